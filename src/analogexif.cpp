@@ -33,6 +33,7 @@
 #include <QSysInfo>
 #include <QTimer>
 #include <QImageReader>
+#include <QElapsedTimer>
 
 // digiKam includes
 
@@ -45,6 +46,14 @@
 #include "autofillexpnum.h"
 #include "progressdialog.h"
 #include "copymetadatadialog.h"
+#include "libraryconnectionmanager.h"
+#include "gearfilter.h"
+#include "thumbnailcache.h"
+#include "directorywalker.h"
+#include "imageformats.h"
+#include "metadataarchive.h"
+#include "backupstore.h"
+#include "atomicwriter.h"
 
 const QUrl AnalogExif::helpUrl("http://analogexif.sourceforge.net/help/");
 
@@ -52,8 +61,16 @@ AnalogExif::AnalogExif(DPluginGeneric* const tool, DInfoInterface* const iface)
     : QMainWindow(nullptr),
       m_tool(tool),
       m_iface(iface),
-      m_fileIconProvider(nullptr)
+      m_fileIconProvider(nullptr),
+      m_thumbnailPrefetcher(nullptr),
+      m_folderWatcher(nullptr),
+      m_previewScheduler(nullptr),
+      curFileChanged(false),
+      batchesRunning(0),
+      curFileWritten(false)
 {
+    startupTimer.start();
+
     ui.setupUi(this);
 
     /// setup tree view
@@ -74,7 +91,7 @@ AnalogExif::AnalogExif(DPluginGeneric* const tool, DInfoInterface* const iface)
     fileViewModel->setFilter(QDir::Files);
     // show supported files only
     fileViewModel->setNameFilterDisables(false);
-    fileViewModel->setNameFilters(QStringList() << "*.jpg" << "*.jpeg" << "*.jpe" << "*.tif" << "*.tiff" << "*.dng" << "*.jp2" << "*.jpf" << "*.jpx" << "*.j2k" << "*.j2c" << "*.jpc" << "*.psd");
+    fileViewModel->setNameFilters(ImageFormats::nameFilters(ImageFormats::WriteInPlace));
     fileViewModel->setReadOnly(false);
     fileSorter = new DirSortFilterProxyModel(this);
     fileSorter->setSourceModel(fileViewModel);
@@ -121,13 +138,13 @@ AnalogExif::AnalogExif(DPluginGeneric* const tool, DInfoInterface* const iface)
 
     setWindowTitle(QCoreApplication::applicationName());
 
-#ifndef Q_WS_MAC
-
-    // connect preview updates
-    connect(this, SIGNAL(updatePreview()), this,
-            SLOT(previewUpdate()), Qt::BlockingQueuedConnection);
+    // fold the library write-ahead log back periodically
+    checkpointTimer.setInterval(LibraryConnectionManager::checkpointInterval);
+    connect(&checkpointTimer, SIGNAL(timeout()), this, SLOT(checkpointLibrary()));
 
-#endif
+    previewResizeTimer.setSingleShot(true);
+    previewResizeTimer.setInterval(150);
+    connect(&previewResizeTimer, SIGNAL(timeout()), this, SLOT(previewResize()));
 
     contextMenus.clear();
 
@@ -171,7 +188,10 @@ AnalogExif::~AnalogExif()
     delete dirViewModel;
     delete fileSorter;
     delete fileViewModel;
+    delete m_thumbnailPrefetcher;
+    delete m_folderWatcher;
     delete m_fileIconProvider;
+    delete m_previewScheduler;
 
     // delete filePreviewPixmap;exifTreeModel
 }
@@ -218,17 +238,38 @@ bool AnalogExif::initialize()
         }
     }
 
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+
     db = QSqlDatabase::addDatabase("QSQLITE");
 
     if(!open(dbName))
         return false;
 
+    checkpointTimer.start();
+
+    logStartupPhase("library", phaseTimer);
+
     // set exif metadata model
     exifTreeModel      = new ExifTreeModel(this);
     exifItemDelegate   = new ExifItemDelegate(this);
-    m_fileIconProvider = new FileIconProvider(exifTreeModel);
+    m_fileIconProvider = new FileIconProvider;
     fileViewModel->setIconProvider(m_fileIconProvider);
+    fileSorter->setThumbnailProvider(m_fileIconProvider);
+    m_thumbnailPrefetcher = new ThumbnailPrefetcher(ui.fileView, m_fileIconProvider);
+
+    // keep thumbnails, folder listings and the open file in sync with the disk
+    m_folderWatcher = new FolderWatcher;
+    connect(m_folderWatcher, SIGNAL(filesChanged(QStringList)),
+            this, SLOT(folderFilesChanged(QStringList)));
+
+    // previews are decoded on their own threads
+    m_previewScheduler = new PreviewScheduler(exifTreeModel);
+    connect(m_previewScheduler, SIGNAL(previewReady(QString,QImage)),
+            this, SLOT(previewLoaded(QString,QImage)));
     
+    logStartupPhase("metadata model", phaseTimer);
+
     ui.metadataView->setModel(exifTreeModel);
     ui.metadataView->setItemDelegateForColumn(1, exifItemDelegate);
 
@@ -242,37 +283,54 @@ bool AnalogExif::initialize()
     // span the categories to full row
     setupTreeView();
 
-    // films view
+    // equipment models are filled once the window is shown
     filmsList = new GearListModel(this, 2, tr("No film defined"));
-    filmsList->reload();
-
     ui.filmView->setModel(filmsList);
     connect(ui.filmView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
             this, SLOT(filmAndGearView_selectionChanged(const QItemSelection&, const QItemSelection&)));
 
-    // authors view
     authorsList = new GearListModel(this, 4, tr("No authors defined"));
-    authorsList->reload();
-
     ui.authorView->setModel(authorsList);
     connect(ui.authorView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
             this, SLOT(filmAndGearView_selectionChanged(const QItemSelection&, const QItemSelection&)));
 
-    // developers view
     developersList = new GearListModel(this, 3, tr("No developers defined"));
-    developersList->reload();
-
     ui.developerView->setModel(developersList);
     connect(ui.developerView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
             this, SLOT(filmAndGearView_selectionChanged(const QItemSelection&, const QItemSelection&)));
 
-    // gear view
     gearList = new GearTreeModel(this);
-    gearList->reload();
     ui.gearView->setModel(gearList);
     connect(ui.gearView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
             this, SLOT(filmAndGearView_selectionChanged(const QItemSelection&, const QItemSelection&)));
 
+    connect(ui.fileView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
+            this, SLOT(fileView_selectionChanged(const QItemSelection&, const QItemSelection&)));
+
+    logStartupPhase("views", phaseTimer);
+
+    // everything else is not needed for the first paint
+    QTimer::singleShot(0, this, SLOT(initializeDeferred()));
+
+    return true;
+}
+
+void AnalogExif::logStartupPhase(const char* phase, QElapsedTimer& phaseTimer)
+{
+    qDebug("AnalogExif: startup phase %s: %lld ms (%lld ms total)", phase, phaseTimer.restart(), startupTimer.elapsed());
+}
+
+// second part of the initialization, runs after the window is shown
+void AnalogExif::initializeDeferred()
+{
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+
+    filmsList->reload();
+    authorsList->reload();
+    developersList->reload();
+    gearList->reload();
+
     filmsList->setApplicable(true);
     gearList->setApplicable(true);
     developersList->setApplicable(true);
@@ -283,10 +341,12 @@ bool AnalogExif::initialize()
 
     ui.gearView->expandAll();
 
-    // start scan
-    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+    applyGearFilters();
+
+    logStartupPhase("equipment", phaseTimer);
+
+    // start scan, QFileSystemModel gathers the entries in its own thread
     dirViewModel->setRootPath(QDir::rootPath());
-    QApplication::restoreOverrideCursor();
 
     dirSorter->setSourceModel(dirViewModel);
 
@@ -298,9 +358,6 @@ bool AnalogExif::initialize()
     connect(ui.dirView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
             this, SLOT(dirView_selectionChanged(const QItemSelection&, const QItemSelection&)));
 
-    connect(ui.fileView->selectionModel(), SIGNAL(selectionChanged(const QItemSelection&, const QItemSelection&)),
-            this, SLOT(fileView_selectionChanged(const QItemSelection&, const QItemSelection&)));
-
     QString currFolder = QDir::homePath();
 
     if (m_iface)
@@ -325,15 +382,16 @@ bool AnalogExif::initialize()
         QTimer::singleShot(200, this, SLOT(scrollToSelectedDir()));
 #endif
 
-        QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
         fileViewModel->setRootPath(currFolder);
-        QApplication::restoreOverrideCursor();
+        m_folderWatcher->watch(currFolder);
 
         fileSorter->setSourceModel(fileViewModel);
         ui.fileView->setRootIndex(fileSorter->mapFromSource(fileViewModel->index(currFolder)));
     }
 
-    return true;
+    logStartupPhase("folders", phaseTimer);
+
+    qDebug("AnalogExif: AnalogExif::initializeDeferred() time to interactive %lld ms", startupTimer.elapsed());
 }
 
 void AnalogExif::scrollToSelectedDir()
@@ -342,6 +400,96 @@ void AnalogExif::scrollToSelectedDir()
         ui.dirView->scrollTo(curDirIndex, QAbstractItemView::PositionAtCenter);
 }
 
+void AnalogExif::checkpointLibrary()
+{
+    LibraryConnectionManager::checkpoint();
+}
+
+void AnalogExif::filterGearList(QListView* view, GearListModel* model, const QString& text)
+{
+    bool showAll = text.trimmed().isEmpty();
+    QSet<int> ids;
+
+    if(!showAll)
+    {
+        ids = GearFilter::match(text, QList<int>() << model->type());
+
+        // rows fetched later would show up unfiltered
+        while(model->canFetchMore(QModelIndex()))
+            model->fetchMore(QModelIndex());
+    }
+
+    // rows are only hidden, the model is not reloaded
+    for(int row = 0; row < model->rowCount(QModelIndex()); row++)
+    {
+        int id = model->gearId(row);
+
+        view->setRowHidden(row, !showAll && (id != -1) && !ids.contains(id));
+    }
+}
+
+void AnalogExif::filterGearTree(const QString& text)
+{
+    if(gearList->bodyCount() == 0)
+        return;
+
+    bool showAll = text.trimmed().isEmpty();
+    QSet<int> ids;
+
+    if(!showAll)
+        ids = GearFilter::match(text, QList<int>() << 0 << 1);
+
+    for(int row = 0; row < gearList->rowCount(); row++)
+    {
+        QStandardItem* body = gearList->item(row);
+        bool bodyMatches = showAll || ids.contains(body->data().toInt());
+        bool lensMatches = false;
+
+        // matching body shows all its lenses
+        for(int lensRow = 0; lensRow < body->rowCount(); lensRow++)
+        {
+            bool matches = bodyMatches || ids.contains(body->child(lensRow)->data().toInt());
+
+            ui.gearView->setRowHidden(lensRow, body->index(), !matches);
+            lensMatches |= matches;
+        }
+
+        ui.gearView->setRowHidden(row, QModelIndex(), !bodyMatches && !lensMatches);
+    }
+}
+
+void AnalogExif::applyGearFilters()
+{
+    filterGearTree(ui.gearFilter->text());
+    filterGearList(ui.filmView, filmsList, ui.filmFilter->text());
+    filterGearList(ui.developerView, developersList, ui.developerFilter->text());
+    filterGearList(ui.authorView, authorsList, ui.authorFilter->text());
+}
+
+void AnalogExif::on_gearFilter_textChanged(const QString& text)
+{
+    if(gearList)
+        filterGearTree(text);
+}
+
+void AnalogExif::on_filmFilter_textChanged(const QString& text)
+{
+    if(filmsList)
+        filterGearList(ui.filmView, filmsList, text);
+}
+
+void AnalogExif::on_developerFilter_textChanged(const QString& text)
+{
+    if(developersList)
+        filterGearList(ui.developerView, developersList, text);
+}
+
+void AnalogExif::on_authorFilter_textChanged(const QString& text)
+{
+    if(authorsList)
+        filterGearList(ui.authorView, authorsList, text);
+}
+
 void AnalogExif::dirView_selectionChanged(const QItemSelection& selected, const QItemSelection&)
 {
     // map selection to original
@@ -402,6 +550,13 @@ void AnalogExif::dirView_selectionChanged(const QItemSelection& selected, const
         {
             QString selFolderName = dirViewModel->filePath(dirSorter->mapToSource(curDirIndex));
             QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+            if(m_fileIconProvider)
+                m_fileIconProvider->cancelPending();
+
+            if(m_folderWatcher)
+                m_folderWatcher->watch(selFolderName);
+
             fileViewModel->setFilter(0);
             ui.fileView->setRootIndex(fileSorter->mapFromSource(fileViewModel->setRootPath(selFolderName)));
             fileViewModel->setFilter(QDir::Files);
@@ -429,6 +584,7 @@ void AnalogExif::dirView_selectionChanged(const QItemSelection& selected, const
     ui.actionOpen_external->setEnabled(false);
 
     // clear file preview
+    m_previewScheduler->cancel();
     ui.filePreview->setPixmap(QPixmap());
 
     // clear metatags
@@ -533,14 +689,7 @@ void AnalogExif::fileView_selectionChanged(const QItemSelection&, const QItemSel
 
             // load preview in the background
             ui.filePreview->setPixmap(QPixmap());
-#ifdef Q_WS_MAC
-            // Background loading doesn't work properly for Mac
-            QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
             loadPreview(curFileName);
-            QApplication::restoreOverrideCursor();
-#else
-            QFuture<void> future = QtConcurrent::run(this, &AnalogExif::loadPreview, curFileName);
-#endif
             exifTreeModel->setReadonly(false);
 
             previewIndex = selIdx.at(0);
@@ -562,6 +711,7 @@ void AnalogExif::fileView_selectionChanged(const QItemSelection&, const QItemSel
     ui.actionOpen_external->setEnabled(false);
 
     // clear file preview
+    m_previewScheduler->cancel();
     ui.filePreview->setPixmap(QPixmap());
 
     // clear metatags
@@ -615,6 +765,7 @@ void AnalogExif::openLocation(QString path)
         ui.directoryLine->setText(QDir::toNativeSeparators(path));
 
         // clear file preview
+        m_previewScheduler->cancel();
         ui.filePreview->setPixmap(QPixmap());
 
         // clear metatags
@@ -645,14 +796,7 @@ void AnalogExif::openLocation(QString path)
 
         // load preview in the background
         ui.filePreview->setPixmap(QPixmap());
-#ifdef Q_WS_MAC
-        // Background loading doesn't work properly for Mac
-        QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
         loadPreview(curFileName);
-        QApplication::restoreOverrideCursor();
-#else
-        QFuture<void> future = QtConcurrent::run(this, &AnalogExif::loadPreview, curFileName);
-#endif
         // directory index
         curDirIndex = dirSorter->mapFromSource(dirViewModel->index(fileInfo.path()));
     }
@@ -677,62 +821,120 @@ void AnalogExif::openLocation(QString path)
     ui.fileView->scrollTo(previewIndex, QAbstractItemView::PositionAtCenter);
 }
 
-// background preview loader
+// request preview of the open file
 void AnalogExif::loadPreview(const QString& filename)
 {
-    // show file preview and details
+    QSize previewSize = ui.filePreviewGroupBox->contentsRect().size();
+    QSize targetSize(previewSize.width()-30, previewSize.height()-30);
+
+    // embedded preview is taken from the open file, decoded in the background
+    QByteArray embeddedPreview = exifTreeModel->getEmbeddedPreview(qMax(targetSize.width(), targetSize.height()));
+
+    m_previewScheduler->request(filename, embeddedPreview, targetSize);
+}
+
+void AnalogExif::previewLoaded(const QString& filePath, const QImage& preview)
+{
+    // another file selected meanwhile
+    if(filePath != curFileName)
+        return;
 
-    // try to load preview
-    QImage preview = exifTreeModel->getPreview(filename);
+    filePreviewPixmap = QPixmap::fromImage(preview, Qt::ThresholdDither);
+    ui.filePreview->setPixmap(filePreviewPixmap);
+}
 
-    if (!preview.isNull())
+void AnalogExif::folderFilesChanged(const QStringList& filePaths)
+{
+    foreach(const QString& filePath, filePaths)
     {
-        filePreviewPixmap = QPixmap::fromImage(preview);
+        m_fileIconProvider->invalidate(filePath);
+
+        if(!curFileName.isEmpty() && (QDir::cleanPath(curFileName) == filePath))
+            curFileChanged = true;
     }
-    else
-    {
-        // check whether image is supported
-        QList<QByteArray> supportedImgs = QImageReader::supportedImageFormats();
 
-        if(!supportedImgs.contains(filename.section(".", -1).toLatin1()))
-            return;
+    if(curFileChanged)
+        reloadChangedFile();
+}
 
-        // show the full image otherwise
-        if(!filePreviewPixmap.load(filename, 0, Qt::ThresholdDither))
-            return;
+void AnalogExif::reloadChangedFile()
+{
+    if(!curFileChanged || curFileName.isEmpty())
+        return;
+
+    // unsaved changes win
+    if(dirty)
+    {
+        curFileChanged = false;
+        return;
     }
 
-    QSize previewSize = ui.filePreviewGroupBox->contentsRect().size();
+    // metadata model is in use by a batch operation, try later
+    if(batchesRunning > 0)
+    {
+        QTimer::singleShot(500, this, SLOT(reloadChangedFile()));
+        return;
+    }
 
-    // ui.filePreview->setPixmap(filePreviewPixmap->scaled(previewSize.width()-30, previewSize.height()-30, Qt::KeepAspectRatio));
-    filePreviewPixmap = filePreviewPixmap.scaled(previewSize.width()-30, previewSize.height()-30, Qt::KeepAspectRatio);
+    curFileChanged = false;
 
-#ifdef Q_WS_MAC
+    QFileInfo fileInfo(curFileName);
 
-    // preview is loaded on the same thread under Mac
-    previewUpdate();
+    if(!fileInfo.exists())
+        return;
 
-#else
+    // written by the application itself, the model is up to date
+    if(ownWriteTime.isValid() && (fileInfo.lastModified() == ownWriteTime))
+        return;
 
-    emit updatePreview();
+    qDebug("AnalogExif: AnalogExif::reloadChangedFile() %s changed on disk", qPrintable(curFileName));
 
-#endif
+    if(exifTreeModel->openFile(QDir::toNativeSeparators(curFileName)))
+    {
+        setupTreeView();
+        loadPreview(curFileName);
+    }
 }
 
-void AnalogExif::previewUpdate()
+void AnalogExif::batchFileWritten(const QString& filePath)
 {
-    ui.filePreview->setPixmap(filePreviewPixmap);
+    if(!curFileName.isEmpty() && (QFileInfo(filePath).canonicalFilePath() == QFileInfo(curFileName).canonicalFilePath()))
+        curFileWritten = true;
+}
+
+void AnalogExif::beginBatch()
+{
+    batchesRunning++;
+    curFileWritten = false;
+}
+
+void AnalogExif::endBatch()
+{
+    // called after the final flush, the file has its new time stamp
+    if(curFileWritten)
+        ownWriteTime = QFileInfo(curFileName).lastModified();
+
+    curFileWritten = false;
+    batchesRunning--;
+
+    // changes of other tools seen meanwhile
+    if(curFileChanged)
+        QTimer::singleShot(0, this, SLOT(reloadChangedFile()));
 }
 
 // on main window resize event
 void AnalogExif::resizeEvent(QResizeEvent *)
 {
-    // rescale the pixmap
-    if(!ui.filePreview->pixmap()->isNull())
-    {
-        QSize previewSize = ui.filePreviewGroupBox->contentsRect().size();
-        ui.filePreview->setPixmap(filePreviewPixmap.scaled(previewSize.width()-30, previewSize.height()-30, Qt::KeepAspectRatio));
-    }
+    // rescale once the window stops changing, the current pixmap stays meanwhile
+    if(m_previewScheduler && ui.filePreview->pixmap() && !ui.filePreview->pixmap()->isNull())
+        previewResizeTimer.start();
+}
+
+void AnalogExif::previewResize()
+{
+    QSize previewSize = ui.filePreviewGroupBox->contentsRect().size();
+
+    m_previewScheduler->resize(QSize(previewSize.width()-30, previewSize.height()-30));
 }
 
 // apply changes
@@ -741,80 +943,32 @@ void AnalogExif::on_applyChangesBtn_clicked()
     save();
 }
 
-bool AnalogExif::createBackup(QString filename, bool singleFile, QMessageBox::StandardButton& prevResult)
+bool AnalogExif::createBackup(const QString& filename, BackupPolicy& backups)
 {
-    // save data
-    if(settings.value("CreateBackups", true).toBool())
-    {
-        QMessageBox::StandardButton res = QMessageBox::Yes;
-        QMessageBox::StandardButtons btns = QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel;
-
-        if(!singleFile)
-        {
-            btns |= QMessageBox::YesToAll | QMessageBox::NoToAll;
-        }
-
-        // create backup
-        if(QFile::exists(filename + ".bak"))
-        {
-            // skip question if Yes/NoToAll was previously selected
-            if((prevResult != QMessageBox::YesToAll) && (prevResult != QMessageBox::NoToAll))
-            {
-                // otherwise - set previous choice as default
-                res = QMessageBox::question(this, tr("Backup file exists"),
-                    tr("Backup file %1 already exists.\n\nOverwrite backup file?").arg(QDir::toNativeSeparators(filename + ".bak")),
-                    btns, prevResult);
-            }
-            else
-            {
-                res = prevResult;
-            }
-
-            if(res == QMessageBox::Cancel)
-                return false;
-
-            if((res == QMessageBox::Yes) || (res == QMessageBox::YesToAll))
-            {
-                if(!QFile::remove(filename + ".bak"))
-                {
-                    QMessageBox::critical(this, tr("Save error"), tr("Unable to remove backup file %1.").arg(QDir::toNativeSeparators(filename + ".bak")));
-                    return false;
-                }
-            }
-        }
-        if((res == QMessageBox::Yes) || (res == QMessageBox::YesToAll))
-        {
-            QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-
-            QTime timer;
-            ProgressDialog progress(tr("Creating backup"), "Please wait...", "", this, 0, 100);
-            QFuture<bool> future = QtConcurrent::run(&QFile::copy, filename, filename + ".bak");
-            progress.setValue(0);
-
-            while(!future.isFinished())
-            {
-                if((timer.elapsed() > 500) && (!progress.isVisible()))
-                    progress.show();
+    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 
-                progress.setValue(timer.elapsed() / 1000);
+    QString errorFile;
+    QFuture<BackupPolicy::Status> future = QtConcurrent::run(&backups, &BackupPolicy::backup, filename, &errorFile);
 
-                QCoreApplication::processEvents();
-                QCoreApplication::sendPostedEvents();
-            }
+    // keeps serving the overwrite question
+    while(!future.isFinished())
+    {
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents();
+    }
 
-            QApplication::restoreOverrideCursor();
+    QApplication::restoreOverrideCursor();
 
-            if(!future)
-            {
-                QMessageBox::critical(this, tr("Save error"), tr("Unable to create backup file:\n%1.").arg(QDir::toNativeSeparators(filename + ".bak")));
-    
-                return false;
-            }
-        }
-        prevResult = res;
+    switch(future.result())
+    {
+    case BackupPolicy::Cancelled:
+        return false;
+    case BackupPolicy::Failed:
+        QMessageBox::critical(this, tr("Save error"), backups.errorMessage(errorFile));
+        return false;
+    default:
+        return true;
     }
-
-    return true;
 }
 
 bool AnalogExif::save()
@@ -831,11 +985,6 @@ bool AnalogExif::save()
         selIdx = ui.dirView->selectionModel()->selectedRows();
     }
 
-    // save backup answer
-    QMessageBox::StandardButton saveBkp = QMessageBox::No;
-    // single selection
-    bool singleFile = false;
-
     // prepare metadata to save
     if(!exifTreeModel->prepareMetadata())
     {
@@ -843,55 +992,13 @@ bool AnalogExif::save()
         return false;
     }
 
-    // browse through all selected indexes
-    QStringList fileNames = getFileList(selIdx);
+    // files are written while the folders are being scanned
+    int filesWritten = runBatch(selIdx, [this](const QString& fName) { return exifTreeModel->saveFile(fName, false); },
+                                tr("Saving metadata..."), tr("Save error"), tr("Unable to save %1."));
 
-    if(fileNames.count() < 1)
+    if(filesWritten < 1)
         return false;
 
-    ProgressDialog progress(tr("Saving metadata..."), "", tr("Cancel"), this, 0, fileNames.count());
-    QTime time;
-    time.start();
-
-    int filesProcessed = 0;
-
-    if(fileNames.count() == 1)
-        singleFile = true;
-
-    foreach(QString fName, fileNames)
-    {
-        progress.setValue(filesProcessed);
-        progress.setLabelText(tr("Saving %1...").arg(fName));
-
-        // check elapsed time, show progress dialog if required
-        if((time.elapsed() > 500) && (!progress.isVisible()))
-            progress.show();
-
-        // create backup
-        if(!createBackup(fName, singleFile, saveBkp))
-            return false;
-
-        // save metadata in another thread, do not replace
-        QFuture<bool> future = QtConcurrent::run(exifTreeModel, &ExifTreeModel::saveFile, fName, false);
-
-        while(!future.isFinished())
-        {
-            QCoreApplication::processEvents();
-            QCoreApplication::sendPostedEvents();
-
-            if(progress.wasCanceled())
-                return false;
-        }
-
-        if(!future.result())
-        {
-            QMessageBox::critical(this, tr("Save error"), tr("Unable to save %1.").arg(QDir::toNativeSeparators(fName)));
-            return false;
-        }
-
-        filesProcessed++;
-    }
-
     // clear dirty flags
     exifTreeModel->resetDirty();
     setDirty(false);
@@ -966,6 +1073,12 @@ void AnalogExif::closeEvent(QCloseEvent *event)
     // save required settings
     settings.setValue("dbName", db.databaseName());
 
+    // leave the library as a single file
+    checkpointTimer.stop();
+    LibraryConnectionManager::checkpoint(true);
+
+    qDebug("AnalogExif: AnalogExif::closeEvent() thumbnail cache: %s", qPrintable(ThumbnailCache::statistics()));
+
     // save window state and geometry
     settings.setValue("WindowState", saveState());
     settings.setValue("WindowGeometry", saveGeometry());
@@ -1120,6 +1233,8 @@ void AnalogExif::on_actionEdit_gear_triggered(bool)
         filmsList->reload();
         authorsList->reload();
         developersList->reload();
+
+        applyGearFilters();
     }
 
     // repopulate metadata
@@ -1213,7 +1328,7 @@ void AnalogExif::on_actionOpen_triggered(bool)
     if(!checkForDirty())
         return;
 
-    QString filename = QFileDialog::getOpenFileName(this, tr("Select file to open..."), QDir::fromNativeSeparators(ui.directoryLine->text()), tr("JPEG images (*.jpg *.jpeg *jpe);;JPEG2000 images (*.jpf *.jpx *.jp2 *.j2c *.j2k *.jpc);;TIFF images (*.tif *.tiff);;DNG images (*.dng);;Photoshop PSD images (*.psd);;Camera raw images (*.cr2 *.nef *.pef *.rw2 *.arw *.sr2 *.orf *.raf *.mrw);;All files (*.*)"));
+    QString filename = QFileDialog::getOpenFileName(this, tr("Select file to open..."), QDir::fromNativeSeparators(ui.directoryLine->text()), ImageFormats::fileDialogFilter());
 
     if(!filename.isNull())
         openLocation(filename);
@@ -1329,6 +1444,8 @@ void AnalogExif::on_actionOpen_library_triggered(bool)
         developersList->reload();
         authorsList->reload();
 
+        applyGearFilters();
+
         exifTreeModel->repopulate();
 
         // setup tree
@@ -1367,6 +1484,8 @@ void AnalogExif::on_actionNew_library_triggered(bool)
         developersList->reload();
         authorsList->reload();
 
+        applyGearFilters();
+
         exifTreeModel->repopulate();
 
         // setup tree
@@ -1376,38 +1495,139 @@ void AnalogExif::on_actionNew_library_triggered(bool)
     }
 }
 
-// open new database
-bool AnalogExif::open(QString dbName)
+// import equipment
+void AnalogExif::on_actionImport_library_triggered(bool)
 {
-    // close if open
-    if(db.isOpen())
-        db.close();
+    if(!checkForDirty())
+        return;
 
-    // set database name
-    db.setDatabaseName(dbName);
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import equipment"), QDir::fromNativeSeparators(ui.directoryLine->text()), tr("CSV files (*.csv);;JSON files (*.json *.jsonl);;All files (*.*)"));
 
-    // try to open
-    if(!db.open())
-    {
-        QSqlError error = db.lastError();
-        QMessageBox::critical(this, tr("Critical error"), tr("Unable to open database (")+dbName+")");
-        return false;
-    }
+    if(fileName.isNull())
+        return;
 
-    // check database version
-    QSqlQuery query ("SELECT setValue, setValueText FROM Settings WHERE setId=1");
-    query.first();
-    if(query.isValid())
+    LibraryTransfer transfer(LibraryTransfer::formatForFile(fileName));
+
+    if(!runTransfer(transfer, &LibraryTransfer::importLibrary, fileName, tr("Importing equipment...")))
     {
-        if(query.value(0).toInt() != dbVersion)
-        {
-            QMessageBox::critical(this, tr("Critical error"), tr("Unsupported AnalogExif library version:\n"
-                                                                 "Required version %1, found version %2 (%3)").arg(dbVersion).arg(query.value(0).toInt()).arg(query.value(1).toString()));
-            return false;
-        }
+        QMessageBox::critical(this, tr("Import error"), tr("Unable to import equipment from %1:\n\n%2").arg(QDir::toNativeSeparators(fileName)).arg(transfer.errorString()));
+        return;
     }
-    else
-    {
+
+    gearList->reload();
+    filmsList->reload();
+    developersList->reload();
+    authorsList->reload();
+
+    applyGearFilters();
+
+    exifTreeModel->repopulate();
+
+    // setup tree
+    setupTreeView();
+
+    ui.gearView->expandAll();
+}
+
+// export equipment
+void AnalogExif::on_actionExport_library_triggered(bool)
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export equipment"), QDir::fromNativeSeparators(ui.directoryLine->text()), tr("CSV files (*.csv);;JSON files (*.json *.jsonl);;All files (*.*)"));
+
+    if(fileName.isNull())
+        return;
+
+    LibraryTransfer transfer(LibraryTransfer::formatForFile(fileName));
+
+    if(!runTransfer(transfer, &LibraryTransfer::exportLibrary, fileName, tr("Exporting equipment...")))
+    {
+        QMessageBox::critical(this, tr("Export error"), tr("Unable to export equipment to %1:\n\n%2").arg(QDir::toNativeSeparators(fileName)).arg(transfer.errorString()));
+    }
+}
+
+bool AnalogExif::runTransfer(LibraryTransfer& transfer, bool (LibraryTransfer::*method)(const QString&), const QString& fileName, const QString& title)
+{
+    ProgressDialog progress(title, tr("Records processed: 0"), tr("Cancel"), this, 0, 0);
+    QTime timer;
+
+    timer.start();
+
+    QFuture<bool> future = QtConcurrent::run(&transfer, method, fileName);
+
+    int rowsProcessed = 0;
+
+    while(!future.isFinished())
+    {
+        if(transfer.rowsProcessed() != rowsProcessed)
+        {
+            rowsProcessed = transfer.rowsProcessed();
+            progress.setLabelText(tr("Records processed: %1").arg(rowsProcessed));
+        }
+
+        if((timer.elapsed() > 500) && (!progress.isVisible()))
+            progress.show();
+
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents();
+
+        // import is rolled back by the worker
+        if(progress.wasCanceled())
+            transfer.cancel();
+    }
+
+    progress.close();
+
+    return future.result();
+}
+
+// open new database
+bool AnalogExif::open(QString dbName)
+{
+    // drop worker connections to the previous library
+    LibraryConnectionManager::invalidate();
+
+    // close if open
+    if(db.isOpen())
+    {
+        LibraryConnectionManager::checkpoint(true);
+        db.close();
+    }
+
+    // set database name
+    db.setDatabaseName(dbName);
+
+    // try to open
+    if(!db.open())
+    {
+        QSqlError error = db.lastError();
+        QMessageBox::critical(this, tr("Critical error"), tr("Unable to open database (")+dbName+")");
+        return false;
+    }
+
+    // switch to WAL and publish the library to the worker threads
+    if(!LibraryConnectionManager::setupMainConnection(db))
+    {
+        QMessageBox::critical(this, tr("Critical error"), tr("Unable to set up database (")+dbName+")");
+        return false;
+    }
+
+    // full-text gear filter, plain LIKE matching is used when not available
+    GearFilter::setup();
+
+    // check database version
+    QSqlQuery query ("SELECT setValue, setValueText FROM Settings WHERE setId=1");
+    query.first();
+    if(query.isValid())
+    {
+        if(query.value(0).toInt() != dbVersion)
+        {
+            QMessageBox::critical(this, tr("Critical error"), tr("Unsupported AnalogExif library version:\n"
+                                                                 "Required version %1, found version %2 (%3)").arg(dbVersion).arg(query.value(0).toInt()).arg(query.value(1).toString()));
+            return false;
+        }
+    }
+    else
+    {
         QMessageBox::critical(this, tr("Critical error"), tr("Unable to query library version.\nCorrupt or invalid library file?"));
         return false;
     }
@@ -1493,37 +1713,10 @@ QString AnalogExif::createLibrary(QWidget* parent, QString dir)
     return newDb;
 }
 
-void AnalogExif::addFileNames(QStringList& fileNames, const QString& path, bool includeDirs)
+QStringList AnalogExif::selectedPaths(QModelIndexList selIdx)
 {
-    QFileInfo fInfo(path);
-
-    if(!fInfo.exists())
-        return;
-
-    // if file - just add the file to the list
-    if(!fInfo.isDir())
-    {
-        fileNames << QDir::toNativeSeparators(path);
-        filesFound++;
-        return;
-    }
-
-    QStringList subDirs = QDir(path).entryList(QStringList() << "*.jpg" << "*.jpeg" << "*.tif" << "*.tiff", QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot, QDir::Name | QDir::DirsLast | QDir::LocaleAware);
-    foreach(QString dirName, subDirs)
-    {
-        addFileNames(fileNames, path + "/" + dirName, includeDirs);
-    }
-
-    if(includeDirs)
-    {
-        fileNames << QDir::toNativeSeparators(path);
-        filesFound++;
-    }
-}
-
-QStringList AnalogExif::scanSubfolders(QModelIndexList selIdx, bool includeDirs)
-{
-    QStringList fileNames;
+    // models are not for worker threads, resolve paths here
+    QStringList paths;
 
     if(selIdx.count())
     {
@@ -1531,11 +1724,11 @@ QStringList AnalogExif::scanSubfolders(QModelIndexList selIdx, bool includeDirs)
         // browse through all selected indexes
         foreach(QModelIndex idx, selIdx)
         {
-            addFileNames(fileNames, ((QFileSystemModel*)sortModel->sourceModel())->filePath(sortModel->mapToSource(idx)), includeDirs);
+            paths << ((QFileSystemModel*)sortModel->sourceModel())->filePath(sortModel->mapToSource(idx));
         }
     }
 
-    return fileNames;
+    return paths;
 }
 
 QStringList AnalogExif::getFileList(QModelIndexList selIdx, bool includeDirs, bool* cancelled)
@@ -1543,23 +1736,27 @@ QStringList AnalogExif::getFileList(QModelIndexList selIdx, bool includeDirs, bo
     if(cancelled)
         *cancelled = false;
 
-    filesFound = 0;
+    QStringList paths = selectedPaths(selIdx);
+
+    // every format metadata can be written to, checked by contents
+    DirectoryWalker walker(ImageFormats::suffixes(ImageFormats::WriteInPlace), includeDirs);
+    walker.setRequiredCapabilities(ImageFormats::WriteInPlace);
 
     ProgressDialog progress(tr("Scanning subfolders..."), tr("Files found: 0"), tr("Cancel"), this, 0, 500);
     QTime timer;
 
     timer.start();
 
-    QFuture<QStringList> future = QtConcurrent::run(this, &AnalogExif::scanSubfolders, selIdx, includeDirs);
+    QFuture<QStringList> future = QtConcurrent::run(&walker, &DirectoryWalker::walk, paths);
 
     int newFilesFound = 0;
     progress.setValue(0);
 
     while(!future.isFinished())
     {
-        if(filesFound != newFilesFound)
+        if(walker.filesFound() != newFilesFound)
         {
-            newFilesFound = filesFound;
+            newFilesFound = walker.filesFound();
             progress.setValue(newFilesFound);
             progress.setLabelText(tr("Files found: %1").arg(newFilesFound));
         }
@@ -1572,6 +1769,10 @@ QStringList AnalogExif::getFileList(QModelIndexList selIdx, bool includeDirs, bo
 
         if(progress.wasCanceled())
         {
+            // walker lives on the stack, wait for its threads
+            walker.cancel();
+            future.waitForFinished();
+
             if(cancelled)
                 *cancelled = true;
             return QStringList();
@@ -1580,9 +1781,132 @@ QStringList AnalogExif::getFileList(QModelIndexList selIdx, bool includeDirs, bo
 
     progress.close();
 
+    if(walker.filesRejected())
+        qDebug("AnalogExif: AnalogExif::getFileList() %d unsupported file(s) skipped", walker.filesRejected());
+
     return future.result();
 }
 
+int AnalogExif::runBatch(QModelIndexList selIdx, const BatchPipeline::WriteFunction& write,
+                         const QString& title, const QString& errorTitle, const QString& errorText)
+{
+    QStringList paths = selectedPaths(selIdx);
+
+    if(paths.isEmpty())
+        return -1;
+
+    // ends after the final flush, the writer is destroyed first
+    BatchGuard batchGuard(this);
+
+    BackupPolicy backups(settings.value("CreateBackups", true).toBool(), (BackupPolicy::Mode)settings.value("BackupMode", 0).toInt(),
+                         settings.value("BackupStorePath").toString(), this);
+
+    BatchPipeline pipeline(write, this);
+    connect(&pipeline, SIGNAL(fileWritten(QString)), this, SLOT(batchFileWritten(QString)));
+    pipeline.setBackupPolicy(&backups);
+
+    AtomicWriter writer((AtomicWriter::SyncPolicy)settings.value("SyncPolicy", AtomicWriter::SyncAtEnd).toInt());
+
+    if(settings.value("AtomicWrites", false).toBool())
+        pipeline.setAtomicWriter(&writer);
+
+    // total is not known until the scan is done
+    ProgressDialog progress(title, tr("Scanning..."), tr("Cancel"), this, 0, 0);
+    QTime timer;
+
+    timer.start();
+    pipeline.start(paths);
+
+    int filesFound = 0;
+    int filesWritten = 0;
+    QString currentFile;
+
+    while(!pipeline.isFinished())
+    {
+        if(pipeline.filesFound() != filesFound)
+        {
+            filesFound = pipeline.filesFound();
+            progress.setRange(0, filesFound);
+        }
+
+        if(pipeline.filesWritten() != filesWritten)
+        {
+            filesWritten = pipeline.filesWritten();
+            progress.setValue(filesWritten);
+        }
+
+        if(pipeline.currentFile() != currentFile)
+        {
+            currentFile = pipeline.currentFile();
+            progress.setLabelText(tr("Saving %1...").arg(currentFile));
+        }
+
+        // check elapsed time, show progress dialog if required
+        if((timer.elapsed() > 500) && (!progress.isVisible()))
+            progress.show();
+
+        // keeps serving the backup questions, even when cancelled
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents();
+
+        if(progress.wasCanceled())
+        {
+            pipeline.cancel();
+            progress.resetCanceled();
+        }
+    }
+
+    // flush the batch in one go
+    progress.setLabelText(tr("Flushing to disk..."));
+
+    QString failedFile;
+    QFuture<bool> future = QtConcurrent::run(&writer, &AtomicWriter::finish, &failedFile);
+
+    while(!future.isFinished())
+    {
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents();
+    }
+
+    // written file reports still queued
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+
+    progress.close();
+
+    qDebug("AnalogExif: AnalogExif::runBatch() %d of %d file(s) written in %d ms", pipeline.filesWritten(), pipeline.filesFound(), timer.elapsed());
+    qDebug("AnalogExif: AnalogExif::runBatch() backups: %s", qPrintable(backups.statistics()));
+
+    switch(pipeline.error())
+    {
+    case BatchPipeline::NoError:
+        break;
+    case BatchPipeline::BackupCancelled:
+        return -1;
+    case BatchPipeline::BackupFailed:
+        QMessageBox::critical(this, tr("Save error"), backups.errorMessage(pipeline.errorFile()));
+        return -1;
+    case BatchPipeline::WriteFailed:
+        QMessageBox::critical(this, errorTitle, errorText.arg(QDir::toNativeSeparators(pipeline.errorFile())));
+        return -1;
+    }
+
+    // the last written files are put in place by the final flush
+    if(!future.result())
+    {
+        QMessageBox::critical(this, errorTitle, tr("Unable to replace %1 with its updated copy.").arg(QDir::toNativeSeparators(failedFile)));
+        return -1;
+    }
+
+    if(backups.isEnabled() && (backups.mode() == BackupPolicy::CentralStore))
+        pruneBackupStore(backups.store());
+
+    // cancelled by the user
+    if(!pipeline.isScanFinished() || (pipeline.filesWritten() != pipeline.filesFound()))
+        return -1;
+
+    return pipeline.filesWritten();
+}
+
 // auto-fill exposure
 void AnalogExif::on_actionAuto_fill_exposure_triggered(bool)
 {
@@ -1620,13 +1944,23 @@ void AnalogExif::on_actionAuto_fill_exposure_triggered(bool)
     if(autoFillDialog.exec() == QDialog::Accepted)
     {
         QVariantList sortedFiles = autoFillDialog.resultFileNames();
-        QMessageBox::StandardButton saveBkp = QMessageBox::No;
+        BackupPolicy backups(settings.value("CreateBackups", true).toBool(), (BackupPolicy::Mode)settings.value("BackupMode", 0).toInt(),
+                             settings.value("BackupStorePath").toString(), this);
+
+        // ends after the final flush, the writer is destroyed first
+        BatchGuard batchGuard(this);
+
+        AtomicWriter writer((AtomicWriter::SyncPolicy)settings.value("SyncPolicy", AtomicWriter::SyncAtEnd).toInt());
+        bool atomicWrites = settings.value("AtomicWrites", false).toBool();
 
         ProgressDialog progress(tr("Updating files..."), "", tr("Cancel"), this, 0, sortedFiles.count() / 2);
         progress.show();
 
         // mute metadata model to supress model changes
         ui.metadataView->blockSignals(true);
+        exifTreeModel->compileEtagsTemplate();
+
+        bool completed = true;
 
         // browse through all files
         for(int i = 0; i < sortedFiles.count(); i += 2)
@@ -1637,17 +1971,20 @@ void AnalogExif::on_actionAuto_fill_exposure_triggered(bool)
             progress.setLabelText(tr("Updating %1...").arg(fileName));
 
             // create backup, if required
-            if(!createBackup(fileName, false, saveBkp))
+            if(!createBackup(fileName, backups))
             {
-                ui.metadataView->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
-                return;
+                completed = false;
+                break;
             }
 
             QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 
-            QFuture<bool> future = QtConcurrent::run(exifTreeModel, &ExifTreeModel::setExposureNumber, fileName, sortedFiles.at(i+1).toInt());
+            int expNum = sortedFiles.at(i+1).toInt();
+            AtomicWriter::WriteFunction write = [this, expNum](const QString& fName) { return exifTreeModel->setExposureNumber(fName, expNum); };
+
+            // with a group commit the failed file may be an earlier one
+            QString failedFile = fileName;
+            QFuture<bool> future = QtConcurrent::run([&]() { return atomicWrites ? writer.write(fileName, write, &failedFile) : write(fileName); });
 
             while(!future.isFinished())
             {
@@ -1657,33 +1994,249 @@ void AnalogExif::on_actionAuto_fill_exposure_triggered(bool)
 
             QApplication::restoreOverrideCursor();
 
+            if(future.result())
+                batchFileWritten(fileName);
+
             if(progress.wasCanceled())
             {
-                ui.metadataView->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
-
-                return;
+                completed = false;
+                break;
             }
 
             if(!future.result())
             {
-                QMessageBox::critical(this, tr("File save error"), tr("Unable to set exposure number for %1.").arg(fileName));
-
-                ui.metadataView->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
+                QMessageBox::critical(this, tr("File save error"), tr("Unable to set exposure number for %1.").arg(QDir::toNativeSeparators(failedFile)));
 
-                return;
+                completed = false;
+                break;
             }
         }
 
+        // the last group of files is put in place by the final flush
+        progress.setLabelText(tr("Flushing to disk..."));
+
+        QString failedFile;
+        QFuture<bool> flushed = QtConcurrent::run(&writer, &AtomicWriter::finish, &failedFile);
+
+        while(!flushed.isFinished())
+        {
+            QCoreApplication::processEvents();
+            QCoreApplication::sendPostedEvents();
+        }
+
+        progress.close();
+
+        if(!flushed.result())
+        {
+            QMessageBox::critical(this, tr("File save error"), tr("Unable to replace %1 with its updated copy.").arg(QDir::toNativeSeparators(failedFile)));
+        }
+        else if(completed && backups.isEnabled() && (backups.mode() == BackupPolicy::CentralStore))
+        {
+            pruneBackupStore(backups.store());
+        }
+
         ui.metadataView->blockSignals(false);
     }
     exifTreeModel->clear(true);
     setupTreeView();
 }
 
+// restore metadata-only backup
+void AnalogExif::on_actionRestore_metadata_triggered(bool)
+{
+    if(!checkForDirty())
+        return;
+
+    QString startDir = QDir(QDir::fromNativeSeparators(ui.directoryLine->text())).absoluteFilePath(MetadataArchive::folderName);
+    QString archivePath = QFileDialog::getOpenFileName(this, tr("Select metadata backup..."), startDir, tr("Metadata backups (*.%1)").arg(MetadataArchive::fileSuffix));
+
+    if(archivePath.isNull())
+        return;
+
+    QList<MetadataArchive::Entry> entries;
+
+    if(!MetadataArchive::read(archivePath, entries))
+    {
+        QMessageBox::critical(this, tr("Restore error"), tr("Unable to read metadata backup %1.").arg(QDir::toNativeSeparators(archivePath)));
+        return;
+    }
+
+    if(QMessageBox::question(this, tr("Restore metadata"), tr("Restore original metadata of %1 file(s)?").arg(entries.count()),
+                             QMessageBox::Yes | QMessageBox::No, QMessageBox::No) != QMessageBox::Yes)
+        return;
+
+    ProgressDialog progress(tr("Restoring metadata..."), "", tr("Cancel"), this, 0, entries.count());
+    progress.show();
+
+    // restored files are reloaded once the restore is done
+    BatchGuard batchGuard(this);
+
+    // answer for files with changed image data
+    QMessageBox::StandardButton forceAnswer = QMessageBox::No;
+    QStringList failedFiles;
+    int filesRestored = 0;
+    int filesProcessed = 0;
+
+    foreach(const MetadataArchive::Entry& entry, entries)
+    {
+        QString fileName = QDir::toNativeSeparators(MetadataArchive::filePath(archivePath, entry));
+
+        progress.setValue(filesProcessed++);
+        progress.setLabelText(tr("Restoring %1...").arg(fileName));
+
+        bool force = (forceAnswer == QMessageBox::YesToAll);
+        MetadataArchive::RestoreStatus status;
+
+        while(true)
+        {
+            QFuture<MetadataArchive::RestoreStatus> future = QtConcurrent::run(&MetadataArchive::restore, archivePath, entry, force);
+
+            while(!future.isFinished())
+            {
+                QCoreApplication::processEvents();
+                QCoreApplication::sendPostedEvents();
+            }
+
+            status = future.result();
+
+            if((status != MetadataArchive::PayloadChanged) || force || (forceAnswer == QMessageBox::NoToAll))
+                break;
+
+            forceAnswer = QMessageBox::question(this, tr("Image changed"),
+                tr("Image data of %1 differs from the backed up file.\n\nRestore its metadata anyway?").arg(fileName),
+                QMessageBox::Yes | QMessageBox::No | QMessageBox::YesToAll | QMessageBox::NoToAll | QMessageBox::Cancel, QMessageBox::No);
+
+            if((forceAnswer != QMessageBox::Yes) && (forceAnswer != QMessageBox::YesToAll))
+                break;
+
+            force = true;
+        }
+
+        if((forceAnswer == QMessageBox::Cancel) || progress.wasCanceled())
+            break;
+
+        if(status == MetadataArchive::Restored)
+            filesRestored++;
+        else if(status != MetadataArchive::PayloadChanged)
+            failedFiles << fileName;
+    }
+
+    progress.close();
+
+    qDebug("AnalogExif: AnalogExif::on_actionRestore_metadata_triggered() %d of %d file(s) restored", filesRestored, entries.count());
+
+    if(!failedFiles.isEmpty())
+    {
+        QMessageBox::warning(this, tr("Restore error"), tr("Unable to restore metadata of:\n%1").arg(failedFiles.join("\n")));
+    }
+
+    // modified files are picked up by the folder watcher
+}
+
+// drop old jobs of the backup store and the contents only they refer to
+void AnalogExif::pruneBackupStore(BackupStore& store)
+{
+    // off unless set in the options
+    int keepDays = settings.value("BackupStoreKeepDays", 0).toInt();
+
+    if(keepDays <= 0)
+        return;
+
+    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+    QFuture<int> future = QtConcurrent::run(&store, &BackupStore::prune, keepDays);
+
+    while(!future.isFinished())
+    {
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents();
+    }
+
+    QApplication::restoreOverrideCursor();
+}
+
+// restore whole files of a backup store job
+void AnalogExif::on_actionRestore_backup_store_triggered(bool)
+{
+    if(!checkForDirty())
+        return;
+
+    QString storePath = settings.value("BackupStorePath").toString();
+
+    if(storePath.isEmpty())
+        storePath = BackupStore(storePath).location(QDir::fromNativeSeparators(ui.directoryLine->text()));
+
+    QString manifestPath = QFileDialog::getOpenFileName(this, tr("Select backup job..."), storePath + "/jobs", tr("Backup jobs (*.manifest)"));
+
+    if(manifestPath.isNull())
+        return;
+
+    QList<BackupStore::Entry> entries;
+
+    if(!BackupStore::readManifest(manifestPath, entries))
+    {
+        QMessageBox::critical(this, tr("Restore error"), tr("Unable to read backup job %1.").arg(QDir::toNativeSeparators(manifestPath)));
+        return;
+    }
+
+    if(QMessageBox::question(this, tr("Restore backup"), tr("Replace %1 file(s) by their backed up versions?").arg(entries.count()),
+                             QMessageBox::Yes | QMessageBox::No, QMessageBox::No) != QMessageBox::Yes)
+        return;
+
+    ProgressDialog progress(tr("Restoring files..."), "", tr("Cancel"), this, 0, entries.count());
+    progress.show();
+
+    // restored files are reloaded once the restore is done
+    BatchGuard batchGuard(this);
+
+    QStringList failedFiles;
+    QStringList missingFiles;
+    int filesRestored = 0;
+    int filesProcessed = 0;
+
+    foreach(const BackupStore::Entry& entry, entries)
+    {
+        QString fileName = QDir::toNativeSeparators(entry.filePath);
+
+        progress.setValue(filesProcessed++);
+        progress.setLabelText(tr("Restoring %1...").arg(fileName));
+
+        QFuture<BackupStore::RestoreStatus> future = QtConcurrent::run(&BackupStore::restore, manifestPath, entry);
+
+        while(!future.isFinished())
+        {
+            QCoreApplication::processEvents();
+            QCoreApplication::sendPostedEvents();
+        }
+
+        if(future.result() == BackupStore::Restored)
+            filesRestored++;
+        else if(future.result() == BackupStore::ObjectMissing)
+            missingFiles << fileName;
+        else
+            failedFiles << fileName;
+
+        if(progress.wasCanceled())
+            break;
+    }
+
+    progress.close();
+
+    qDebug("AnalogExif: AnalogExif::on_actionRestore_backup_store_triggered() %d of %d file(s) restored", filesRestored, entries.count());
+
+    if(!missingFiles.isEmpty())
+    {
+        QMessageBox::warning(this, tr("Restore error"), tr("Backup contents missing from the store for:\n%1").arg(missingFiles.join("\n")));
+    }
+
+    if(!failedFiles.isEmpty())
+    {
+        QMessageBox::warning(this, tr("Restore error"), tr("Unable to restore:\n%1").arg(failedFiles.join("\n")));
+    }
+
+    // modified files are picked up by the folder watcher
+}
+
 // double-click - launch file
 void AnalogExif::on_fileView_doubleClicked(const QModelIndex& index)
 {
@@ -1844,13 +2397,11 @@ void AnalogExif::on_action_Copy_metadata_triggered(bool)
         selIdx = ui.dirView->selectionModel()->selectedRows();
     }
 
-    QStringList fileNames = getFileList(selIdx);
-
-    if(fileNames.isEmpty())
+    if(selIdx.isEmpty())
         return;
 
     // get source filename
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Select source file for metadata..."), QDir::fromNativeSeparators(ui.directoryLine->text()), tr("JPEG images (*.jpg *.jpeg *jpe);;JPEG2000 images (*.jpf *.jpx *.jp2 *.j2c *.j2k *.jpc);;TIFF images (*.tif *.tiff);;DNG images (*.dng);;Photoshop PSD images (*.psd);;Camera raw images (*.cr2 *.nef *.pef *.rw2 *.arw *.sr2 *.orf *.raf *.mrw);;All files (*.*)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Select source file for metadata..."), QDir::fromNativeSeparators(ui.directoryLine->text()), ImageFormats::fileDialogFilter());
 
     if(fileName.isNull())
         return;
@@ -1861,67 +2412,22 @@ void AnalogExif::on_action_Copy_metadata_triggered(bool)
     if(copyMetadata.exec() == QDialog::Accepted)
     {
         QVariantList data = copyMetadata.getMetadata();
-        QMessageBox::StandardButton saveBkp = QMessageBox::No;
-
-        ProgressDialog progress(tr("Updating files..."), "", tr("Cancel"), this, 0, fileNames.count());
-        progress.show();
-
-        int nFiles = 0;
-        progress.setValue(nFiles);
 
         exifTreeModel->blockSignals(true);
+        exifTreeModel->compileEtagsTemplate();
 
-        // browse through all files
-        foreach(QString fName, fileNames)
-        {
-            progress.setLabelText(tr("Updating %1...").arg(fName));
-
-            // create backup, if required
-            if(!createBackup(fName, false, saveBkp))
-            {
-                exifTreeModel->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
-                return;
-            }
-
-            QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-            QFuture<bool> future = QtConcurrent::run(exifTreeModel, &ExifTreeModel::mergeMetadata, fName, data);
-
-            while(!future.isFinished())
-            {
-                QCoreApplication::processEvents();
-                QCoreApplication::sendPostedEvents();
-            }
-
-            QApplication::restoreOverrideCursor();
-
-            if(progress.wasCanceled())
-            {
-                exifTreeModel->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
-
-                return;
-            }
-
-            if(!future.result())
-            {
-                QMessageBox::critical(this, tr("File save error"), tr("Unable to set metadata for %1.").arg(fName));
-
-                exifTreeModel->blockSignals(false);
-                exifTreeModel->clear(true);
-                setupTreeView();
-
-                return;
-            }
-
-            nFiles++;
-            progress.setValue(nFiles);
-        }
+        // files are updated while the folders are being scanned
+        int filesWritten = runBatch(selIdx, [this, &data](const QString& fName) { return exifTreeModel->mergeMetadata(fName, data); },
+                                    tr("Updating files..."), tr("File save error"), tr("Unable to set metadata for %1."));
 
         exifTreeModel->blockSignals(false);
         exifTreeModel->clear(true);
+
+        if(filesWritten < 0)
+        {
+            setupTreeView();
+            return;
+        }
     }
 
     if(!selectedFname.isEmpty())
@@ -31,6 +31,9 @@
 #include <QCompleter>
 #include <QMessageBox>
 #include <QNetworkReply>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDateTime>
 
 // digiKam includes
 
@@ -48,8 +51,14 @@
 #include "dirsortfilterproxymodel.h"
 #include "exiftreemodel.h"
 #include "exifitemdelegate.h"
+#include "fileiconprovider.h"
+#include "previewscheduler.h"
+#include "thumbnailprefetcher.h"
+#include "folderwatcher.h"
+#include "batchpipeline.h"
 #include "gearlistmodel.h"
 #include "geartreemodel.h"
+#include "librarytransfer.h"
 
 using namespace Digikam;
 
@@ -69,6 +78,9 @@ private:
     DPluginGeneric*             m_tool;
     DInfoInterface*             m_iface;
     FileIconProvider*           m_fileIconProvider;
+    ThumbnailPrefetcher*        m_thumbnailPrefetcher;
+    FolderWatcher*              m_folderWatcher;
+    PreviewScheduler*           m_previewScheduler;
     
     Ui::AnalogExifClass         ui;
     QSettings                   settings;
@@ -110,14 +122,31 @@ private:
     // database
     QSqlDatabase                db;
 
+    // periodic WAL checkpoint
+    QTimer                      checkpointTimer;
+
+    // time since the window was created, for startup measurements
+    QElapsedTimer               startupTimer;
+
+    // preview rescale is delayed until the window stops resizing
+    QTimer                      previewResizeTimer;
+
     bool dirty;
 
+    // open file changed on disk, reload pending
+    bool                        curFileChanged;
+
+    // batch operations writing files, no reloads meanwhile
+    int                         batchesRunning;
+    // open file was written by the running batch
+    bool                        curFileWritten;
+    // modification time of the open file after the application wrote it
+    QDateTime                   ownWriteTime;
+
     // preview file index
     QModelIndex                 previewIndex;
     QModelIndex                 curDirIndex;
 
-    int filesFound;
-
     // current version of the database
     static const int            dbVersion = 1;
 
@@ -153,8 +182,8 @@ private:
         ui.applyChangesBtn->setEnabled(isDirty);
     }
 
-    // create backup
-    bool createBackup(QString filename, bool singleFile, QMessageBox::StandardButton& prevResult);
+    // back up a single file before writing it, false if failed or cancelled
+    bool createBackup(const QString& filename, BackupPolicy& backups);
 
     // save data
     bool save();
@@ -165,7 +194,7 @@ private:
     // create new database
     QString createLibrary(QWidget* parent = 0, QString dir = QString());
 
-    // background preview loader
+    // request preview of the open file in the background
     void loadPreview(const QString& filename);
 
     // open specified location
@@ -186,15 +215,52 @@ private:
     // open the file in the shell
     void openExternal(const QModelIndex& index);
 
+    // log duration of the startup phase and restart its timer
+    void logStartupPhase(const char* phase, QElapsedTimer& phaseTimer);
+
+    // paths of the selected files and folders
+    QStringList selectedPaths(QModelIndexList selIdx);
+
     // async get file list
     QStringList getFileList(QModelIndexList selIdx, bool includeDirs = false, bool* cancelled = 0);
 
-    void addFileNames(QStringList& fileNames, const QString& path, bool includeDirs = false);
-    QStringList scanSubfolders(QModelIndexList selIdx, bool includeDirs = false);
+    // write metadata to all files of the selection while scanning it,
+    // returns number of files written or -1 if failed or cancelled
+    int runBatch(QModelIndexList selIdx, const BatchPipeline::WriteFunction& write,
+                 const QString& title, const QString& errorTitle, const QString& errorText);
 
-Q_SIGNALS:
+    // batch operation writing files, the open file is not reloaded meanwhile
+    class BatchGuard
+    {
+    public:
+        explicit BatchGuard(AnalogExif* owner)
+            : m_owner(owner)
+        {
+            m_owner->beginBatch();
+        }
 
-    void updatePreview();
+        ~BatchGuard()
+        {
+            m_owner->endBatch();
+        }
+
+    private:
+        AnalogExif* m_owner;
+    };
+
+    void beginBatch();
+    void endBatch();
+
+    // remove old jobs from the stores used by the batch, if enabled in the options
+    void pruneBackupStore(BackupStore& store);
+
+    // hide gear not matching the filter text
+    void filterGearList(QListView* view, GearListModel* model, const QString& text);
+    void filterGearTree(const QString& text);
+    void applyGearFilters();
+
+    // run library import or export in the background
+    bool runTransfer(LibraryTransfer& transfer, bool (LibraryTransfer::*method)(const QString&), const QString& fileName, const QString& title);
 
 private Q_SLOTS:
 
@@ -234,6 +300,10 @@ private Q_SLOTS:
     void on_actionOpen_library_triggered(bool checked = false);
     // create new gear database
     void on_actionNew_library_triggered(bool checked = false);
+    // import equipment from file
+    void on_actionImport_library_triggered(bool checked = false);
+    // export equipment to file
+    void on_actionExport_library_triggered(bool checked = false);
     // file browser selection changed
     void fileView_selectionChanged(const QItemSelection&, const QItemSelection&);
     void dirView_selectionChanged(const QItemSelection&, const QItemSelection&);
@@ -252,16 +322,42 @@ private Q_SLOTS:
     void on_actionRemove_triggered(bool checked = false);
     // copy metadata
     void on_action_Copy_metadata_triggered(bool checked = false);
+    // restore metadata-only backup
+    void on_actionRestore_metadata_triggered(bool checked = false);
+    // restore whole files from the backup store
+    void on_actionRestore_backup_store_triggered(bool checked = false);
     // about dialog
     void on_action_About_triggered(bool checked = false);
     // help
     void on_actionHelp_triggered(bool checked = false);
 
-    // on update preview
-    void previewUpdate();
+    // preview of the selected file loaded
+    void previewLoaded(const QString& filePath, const QImage& preview);
+    // window resizing finished, rescale the preview
+    void previewResize();
+
+    // rest of the initialization, after the window is shown
+    void initializeDeferred();
+
+    // files changed on disk
+    void folderFilesChanged(const QStringList& filePaths);
+    // reload the open file changed by another program
+    void reloadChangedFile();
+
+    // file written by a batch
+    void batchFileWritten(const QString& filePath);
 
     // scroll to the selected directory
     void scrollToSelectedDir();
+
+    // periodic library checkpoint
+    void checkpointLibrary();
+
+    // gear filter boxes
+    void on_gearFilter_textChanged(const QString& text);
+    void on_filmFilter_textChanged(const QString& text);
+    void on_developerFilter_textChanged(const QString& text);
+    void on_authorFilter_textChanged(const QString& text);
 };
 
 #endif // ANALOGEXIF_H
@@ -26,6 +26,7 @@
 #include <QRegExpValidator>
 
 #include "exiftreemodel.h"
+#include "atomicwriter.h"
 
 AnalogExifOptions::AnalogExifOptions(QWidget* const parent)
     : QDialog(parent),
@@ -305,6 +306,23 @@ void AnalogExifOptions::loadOptions()
         ui.createBkpCbox->setChecked(false);
     }
 
+    // 0 - full copy, 1 - metadata only, 2 - central store
+    initialState_bkpMode = settings.value("BackupMode", 0).toInt();
+    ui.bkpModeCBox->setCurrentIndex(initialState_bkpMode);
+    ui.bkpModeCBox->setEnabled(ui.createBkpCbox->isChecked());
+
+    // 0 - keep all store backups
+    initialState_bkpKeepDays = settings.value("BackupStoreKeepDays", 0).toInt();
+    ui.bkpKeepDaysSpin->setValue(initialState_bkpKeepDays);
+    ui.bkpKeepDaysSpin->setEnabled(ui.createBkpCbox->isChecked() && (initialState_bkpMode == 2));
+
+    // load write options, values of AtomicWriter::SyncPolicy
+    initialState_atomicWriteCbox = settings.value("AtomicWrites", false).toBool();
+    initialState_syncPolicy = settings.value("SyncPolicy", AtomicWriter::SyncAtEnd).toInt();
+    ui.atomicWriteCbox->setChecked(initialState_atomicWriteCbox);
+    ui.syncPolicyCBox->setCurrentIndex(initialState_syncPolicy);
+    ui.syncPolicyCBox->setEnabled(initialState_atomicWriteCbox);
+
     // load user NS options
     originalNs = "";
     originalNsPrefix = "";
@@ -365,6 +383,12 @@ bool AnalogExifOptions::saveOptions()
 
     // save backup options
     settings.setValue("CreateBackups", ui.createBkpCbox->checkState() == Qt::Checked);
+    settings.setValue("BackupMode", ui.bkpModeCBox->currentIndex());
+    settings.setValue("BackupStoreKeepDays", ui.bkpKeepDaysSpin->value());
+
+    // save write options
+    settings.setValue("AtomicWrites", ui.atomicWriteCbox->isChecked());
+    settings.setValue("SyncPolicy", ui.syncPolicyCBox->currentIndex());
 
     // delete previous values
     QSqlQuery query("DELETE FROM Settings WHERE SetId = 2 OR SetId = 3");
@@ -406,6 +430,10 @@ bool AnalogExifOptions::saveOptions()
 
     initialState_userNsGBox = ui.userNsGBox->isChecked();
     initialState_createBkpCbox = ui.createBkpCbox->isChecked();
+    initialState_bkpMode = ui.bkpModeCBox->currentIndex();
+    initialState_bkpKeepDays = ui.bkpKeepDaysSpin->value();
+    initialState_atomicWriteCbox = ui.atomicWriteCbox->isChecked();
+    initialState_syncPolicy = ui.syncPolicyCBox->currentIndex();
     initialState_etagsCboxStorageXp = ui.etagsCboxStorageXp->isChecked();
     initialState_etagsCboxStorageUser = ui.etagsCboxStorageUser->isChecked();
 
@@ -544,9 +572,36 @@ void AnalogExifOptions::on_userNsGBox_toggled(bool state)
 }
 void AnalogExifOptions::on_createBkpCbox_stateChanged(int state)
 {
+    ui.bkpModeCBox->setEnabled(state == Qt::Checked);
+    ui.bkpKeepDaysSpin->setEnabled((state == Qt::Checked) && (ui.bkpModeCBox->currentIndex() == 2));
+
     if((state == Qt::Checked) != initialState_createBkpCbox)
         setDirty();
 }
+void AnalogExifOptions::on_bkpModeCBox_currentIndexChanged(int newValue)
+{
+    ui.bkpKeepDaysSpin->setEnabled(ui.createBkpCbox->isChecked() && (newValue == 2));
+
+    if(newValue != initialState_bkpMode)
+        setDirty();
+}
+void AnalogExifOptions::on_bkpKeepDaysSpin_valueChanged(int newValue)
+{
+    if(newValue != initialState_bkpKeepDays)
+        setDirty();
+}
+void AnalogExifOptions::on_atomicWriteCbox_stateChanged(int state)
+{
+    ui.syncPolicyCBox->setEnabled(state == Qt::Checked);
+
+    if((state == Qt::Checked) != initialState_atomicWriteCbox)
+        setDirty();
+}
+void AnalogExifOptions::on_syncPolicyCBox_currentIndexChanged(int newValue)
+{
+    if(newValue != initialState_syncPolicy)
+        setDirty();
+}
 void AnalogExifOptions::on_etagsCboxStorageXp_stateChanged(int state)
 {
     if((state == Qt::Checked) != initialState_etagsCboxStorageXp)
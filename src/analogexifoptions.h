@@ -77,6 +77,10 @@ private:
 
     bool initialState_userNsGBox;
     bool initialState_createBkpCbox;
+    int initialState_bkpMode;
+    int initialState_bkpKeepDays;
+    bool initialState_atomicWriteCbox;
+    int initialState_syncPolicy;
     bool initialState_etagsCboxStorageXp;
     bool initialState_etagsCboxStorageUser;
     bool initialState_updProxyGBox;
@@ -124,6 +128,10 @@ private Q_SLOTS:
     void on_userNsEdit_textEdited(const QString &);
     void on_userNsGBox_toggled(bool);
     void on_createBkpCbox_stateChanged(int);
+    void on_bkpModeCBox_currentIndexChanged(int);
+    void on_bkpKeepDaysSpin_valueChanged(int);
+    void on_atomicWriteCbox_stateChanged(int);
+    void on_syncPolicyCBox_currentIndexChanged(int);
     void on_etagsCboxStorageXp_stateChanged(int);
     void on_etagsCboxStorageUser_stateChanged(int);
     void on_updProxyGBox_toggled(bool);
@@ -0,0 +1,290 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "atomicwriter.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSet>
+#include <QHash>
+#include <QMutexLocker>
+
+// Local includes
+
+#include "backupcopier.h"
+
+#ifdef Q_OS_UNIX
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <stdio.h>
+#endif
+
+#ifdef Q_OS_WIN
+#   include <windows.h>
+#   include <io.h>
+#endif
+
+AtomicWriter::AtomicWriter(SyncPolicy policy)
+    : m_policy(policy)
+{
+}
+
+AtomicWriter::~AtomicWriter()
+{
+    finish();
+}
+
+QString AtomicWriter::tempPath(const QString& filePath)
+{
+    QFileInfo fInfo(filePath);
+
+    // dot files are skipped by the folder scans
+    return fInfo.absolutePath() + "/." + fInfo.fileName() + ".aetmp";
+}
+
+bool AtomicWriter::replaceFile(const QString& source, const QString& target)
+{
+#ifdef Q_OS_UNIX
+    // atomic, replaces the target
+    return (::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0);
+#elif defined(Q_OS_WIN)
+    return MoveFileExW((const wchar_t*)QDir::toNativeSeparators(source).utf16(), (const wchar_t*)QDir::toNativeSeparators(target).utf16(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    QFile::remove(target);
+
+    return QFile::rename(source, target);
+#endif
+}
+
+bool AtomicWriter::syncPath(const QString& path)
+{
+#ifdef Q_OS_UNIX
+    int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+        return false;
+
+    bool result = (fsync(fd) == 0);
+    close(fd);
+
+    return result;
+#elif defined(Q_OS_WIN)
+    // folders can not be flushed here, the write-through rename covers them
+    if(QFileInfo(path).isDir())
+        return true;
+
+    QFile file(path);
+
+    if(!file.open(QIODevice::ReadWrite))
+        return false;
+
+    return FlushFileBuffers((HANDLE)_get_osfhandle(file.handle()));
+#else
+    Q_UNUSED(path);
+
+    return true;
+#endif
+}
+
+bool AtomicWriter::syncFile(QFile& file)
+{
+    if(!file.flush())
+        return false;
+
+#ifdef Q_OS_UNIX
+    return (fsync(file.handle()) == 0);
+#elif defined(Q_OS_WIN)
+    return FlushFileBuffers((HANDLE)_get_osfhandle(file.handle()));
+#else
+    return true;
+#endif
+}
+
+bool AtomicWriter::write(const QString& filePath, const WriteFunction& writeFunction, QString* failedFile)
+{
+    if(failedFile)
+        *failedFile = filePath;
+
+    // replace the file a symbolic link points to, not the link
+    QString target = QFileInfo(filePath).canonicalFilePath();
+
+    if(target.isEmpty())
+        return false;
+
+    QString temp = tempPath(target);
+
+    // left over from an interrupted run
+    QFile::remove(temp);
+
+    if(!BackupCopier::copy(target, temp).ok())
+        return false;
+
+    if(!writeFunction(temp))
+    {
+        QFile::remove(temp);
+        return false;
+    }
+
+    if(m_policy == SyncAtEnd)
+    {
+        PendingFile file;
+        file.tempPath = temp;
+        file.targetPath = target;
+
+        QList<PendingFile> group;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_pending << file;
+
+            if(m_pending.count() >= maxPendingFiles)
+                group.swap(m_pending);
+        }
+
+        if(group.isEmpty())
+            return true;
+
+        QStringList failed = commit(group);
+
+        if(failed.isEmpty())
+            return true;
+
+        if(failedFile)
+            *failedFile = failed.first();
+
+        return false;
+    }
+
+    if((m_policy == SyncEachFile) && !syncPath(temp))
+    {
+        qDebug("AnalogExif: AtomicWriter::write() unable to flush %s", qPrintable(temp));
+        QFile::remove(temp);
+        return false;
+    }
+
+    if(!replaceFile(temp, target))
+    {
+        qDebug("AnalogExif: AtomicWriter::write() unable to replace %s", qPrintable(target));
+        QFile::remove(temp);
+        return false;
+    }
+
+    if(m_policy == SyncEachFile)
+    {
+        // makes the rename itself durable
+        syncPath(QFileInfo(target).absolutePath());
+    }
+
+    return true;
+}
+
+bool AtomicWriter::finish(QString* failedFile)
+{
+    QList<PendingFile> pending;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+    }
+
+    if(pending.isEmpty())
+        return true;
+
+    QStringList failed = commit(pending);
+
+    if(failed.isEmpty())
+        return true;
+
+    if(failedFile)
+        *failedFile = failed.first();
+
+    return false;
+}
+
+QStringList AtomicWriter::commit(const QList<PendingFile>& files)
+{
+    bool flushed = true;
+
+#if defined(Q_OS_LINUX) && defined(_GNU_SOURCE)
+    // one flush per file system instead of one per file
+    QSet<dev_t> devices;
+
+    foreach(const PendingFile& file, files)
+    {
+        struct stat st;
+        QString folder = QFileInfo(file.targetPath).absolutePath();
+
+        if((stat(QFile::encodeName(folder).constData(), &st) != 0) || devices.contains(st.st_dev))
+            continue;
+
+        devices.insert(st.st_dev);
+
+        int fd = open(QFile::encodeName(folder).constData(), O_RDONLY | O_CLOEXEC);
+
+        if((fd < 0) || (syncfs(fd) != 0))
+            flushed = false;
+
+        if(fd >= 0)
+            close(fd);
+    }
+#else
+    foreach(const PendingFile& file, files)
+    {
+        if(!syncPath(file.tempPath))
+            flushed = false;
+    }
+#endif
+
+    QStringList failed;
+    // files replaced in each folder
+    QHash<QString, QStringList> folders;
+
+    foreach(const PendingFile& file, files)
+    {
+        // an unflushed copy must not replace the original
+        if(!flushed || !replaceFile(file.tempPath, file.targetPath))
+        {
+            qDebug("AnalogExif: AtomicWriter::commit() unable to replace %s", qPrintable(file.targetPath));
+            QFile::remove(file.tempPath);
+            failed << file.targetPath;
+            continue;
+        }
+
+        folders[QFileInfo(file.targetPath).absolutePath()] << file.targetPath;
+    }
+
+    // makes the renames durable
+    for(QHash<QString, QStringList>::const_iterator it = folders.constBegin(); it != folders.constEnd(); ++it)
+    {
+        if(!syncPath(it.key()))
+        {
+            qDebug("AnalogExif: AtomicWriter::commit() unable to flush %s", qPrintable(it.key()));
+            failed << it.value();
+        }
+    }
+
+    qDebug("AnalogExif: AtomicWriter::commit() %d file(s) flushed", files.count());
+
+    return failed;
+}
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ATOMICWRITER_H
+#define ATOMICWRITER_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+
+class QFile;
+
+// C++ includes
+
+#include <functional>
+
+// crash-safe metadata writes
+//
+// the metadata is written to a copy of the file in the same folder (a reflink
+// where supported), which then replaces the original by a rename
+//
+// with SyncEachFile and SyncAtEnd the copy is flushed before the rename, so
+// even a power loss leaves either the old or the new file; SyncAtEnd writes
+// the copies of a group of files, flushes them once and then renames them
+// all; NoSync only protects against the application being interrupted
+//
+// the rename puts a new file in place of the original: owner, group, ACLs,
+// extended attributes and hard links of the original are not kept
+class AtomicWriter
+{
+public:
+    enum SyncPolicy
+    {
+        // leave it to the system
+        NoSync,
+        // flush every file and its folder, slowest
+        SyncEachFile,
+        // flush written files once per group, rename them afterwards
+        SyncAtEnd
+    };
+
+    // copies waiting for the flush with SyncAtEnd, bounds the disk space
+    // taken by the copies when they are not reflinks
+    static const int maxPendingFiles = 32;
+
+    // writes metadata to the given (temporary) file
+    typedef std::function<bool (const QString& filePath)> WriteFunction;
+
+    explicit AtomicWriter(SyncPolicy policy = SyncAtEnd);
+
+    // finishes the batch
+    ~AtomicWriter();
+
+    // write to a temporary copy of the file and put it in place of the original,
+    // with SyncAtEnd the original is replaced by a later write() or finish();
+    // failedFile is set to the file that could not be written or replaced,
+    // with SyncAtEnd that can be an earlier file of the group
+    bool write(const QString& filePath, const WriteFunction& writeFunction, QString* failedFile = 0);
+
+    // flush and put in place everything written so far, called by the
+    // destructor as well; failedFile is set to the first file not replaced
+    bool finish(QString* failedFile = 0);
+
+    // replace target by source in one step
+    static bool replaceFile(const QString& source, const QString& target);
+
+    // flush file or folder to disk
+    static bool syncPath(const QString& path);
+
+    // flush data written to the open file to disk, not just to the system
+    static bool syncFile(QFile& file);
+
+private:
+    Q_DISABLE_COPY(AtomicWriter)
+
+    // temporary name next to the file, hidden from the file lists
+    static QString tempPath(const QString& filePath);
+
+    struct PendingFile
+    {
+        QString tempPath;
+        QString targetPath;
+    };
+
+    // flush the copies, rename them, then flush their folders;
+    // returns the files not replaced or not made durable
+    static QStringList commit(const QList<PendingFile>& files);
+
+    SyncPolicy  m_policy;
+
+    // guards the members below
+    QMutex      m_mutex;
+    QList<PendingFile> m_pending;
+};
+
+#endif // ATOMICWRITER_H
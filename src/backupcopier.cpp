@@ -0,0 +1,389 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "backupcopier.h"
+
+// Qt includes
+
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/ioctl.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <errno.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#   include <sys/syscall.h>
+#   include <linux/fs.h>
+#endif
+
+namespace
+{
+#ifdef Q_OS_UNIX
+
+    // share all data blocks of the source, false if not supported
+    bool reflink(int sourceFd, int targetFd)
+    {
+#ifdef FICLONE
+        return (ioctl(targetFd, FICLONE, sourceFd) == 0);
+#else
+        Q_UNUSED(sourceFd);
+        Q_UNUSED(targetFd);
+
+        return false;
+#endif
+    }
+
+    // in-kernel copy, false if not supported before anything was copied
+    bool copyFileRange(int sourceFd, int targetFd, qint64 size, qint64& bytesCopied, bool& failed)
+    {
+#if defined(Q_OS_LINUX) && defined(__NR_copy_file_range)
+        while(bytesCopied < size)
+        {
+            // called through syscall(), older C libraries have no wrapper
+            ssize_t copied = syscall(__NR_copy_file_range, sourceFd, (loff_t*)0, targetFd, (loff_t*)0, (size_t)(size - bytesCopied), 0u);
+
+            if(copied < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                // not supported here (old kernel, cross-device on older kernels, some file systems)
+                if((bytesCopied == 0) && ((errno == ENOSYS) || (errno == EXDEV) || (errno == EINVAL) || (errno == EOPNOTSUPP)))
+                    return false;
+
+                failed = true;
+                return false;
+            }
+
+            // source got shorter meanwhile
+            if(copied == 0)
+                break;
+
+            bytesCopied += copied;
+        }
+
+        return true;
+#else
+        Q_UNUSED(sourceFd);
+        Q_UNUSED(targetFd);
+        Q_UNUSED(size);
+        Q_UNUSED(bytesCopied);
+        Q_UNUSED(failed);
+
+        return false;
+#endif
+    }
+
+    bool stream(int sourceFd, int targetFd, qint64& bytesCopied)
+    {
+        QByteArray buffer(BackupCopier::streamBufferSize, Qt::Uninitialized);
+
+        while(true)
+        {
+            ssize_t bytesRead = read(sourceFd, buffer.data(), buffer.size());
+
+            if(bytesRead < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                return false;
+            }
+
+            if(bytesRead == 0)
+                return true;
+
+            ssize_t offset = 0;
+
+            while(offset < bytesRead)
+            {
+                ssize_t written = ::write(targetFd, buffer.constData() + offset, bytesRead - offset);
+
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+
+                    return false;
+                }
+
+                offset += written;
+            }
+
+            bytesCopied += bytesRead;
+        }
+    }
+
+#endif
+}
+
+BackupCopier::Result BackupCopier::copy(const QString& source, const QString& target)
+{
+    Result result;
+
+#ifdef Q_OS_UNIX
+
+    int sourceFd = open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+
+    if(sourceFd < 0)
+        return result;
+
+    struct stat st;
+
+    if((fstat(sourceFd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        close(sourceFd);
+        return result;
+    }
+
+    // never overwrite, same as QFile::copy()
+    int targetFd = open(QFile::encodeName(target).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777);
+
+    if(targetFd < 0)
+    {
+        close(sourceFd);
+        return result;
+    }
+
+    bool failed = false;
+
+    if(reflink(sourceFd, targetFd))
+    {
+        result.method = Reflink;
+    }
+    else if(copyFileRange(sourceFd, targetFd, st.st_size, result.bytesCopied, failed))
+    {
+        result.method = CopyFileRange;
+    }
+    else if(!failed && stream(sourceFd, targetFd, result.bytesCopied))
+    {
+        result.method = Stream;
+    }
+
+    close(sourceFd);
+
+    if(close(targetFd) != 0)
+        result.method = Failed;
+
+#else
+
+    QFile sourceFile(source);
+    QFile targetFile(target);
+
+    if(targetFile.exists() || !sourceFile.open(QIODevice::ReadOnly) || !targetFile.open(QIODevice::WriteOnly))
+        return result;
+
+    QByteArray buffer(streamBufferSize, Qt::Uninitialized);
+    result.method = Stream;
+
+    while(!sourceFile.atEnd())
+    {
+        qint64 bytesRead = sourceFile.read(buffer.data(), buffer.size());
+
+        if((bytesRead < 0) || (targetFile.write(buffer.constData(), bytesRead) != bytesRead))
+        {
+            result.method = Failed;
+            break;
+        }
+
+        result.bytesCopied += bytesRead;
+    }
+
+    sourceFile.close();
+    targetFile.close();
+
+    if(result.ok())
+        targetFile.setPermissions(sourceFile.permissions());
+
+#endif
+
+    if(!result.ok())
+    {
+        qDebug("AnalogExif: BackupCopier::copy() unable to copy %s", qPrintable(source));
+
+        // no partial backups
+        QFile::remove(target);
+    }
+
+    return result;
+}
+
+BackupCopier::Result BackupCopier::copyRange(const QString& source, qint64 offset, qint64 length, const QString& target)
+{
+    Result result;
+
+#ifdef Q_OS_UNIX
+
+    int sourceFd = open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+
+    if(sourceFd < 0)
+        return result;
+
+    int targetFd = open(QFile::encodeName(target).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if(targetFd < 0)
+    {
+        close(sourceFd);
+        return result;
+    }
+
+#ifdef FICLONERANGE
+    struct file_clone_range range;
+    range.src_fd = sourceFd;
+    range.src_offset = offset;
+    range.src_length = length;
+    range.dest_offset = 0;
+
+    if(ioctl(targetFd, FICLONERANGE, &range) == 0)
+        result.method = Reflink;
+#endif
+
+    bool failed = false;
+
+#if defined(Q_OS_LINUX) && defined(__NR_copy_file_range)
+    if(!result.ok())
+    {
+        loff_t sourceOffset = offset;
+        bool supported = true;
+
+        while(result.bytesCopied < length)
+        {
+            ssize_t copied = syscall(__NR_copy_file_range, sourceFd, &sourceOffset, targetFd, (loff_t*)0, (size_t)(length - result.bytesCopied), 0u);
+
+            if(copied < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                // not supported here, the stream copy takes over
+                if((result.bytesCopied == 0) && ((errno == ENOSYS) || (errno == EXDEV) || (errno == EINVAL) || (errno == EOPNOTSUPP)))
+                    supported = false;
+                else
+                    failed = true;
+
+                break;
+            }
+
+            if(copied == 0)
+                break;
+
+            result.bytesCopied += copied;
+        }
+
+        if(supported && !failed)
+            result.method = CopyFileRange;
+    }
+#endif
+
+    if(!result.ok() && !failed && (lseek(sourceFd, offset, SEEK_SET) == offset))
+    {
+        QByteArray buffer(streamBufferSize, Qt::Uninitialized);
+        result.method = Stream;
+
+        while(result.bytesCopied < length)
+        {
+            ssize_t bytesRead = read(sourceFd, buffer.data(), qMin<qint64>(buffer.size(), length - result.bytesCopied));
+
+            if((bytesRead < 0) && (errno == EINTR))
+                continue;
+
+            if(bytesRead <= 0)
+            {
+                if(bytesRead < 0)
+                    result.method = Failed;
+                break;
+            }
+
+            if(::write(targetFd, buffer.constData(), bytesRead) != bytesRead)
+            {
+                result.method = Failed;
+                break;
+            }
+
+            result.bytesCopied += bytesRead;
+        }
+    }
+
+    close(sourceFd);
+
+    if(close(targetFd) != 0)
+        result.method = Failed;
+
+#else
+
+    QFile sourceFile(source);
+    QFile targetFile(target);
+
+    if(targetFile.exists() || !sourceFile.open(QIODevice::ReadOnly) || !sourceFile.seek(offset) || !targetFile.open(QIODevice::WriteOnly))
+        return result;
+
+    QByteArray buffer(streamBufferSize, Qt::Uninitialized);
+    result.method = Stream;
+
+    while(result.bytesCopied < length)
+    {
+        qint64 bytesRead = sourceFile.read(buffer.data(), qMin<qint64>(buffer.size(), length - result.bytesCopied));
+
+        if(bytesRead <= 0)
+        {
+            if(bytesRead < 0)
+                result.method = Failed;
+            break;
+        }
+
+        if(targetFile.write(buffer.constData(), bytesRead) != bytesRead)
+        {
+            result.method = Failed;
+            break;
+        }
+
+        result.bytesCopied += bytesRead;
+    }
+
+#endif
+
+    if(!result.ok())
+    {
+        qDebug("AnalogExif: BackupCopier::copyRange() unable to copy %s", qPrintable(source));
+
+        // no partial copies
+        QFile::remove(target);
+    }
+
+    return result;
+}
+
+const char* BackupCopier::methodName(Method method)
+{
+    switch(method)
+    {
+    case Reflink:
+        return "reflink";
+    case CopyFileRange:
+        return "copy_file_range";
+    case Stream:
+        return "stream";
+    default:
+        return "failed";
+    }
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BACKUPCOPIER_H
+#define BACKUPCOPIER_H
+
+// Qt includes
+
+#include <QString>
+
+// file copy for backups, cheapest method first
+//
+// a reflink shares the data blocks of the original (btrfs, XFS), so the
+// backup costs no data I/O until the original is modified; copy_file_range
+// keeps the data in the kernel and lets network file systems copy on the
+// server; plain read/write copy is the fallback everywhere else
+//
+// all methods are reentrant, several copies may run at the same time
+class BackupCopier
+{
+public:
+    enum Method
+    {
+        Failed,
+        Reflink,
+        CopyFileRange,
+        Stream
+    };
+
+    struct Result
+    {
+        Result()
+            : method(Failed),
+              bytesCopied(0)
+        {
+        }
+
+        bool ok() const
+        {
+            return (method != Failed);
+        }
+
+        Method  method;
+        // data actually copied, zero for a reflink
+        qint64  bytesCopied;
+    };
+
+    // copy source to target, fails if target already exists
+    static Result copy(const QString& source, const QString& target);
+
+    // copy length bytes of source from offset to the new file target, a
+    // reflink needs offset aligned to the file system block size
+    static Result copyRange(const QString& source, qint64 offset, qint64 length, const QString& target);
+
+    static const char* methodName(Method method);
+
+    // read/write buffer of the fallback copy
+    static const int streamBufferSize = 1024 * 1024;
+};
+
+#endif // BACKUPCOPIER_H
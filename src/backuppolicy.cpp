@@ -0,0 +1,197 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "backuppolicy.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QDir>
+#include <QThread>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QWidget>
+
+BackupPolicy::BackupPolicy(bool enabled, Mode mode, const QString& storePath, QWidget* const parent)
+    : QObject(parent),
+      m_enabled(enabled),
+      m_mode(mode),
+      m_parent(parent),
+      m_singleFile(false),
+      m_cancelled(0),
+      m_store(storePath),
+      m_overwriteAnswer(QMessageBox::No),
+      m_bytesCopied(0),
+      m_metadataBackups(0),
+      m_storedBackups(0),
+      m_dedupedBackups(0)
+{
+    for(int i = 0; i <= BackupCopier::Stream; i++)
+        m_copyMethods[i] = 0;
+}
+
+BackupPolicy::Status BackupPolicy::backup(const QString& filePath, QString* errorFile)
+{
+    if(!m_enabled)
+        return Skipped;
+
+    if(errorFile)
+        *errorFile = filePath;
+
+    // archive entries never overwrite anything, no questions
+    if(m_mode == MetadataOnly)
+    {
+        if(!m_archive.store(filePath))
+            return Failed;
+
+        QMutexLocker locker(&m_mutex);
+        m_metadataBackups++;
+
+        return BackedUp;
+    }
+
+    // the store keeps every version, no questions either
+    if(m_mode == CentralStore)
+    {
+        BackupStore::Result result = m_store.store(filePath);
+
+        if(!result.ok)
+            return Failed;
+
+        QMutexLocker locker(&m_mutex);
+
+        if(result.stored)
+            m_storedBackups++;
+        else
+            m_dedupedBackups++;
+
+        m_bytesCopied += result.bytesCopied;
+
+        return BackedUp;
+    }
+
+    return copyFile(filePath, errorFile);
+}
+
+BackupPolicy::Status BackupPolicy::copyFile(const QString& filePath, QString* errorFile)
+{
+    QString backupPath = filePath + ".bak";
+    QMessageBox::StandardButton res = QMessageBox::Yes;
+
+    if(errorFile)
+        *errorFile = backupPath;
+
+    if(QFile::exists(backupPath))
+    {
+        // one question at a time, the answer may apply to all files
+        QMutexLocker locker(&m_askMutex);
+
+        // skip question if Yes/NoToAll was previously selected
+        if((m_overwriteAnswer != QMessageBox::YesToAll) && (m_overwriteAnswer != QMessageBox::NoToAll))
+        {
+            int answer = QMessageBox::Cancel;
+
+            // the question is a dialog, the GUI thread has to ask it
+            if(QThread::currentThread() == thread())
+                answer = askOverwrite(backupPath);
+            else
+                QMetaObject::invokeMethod(this, "askOverwrite", Qt::BlockingQueuedConnection,
+                                          Q_RETURN_ARG(int, answer), Q_ARG(QString, backupPath));
+
+            res = (QMessageBox::StandardButton)answer;
+        }
+        else
+        {
+            res = m_overwriteAnswer;
+        }
+
+        m_overwriteAnswer = res;
+
+        if(res == QMessageBox::Cancel)
+            return Cancelled;
+
+        if((res == QMessageBox::No) || (res == QMessageBox::NoToAll))
+            return Skipped;
+
+        if(!QFile::remove(backupPath))
+            return Failed;
+    }
+
+    BackupCopier::Result result = BackupCopier::copy(filePath, backupPath);
+
+    if(!result.ok())
+        return Failed;
+
+    QMutexLocker locker(&m_mutex);
+
+    m_copyMethods[result.method]++;
+    m_bytesCopied += result.bytesCopied;
+
+    return BackedUp;
+}
+
+int BackupPolicy::askOverwrite(const QString& backupPath)
+{
+    // cancelled while the question was on its way
+    if(m_cancelled.load())
+        return QMessageBox::Cancel;
+
+    QMessageBox::StandardButtons btns = QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel;
+
+    if(!m_singleFile)
+    {
+        btns |= QMessageBox::YesToAll | QMessageBox::NoToAll;
+    }
+
+    // previous choice as default
+    QMessageBox::StandardButton defaultButton = m_overwriteAnswer;
+
+    if(defaultButton == QMessageBox::NoButton)
+        defaultButton = QMessageBox::No;
+
+    return QMessageBox::question(m_parent, tr("Backup file exists"),
+        tr("Backup file %1 already exists.\n\nOverwrite backup file?").arg(QDir::toNativeSeparators(backupPath)),
+        btns, defaultButton);
+}
+
+QString BackupPolicy::errorMessage(const QString& errorFile) const
+{
+    switch(m_mode)
+    {
+    case MetadataOnly:
+        return tr("Unable to back up metadata of %1.").arg(QDir::toNativeSeparators(errorFile));
+    case CentralStore:
+        return tr("Unable to back up %1 to %2.").arg(QDir::toNativeSeparators(errorFile)).arg(QDir::toNativeSeparators(m_store.location(errorFile)));
+    default:
+        return tr("Unable to create backup file:\n%1.").arg(QDir::toNativeSeparators(errorFile));
+    }
+}
+
+QString BackupPolicy::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return QString("%1 metadata only, %2 stored, %3 deduplicated, %4 reflink, %5 copy_file_range, %6 stream, %7 bytes copied")
+        .arg(m_metadataBackups)
+        .arg(m_storedBackups)
+        .arg(m_dedupedBackups)
+        .arg(m_copyMethods[BackupCopier::Reflink])
+        .arg(m_copyMethods[BackupCopier::CopyFileRange])
+        .arg(m_copyMethods[BackupCopier::Stream])
+        .arg(m_bytesCopied);
+}
@@ -0,0 +1,144 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BACKUPPOLICY_H
+#define BACKUPPOLICY_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QMessageBox>
+
+// Local includes
+
+#include "backupcopier.h"
+#include "metadataarchive.h"
+#include "backupstore.h"
+
+class QWidget;
+
+// backup of files about to be modified, shared by all writers
+//
+// copies the file to .bak, asking before an existing backup is overwritten,
+// stores its original metadata in the archive of its folder, or the whole
+// file in the backup store, depending on the mode; the overwrite answer of
+// the "to all" buttons holds for the rest of the job
+//
+// backup() can be called from several threads, questions are always asked
+// by the thread of the parent one at a time
+class BackupPolicy : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    // values of the BackupMode setting
+    enum Mode
+    {
+        CopyFile,
+        MetadataOnly,
+        CentralStore
+    };
+
+    enum Status
+    {
+        BackedUp,
+        // not required or declined by the user
+        Skipped,
+        // user cancelled at the overwrite question
+        Cancelled,
+        Failed
+    };
+
+    // parent is used for the questions, an empty store path stores on the volumes of the files
+    BackupPolicy(bool enabled, Mode mode, const QString& storePath, QWidget* const parent);
+
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    Mode mode() const
+    {
+        return m_mode;
+    }
+
+    BackupStore& store()
+    {
+        return m_store;
+    }
+
+    // no "to all" buttons in the questions
+    void setSingleFile(bool singleFile)
+    {
+        m_singleFile = singleFile;
+    }
+
+    // back up the file before it is written, errorFile is the file that failed
+    Status backup(const QString& filePath, QString* errorFile = 0);
+
+    // further questions are answered with Cancel
+    void cancel()
+    {
+        m_cancelled.store(1);
+    }
+
+    // message for a failed backup of the error file
+    QString errorMessage(const QString& errorFile) const;
+
+    // one-line report of the backup methods used and bytes copied
+    QString statistics() const;
+
+private Q_SLOTS:
+
+    // returns QMessageBox::StandardButton
+    int askOverwrite(const QString& backupPath);
+
+private:
+
+    Status copyFile(const QString& filePath, QString* errorFile);
+
+    bool            m_enabled;
+    Mode            m_mode;
+    QWidget*        m_parent;
+    bool            m_singleFile;
+    QAtomicInt      m_cancelled;
+
+    // original metadata of the job, one archive per folder
+    MetadataArchive m_archive;
+    // versioned job in the central store
+    BackupStore     m_store;
+
+    // serializes the questions, guards the answer
+    QMutex                      m_askMutex;
+    // answer to the last question
+    QMessageBox::StandardButton m_overwriteAnswer;
+
+    // guards the statistics
+    mutable QMutex  m_mutex;
+    int             m_copyMethods[BackupCopier::Stream + 1];
+    qint64          m_bytesCopied;
+    int             m_metadataBackups;
+    int             m_storedBackups;
+    int             m_dedupedBackups;
+};
+
+#endif // BACKUPPOLICY_H
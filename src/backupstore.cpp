@@ -0,0 +1,593 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "backupstore.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QThread>
+#include <QVector>
+#include <QSet>
+#include <QMutexLocker>
+#include <QtConcurrentMap>
+
+// Local includes
+
+#include "backupcopier.h"
+#include "atomicwriter.h"
+#include "metadataarchive.h"
+
+namespace
+{
+    // reads a single chunk, opens the file on its own so chunks can be read in parallel
+    bool readChunk(const QString& filePath, qint64 offset, QByteArray& data)
+    {
+        QFile file(filePath);
+
+        if(!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+            return false;
+
+        data = file.read(BackupStore::chunkSize);
+
+        return !data.isEmpty();
+    }
+
+    struct ChunkHasher
+    {
+        typedef QByteArray result_type;
+
+        explicit ChunkHasher(const QString& filePath)
+            : filePath(filePath)
+        {
+        }
+
+        QByteArray operator()(qint64 offset) const
+        {
+            QByteArray data;
+
+            if(!readChunk(filePath, offset, data))
+                return QByteArray();
+
+            return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+        }
+
+        QString filePath;
+    };
+
+    struct ChunkResult
+    {
+        ChunkResult()
+            : ok(false),
+              stored(false),
+              bytesCopied(0)
+        {
+        }
+
+        QByteArray  hash;
+        bool        ok;
+        bool        stored;
+        qint64      bytesCopied;
+    };
+
+    // hashes a single chunk and stores it unless the store has it already
+    struct ChunkStorer
+    {
+        typedef ChunkResult result_type;
+
+        ChunkStorer(const QString& filePath, const QString& location)
+            : filePath(filePath),
+              location(location)
+        {
+        }
+
+        ChunkResult operator()(qint64 offset) const
+        {
+            ChunkResult result;
+            QByteArray data;
+
+            if(!readChunk(filePath, offset, data))
+                return result;
+
+            result.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+
+            QString chunkFile = BackupStore::chunkPath(location, result.hash.toHex());
+
+            if(QFile::exists(chunkFile))
+            {
+                result.ok = true;
+                return result;
+            }
+
+            if(!QDir().mkpath(QFileInfo(chunkFile).absolutePath()))
+                return result;
+
+            // copy under a private name, the rename makes the chunk appear complete
+            QString tempFile = QString("%1.%2.tmp").arg(chunkFile).arg((quintptr)QThread::currentThreadId());
+
+            // a reflink of the range if the store is on the same volume
+            BackupCopier::Result copyResult = BackupCopier::copyRange(filePath, offset, data.size(), tempFile);
+
+            if(!copyResult.ok())
+                return result;
+
+            if(!QFile::rename(tempFile, chunkFile))
+            {
+                // stored by another thread meanwhile
+                QFile::remove(tempFile);
+
+                result.ok = QFile::exists(chunkFile);
+                return result;
+            }
+
+            result.ok = true;
+            result.stored = true;
+            result.bytesCopied = copyResult.bytesCopied;
+
+            return result;
+        }
+
+        QString filePath;
+        QString location;
+    };
+
+    // remove objects not in the set, returns the number removed
+    int sweepObjects(const QString& folder, const QSet<QByteArray>& used, const QDateTime& graceLimit)
+    {
+        int removed = 0;
+        QDirIterator it(folder, QDir::Files, QDirIterator::Subdirectories);
+
+        while(it.hasNext())
+        {
+            it.next();
+
+            QFileInfo info = it.fileInfo();
+
+            // recently written ones may belong to a job still running
+            if(info.lastModified() > graceLimit)
+                continue;
+
+            // temporary names contain a dot, left over if older than the grace time
+            if(info.fileName().contains('.') || !used.contains(info.fileName().toLatin1()))
+            {
+                if(QFile::remove(info.absoluteFilePath()))
+                    removed++;
+            }
+        }
+
+        return removed;
+    }
+}
+
+const char* const BackupStore::folderName = ".analogexif-store";
+
+BackupStore::BackupStore(const QString& location)
+    : m_location(location),
+      m_jobId(MetadataArchive::newJobId())
+{
+}
+
+BackupStore::~BackupStore()
+{
+    foreach(QFile* manifest, m_manifests)
+    {
+        manifest->close();
+        delete manifest;
+    }
+}
+
+QString BackupStore::defaultLocation()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/backups";
+}
+
+QString BackupStore::location(const QString& filePath) const
+{
+    if(!m_location.isEmpty())
+        return m_location;
+
+    QString root = QStorageInfo(QFileInfo(filePath).absolutePath()).rootPath();
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, QString>::const_iterator it = m_volumeStores.constFind(root);
+
+    if(it != m_volumeStores.constEnd())
+        return it.value();
+
+    QString volumeStore = QDir(root).absoluteFilePath(folderName);
+
+    // a store next to the files allows reflinks of their chunks
+    if(root.isEmpty() || !QDir().mkpath(volumeStore) || !QFileInfo(volumeStore).isWritable())
+        volumeStore = defaultLocation();
+
+    m_volumeStores.insert(root, volumeStore);
+
+    return volumeStore;
+}
+
+QString BackupStore::chunkPath(const QString& location, const QByteArray& hash)
+{
+    // spread over 256 subfolders
+    return location + "/chunks/" + QString::fromLatin1(hash.left(2)) + "/" + QString::fromLatin1(hash);
+}
+
+QString BackupStore::filesPath(const QString& location, const QByteArray& hash)
+{
+    return location + "/files/" + QString::fromLatin1(hash.left(2)) + "/" + QString::fromLatin1(hash);
+}
+
+QByteArray BackupStore::contentHash(const QString& filePath)
+{
+    QFileInfo fInfo(filePath);
+
+    if(!fInfo.isFile())
+        return QByteArray();
+
+    QVector<qint64> offsets;
+
+    for(qint64 offset = 0; offset < fInfo.size(); offset += chunkSize)
+        offsets << offset;
+
+    // chunks are hashed by the global pool, the results come back in order
+    QList<QByteArray> chunkHashes = QtConcurrent::blockingMapped<QList<QByteArray> >(offsets, ChunkHasher(filePath));
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    // the size keeps files of identical chunks but different length apart
+    hash.addData(QByteArray::number(fInfo.size()));
+
+    foreach(const QByteArray& chunkHash, chunkHashes)
+    {
+        if(chunkHash.isEmpty())
+            return QByteArray();
+
+        hash.addData(chunkHash);
+    }
+
+    return hash.result().toHex();
+}
+
+bool BackupStore::writeObject(const QString& objectFile, const QByteArray& data)
+{
+    if(!QDir().mkpath(QFileInfo(objectFile).absolutePath()))
+        return false;
+
+    QString tempFile = QString("%1.%2.tmp").arg(objectFile).arg((quintptr)QThread::currentThreadId());
+    QFile file(tempFile);
+
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    bool written = (file.write(data) == data.size());
+    file.close();
+
+    if(!written || !QFile::rename(tempFile, objectFile))
+    {
+        QFile::remove(tempFile);
+
+        // stored by another thread meanwhile
+        return written && QFile::exists(objectFile);
+    }
+
+    return true;
+}
+
+BackupStore::Result BackupStore::store(const QString& filePath)
+{
+    Result result;
+    QFileInfo fInfo(filePath);
+
+    if(!fInfo.isFile())
+        return result;
+
+    QString storeLocation = location(filePath);
+
+    QVector<qint64> offsets;
+
+    for(qint64 offset = 0; offset < fInfo.size(); offset += chunkSize)
+        offsets << offset;
+
+    // chunks are stored by the global pool, the results come back in order
+    QList<ChunkResult> chunks = QtConcurrent::blockingMapped<QList<ChunkResult> >(offsets, ChunkStorer(filePath, storeLocation));
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    // same hash as contentHash()
+    hash.addData(QByteArray::number(fInfo.size()));
+
+    // size, then one chunk hash per line
+    QByteArray fileList = QByteArray::number(fInfo.size()) + '\n';
+
+    foreach(const ChunkResult& chunk, chunks)
+    {
+        if(!chunk.ok)
+            return result;
+
+        hash.addData(chunk.hash);
+        fileList += chunk.hash.toHex() + '\n';
+
+        result.stored |= chunk.stored;
+        result.bytesCopied += chunk.bytesCopied;
+    }
+
+    QByteArray fileHash = hash.result().toHex();
+    QString listFile = filesPath(storeLocation, fileHash);
+
+    if(!QFile::exists(listFile) && !writeObject(listFile, fileList))
+        return result;
+
+    result.ok = addToManifest(storeLocation, fileHash, filePath);
+
+    return result;
+}
+
+bool BackupStore::addToManifest(const QString& location, const QByteArray& hash, const QString& filePath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QFile* manifest = m_manifests.value(location);
+
+    if(!manifest)
+    {
+        if(!QDir().mkpath(location + "/jobs"))
+            return false;
+
+        QString manifestPath = location + "/jobs/" + m_jobId + ".manifest";
+
+        // a job of another process with the same id, never mix two jobs
+        for(int i = 1; QFile::exists(manifestPath); i++)
+            manifestPath = QString("%1/jobs/%2-%3.manifest").arg(location).arg(m_jobId).arg(i);
+
+        manifest = new QFile(manifestPath);
+
+        // the new manifest has to be found after a power loss as well
+        if(!manifest->open(QIODevice::WriteOnly) || !AtomicWriter::syncPath(location + "/jobs"))
+        {
+            manifest->close();
+            manifest->remove();
+            delete manifest;
+            return false;
+        }
+
+        m_manifests.insert(location, manifest);
+    }
+
+    QFileInfo fInfo(filePath);
+
+    // hash, size, modification time, path - tab separated, one file per line
+    QByteArray line = hash + '\t' + QByteArray::number(fInfo.size()) + '\t'
+                    + QByteArray::number(fInfo.lastModified().toMSecsSinceEpoch()) + '\t'
+                    + QDir::toNativeSeparators(fInfo.absoluteFilePath()).toUtf8() + '\n';
+
+    // the line must be on disk before the file is modified
+    return ((manifest->write(line) == line.size()) && AtomicWriter::syncFile(*manifest));
+}
+
+bool BackupStore::readManifest(const QString& manifestPath, QList<Entry>& entries)
+{
+    QFile file(manifestPath);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    while(!file.atEnd())
+    {
+        QByteArray line = file.readLine();
+
+        // a job interrupted while writing leaves a truncated last line
+        if(!line.endsWith('\n'))
+            break;
+
+        QList<QByteArray> fields = line.trimmed().split('\t');
+
+        if(fields.count() != 4)
+            continue;
+
+        Entry entry;
+        entry.hash = fields.at(0);
+        entry.size = fields.at(1).toLongLong();
+        entry.modified = fields.at(2).toLongLong();
+        entry.filePath = QDir::fromNativeSeparators(QString::fromUtf8(fields.at(3)));
+
+        entries << entry;
+    }
+
+    return true;
+}
+
+bool BackupStore::readFileList(const QString& location, const QByteArray& hash, qint64& size, QList<QByteArray>& chunks)
+{
+    QFile file(filesPath(location, hash));
+
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    bool ok = false;
+    size = file.readLine().trimmed().toLongLong(&ok);
+
+    if(!ok)
+        return false;
+
+    while(!file.atEnd())
+    {
+        QByteArray chunk = file.readLine().trimmed();
+
+        if(!chunk.isEmpty())
+            chunks << chunk;
+    }
+
+    return true;
+}
+
+BackupStore::RestoreStatus BackupStore::restore(const QString& manifestPath, const Entry& entry)
+{
+    // manifests are kept in <store>/jobs
+    QString storeLocation = QFileInfo(QFileInfo(manifestPath).absolutePath()).absolutePath();
+
+    qint64 size = 0;
+    QList<QByteArray> chunks;
+
+    if(!readFileList(storeLocation, entry.hash, size, chunks))
+        return ObjectMissing;
+
+    foreach(const QByteArray& chunk, chunks)
+    {
+        if(!QFile::exists(chunkPath(storeLocation, chunk)))
+            return ObjectMissing;
+    }
+
+    QFileInfo target(entry.filePath);
+
+    if(!QDir().mkpath(target.absolutePath()))
+        return RestoreFailed;
+
+    // assembled next to the file, then put in its place in one step
+    QString tempFile = target.absolutePath() + "/." + target.fileName() + ".aerestore";
+    QFile out(tempFile);
+
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return RestoreFailed;
+
+    qint64 written = 0;
+
+    foreach(const QByteArray& chunk, chunks)
+    {
+        QFile in(chunkPath(storeLocation, chunk));
+
+        if(!in.open(QIODevice::ReadOnly))
+            break;
+
+        QByteArray data = in.readAll();
+
+        if(out.write(data) != data.size())
+            break;
+
+        written += data.size();
+    }
+
+    out.close();
+
+    if((written != size) || (written != entry.size) || !AtomicWriter::replaceFile(tempFile, target.absoluteFilePath()))
+    {
+        qDebug("AnalogExif: BackupStore::restore() unable to restore %s", qPrintable(entry.filePath));
+        QFile::remove(tempFile);
+
+        return RestoreFailed;
+    }
+
+    return Restored;
+}
+
+int BackupStore::prune(int keepDays)
+{
+    // keep everything
+    if(keepDays <= 0)
+        return 0;
+
+    QStringList locations;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        locations = m_manifests.keys();
+    }
+
+    int removed = 0;
+
+    foreach(const QString& storeLocation, locations)
+    {
+        removed += pruneLocation(storeLocation, keepDays);
+    }
+
+    return removed;
+}
+
+int BackupStore::pruneLocation(const QString& location, int keepDays)
+{
+    QDateTime now = QDateTime::currentDateTime();
+    QDateTime limit = now.addDays(-keepDays);
+
+    // scanning every object is not for every batch
+    QFile stamp(location + "/pruned");
+    QFileInfo stampInfo(stamp);
+
+    if(stampInfo.exists() && (stampInfo.lastModified().secsTo(now) < pruneIntervalSecs))
+        return 0;
+
+    if(stamp.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        stamp.write(now.toString(Qt::ISODate).toLatin1());
+
+    stamp.close();
+
+    QSet<QByteArray> files;
+    int removed = 0;
+
+    foreach(const QFileInfo& info, QDir(location + "/jobs").entryInfoList(QStringList() << "*.manifest", QDir::Files))
+    {
+        if(info.lastModified() < limit)
+        {
+            if(QFile::remove(info.absoluteFilePath()))
+                removed++;
+
+            continue;
+        }
+
+        QList<Entry> entries;
+
+        // references unknown, remove nothing
+        if(!readManifest(info.absoluteFilePath(), entries))
+            return removed;
+
+        foreach(const Entry& entry, entries)
+        {
+            files.insert(entry.hash);
+        }
+    }
+
+    QSet<QByteArray> chunks;
+
+    foreach(const QByteArray& hash, files)
+    {
+        qint64 size = 0;
+        QList<QByteArray> fileChunks;
+
+        if(readFileList(location, hash, size, fileChunks))
+        {
+            foreach(const QByteArray& chunk, fileChunks)
+            {
+                chunks.insert(chunk);
+            }
+        }
+    }
+
+    QDateTime graceLimit = now.addSecs(-pruneGraceSecs);
+
+    removed += sweepObjects(location + "/files", files, graceLimit);
+    removed += sweepObjects(location + "/chunks", chunks, graceLimit);
+
+    qDebug("AnalogExif: BackupStore::pruneLocation(%s) %d job(s) and object(s) removed", qPrintable(location), removed);
+
+    return removed;
+}
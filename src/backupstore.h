@@ -0,0 +1,169 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BACKUPSTORE_H
+#define BACKUPSTORE_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+
+class QFile;
+
+// central deduplicating backup store
+//
+// files are cut into fixed-size chunks, every chunk is stored once under its
+// hash: <store>/chunks/<2 hex digits>/<hash>; a file is stored as the list
+// of its chunks under the hash of the whole contents:
+// <store>/files/<2 hex digits>/<hash>; every job writes a manifest
+// <store>/jobs/<job id>.manifest listing hash, size, modification time and
+// path of each file
+//
+// a metadata edit only changes the chunks holding the metadata, so repeated
+// batches on the same files store a few chunks per file and nothing is ever
+// overwritten; a change that moves the image data within the file still
+// stores the moved chunks again
+//
+// without a configured location every volume gets its own store in its root
+// folder, so chunks can be reflinks of the originals; the store in the
+// application data folder is used where the root is not writable
+//
+// the hashes are SHA-256, the chunks are read, hashed and stored in parallel
+class BackupStore
+{
+public:
+    struct Result
+    {
+        Result()
+            : ok(false),
+              stored(false),
+              bytesCopied(0)
+        {
+        }
+
+        bool    ok;
+        // some of the content was new to the store
+        bool    stored;
+        qint64  bytesCopied;
+    };
+
+    // file of a job manifest
+    struct Entry
+    {
+        Entry()
+            : size(0),
+              modified(0)
+        {
+        }
+
+        QByteArray  hash;
+        qint64      size;
+        // msecs since epoch
+        qint64      modified;
+        QString     filePath;
+    };
+
+    enum RestoreStatus
+    {
+        Restored,
+        // chunks or file list missing from the store
+        ObjectMissing,
+        RestoreFailed
+    };
+
+    // start a new job, stores on the volumes of the files if location is empty
+    explicit BackupStore(const QString& location = QString());
+    ~BackupStore();
+
+    // store used for the file
+    QString location(const QString& filePath) const;
+
+    QString jobId() const
+    {
+        return m_jobId;
+    }
+
+    // back up the chunks of the file not stored yet,
+    // can be called from several threads
+    Result store(const QString& filePath);
+
+    // remove manifests older than keepDays from the stores used by the job,
+    // then the files and chunks no manifest refers to; each store is checked
+    // at most once per pruneIntervalSecs, returns objects removed
+    int prune(int keepDays);
+
+    // read the files of a job manifest
+    static bool readManifest(const QString& manifestPath, QList<Entry>& entries);
+
+    // put the stored contents in place of the file of the entry
+    static RestoreStatus restore(const QString& manifestPath, const Entry& entry);
+
+    // content hash of the file as hex string, empty if unreadable
+    static QByteArray contentHash(const QString& filePath);
+
+    // store location used where no other can be
+    static QString defaultLocation();
+
+    // stored chunk and file list of the hex hash
+    static QString chunkPath(const QString& location, const QByteArray& hash);
+    static QString filesPath(const QString& location, const QByteArray& hash);
+
+    // hidden store folder in the root of a volume
+    static const char* const folderName;
+
+    // files are cut into chunks of this size, one chunk per thread
+    static const int chunkSize = 4 * 1024 * 1024;
+
+    // unreferenced objects younger than this are kept, a job may be storing them
+    static const int pruneGraceSecs = 3600;
+
+    // a store is scanned for old jobs at most this often
+    static const int pruneIntervalSecs = 24 * 3600;
+
+private:
+    Q_DISABLE_COPY(BackupStore)
+
+    // chunk hashes of a stored file
+    static bool readFileList(const QString& location, const QByteArray& hash, qint64& size, QList<QByteArray>& chunks);
+
+    // write data under a private name, the rename makes the object appear complete
+    static bool writeObject(const QString& objectFile, const QByteArray& data);
+
+    // append manifest line of the job
+    bool addToManifest(const QString& location, const QByteArray& hash, const QString& filePath);
+
+    // remove old manifests and unreferenced objects of one store
+    static int pruneLocation(const QString& location, int keepDays);
+
+    QString     m_location;
+    QString     m_jobId;
+
+    // guards the members below
+    mutable QMutex                  m_mutex;
+    // store of each volume root
+    mutable QHash<QString, QString> m_volumeStores;
+    // manifest of each store used
+    QHash<QString, QFile*>          m_manifests;
+};
+
+#endif // BACKUPSTORE_H
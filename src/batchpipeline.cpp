@@ -0,0 +1,306 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "batchpipeline.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QMutexLocker>
+
+// single stage thread
+class BatchPipelineTask : public QRunnable
+{
+public:
+
+    BatchPipelineTask(BatchPipeline* const pipeline, int stage)
+        : m_pipeline(pipeline),
+          m_stage(stage)
+    {
+    }
+
+    void run()
+    {
+        m_pipeline->runStage(m_stage);
+    }
+
+private:
+
+    BatchPipeline*  m_pipeline;
+    int             m_stage;
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+BatchPipeline::FileQueue::FileQueue(int capacity)
+    : m_capacity(capacity),
+      m_closed(false),
+      m_aborted(false)
+{
+}
+
+bool BatchPipeline::FileQueue::push(const QString& filePath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(!m_aborted && (m_files.count() >= m_capacity))
+        m_notFull.wait(&m_mutex);
+
+    if(m_aborted)
+        return false;
+
+    m_files.enqueue(filePath);
+    m_notEmpty.wakeOne();
+
+    return true;
+}
+
+bool BatchPipeline::FileQueue::pop(QString& filePath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(!m_aborted && !m_closed && m_files.isEmpty())
+        m_notEmpty.wait(&m_mutex);
+
+    if(m_aborted || m_files.isEmpty())
+        return false;
+
+    filePath = m_files.dequeue();
+    m_notFull.wakeOne();
+
+    return true;
+}
+
+void BatchPipeline::FileQueue::close()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_closed = true;
+    m_notEmpty.wakeAll();
+}
+
+void BatchPipeline::FileQueue::abort()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_aborted = true;
+    m_files.clear();
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+BatchPipeline::BatchPipeline(const WriteFunction& write, QWidget* const parent)
+    : QObject(parent),
+      m_write(write),
+      m_backups(0),
+      m_writer(0),
+      // every format metadata can be written to, checked by contents
+      m_walker(ImageFormats::suffixes(ImageFormats::WriteInPlace)),
+      m_scanned(scanQueueSize),
+      m_backedUp(backupQueueSize),
+      m_filesWritten(0),
+      m_tasksFinished(0),
+      m_backupsRunning(backupThreads),
+      m_scanFinished(0),
+      m_cancelled(0),
+      m_error(NoError)
+{
+    m_walker.setRequiredCapabilities(ImageFormats::WriteInPlace);
+    m_walker.setSink(this);
+
+    m_pool.setMaxThreadCount(taskCount);
+}
+
+BatchPipeline::~BatchPipeline()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void BatchPipeline::start(const QStringList& paths)
+{
+    m_paths = paths;
+
+    // no "to all" buttons for a single file
+    if(m_backups)
+        m_backups->setSingleFile((paths.count() == 1) && !QFileInfo(paths.at(0)).isDir());
+
+    m_pool.start(new BatchPipelineTask(this, ScanStage));
+
+    for(int i = 0; i < backupThreads; i++)
+        m_pool.start(new BatchPipelineTask(this, BackupStage));
+
+    m_pool.start(new BatchPipelineTask(this, WriteStage));
+}
+
+void BatchPipeline::cancel()
+{
+    m_cancelled.store(1);
+    m_walker.cancel();
+
+    // no questions after cancel
+    if(m_backups)
+        m_backups->cancel();
+
+    m_scanned.abort();
+    m_backedUp.abort();
+}
+
+int BatchPipeline::filesFound() const
+{
+    return m_walker.filesFound();
+}
+
+QString BatchPipeline::currentFile() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_currentFile;
+}
+
+BatchPipeline::Error BatchPipeline::error() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_error;
+}
+
+QString BatchPipeline::errorFile() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_errorFile;
+}
+
+void BatchPipeline::fail(Error error, const QString& filePath)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if(m_error == NoError)
+        {
+            m_error = error;
+            m_errorFile = filePath;
+        }
+    }
+
+    cancel();
+}
+
+void BatchPipeline::runStage(int stage)
+{
+    switch(stage)
+    {
+    case ScanStage:
+        scan();
+        break;
+    case BackupStage:
+        backup();
+        break;
+    case WriteStage:
+        write();
+        break;
+    }
+
+    m_tasksFinished.ref();
+}
+
+void BatchPipeline::filesListed(const QStringList& files)
+{
+    foreach(const QString& filePath, files)
+    {
+        // queue full - the walker waits here for the writes to catch up
+        if(!m_scanned.push(filePath))
+        {
+            m_walker.cancel();
+            return;
+        }
+    }
+}
+
+void BatchPipeline::scan()
+{
+    m_walker.walk(m_paths);
+
+    m_scanFinished.store(1);
+    m_scanned.close();
+}
+
+void BatchPipeline::backup()
+{
+    QString filePath;
+
+    while(m_scanned.pop(filePath))
+    {
+        if(m_backups)
+        {
+            QString errorFile;
+            BackupPolicy::Status status = m_backups->backup(filePath, &errorFile);
+
+            if(status == BackupPolicy::Cancelled)
+            {
+                fail(BackupCancelled, filePath);
+                break;
+            }
+
+            if(status == BackupPolicy::Failed)
+            {
+                fail(BackupFailed, errorFile);
+                break;
+            }
+        }
+
+        if(!m_backedUp.push(filePath))
+            break;
+    }
+
+    // the last backup thread lets the writer drain the queue
+    if(!m_backupsRunning.deref())
+        m_backedUp.close();
+}
+
+void BatchPipeline::write()
+{
+    QString filePath;
+
+    while(m_backedUp.pop(filePath))
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_currentFile = filePath;
+        }
+
+        // with a group commit the failed file may be an earlier one
+        QString failedFile = filePath;
+        bool written = (m_writer ? m_writer->write(filePath, m_write, &failedFile) : m_write(filePath));
+
+        if(!written)
+        {
+            fail(WriteFailed, failedFile);
+            return;
+        }
+
+        m_filesWritten.ref();
+
+        emit fileWritten(filePath);
+    }
+}
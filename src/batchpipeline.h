@@ -0,0 +1,214 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+
+// Qt includes
+
+#include <QObject>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+
+// Local includes
+
+#include "directorywalker.h"
+#include "backuppolicy.h"
+#include "atomicwriter.h"
+
+// C++ includes
+
+#include <functional>
+
+class QWidget;
+
+// batch metadata update of the selected files and folders
+//
+// scanning, backup copies and metadata writes run as three stages connected
+// by short bounded queues: a full queue stops the stage feeding it, so the
+// disk reads, copies and writes overlap and the first files are written
+// while the folders are still being listed
+//
+// backups are copied by several threads, files are written one at a time
+class BatchPipeline : public QObject, private DirectoryWalkerSink
+{
+    Q_OBJECT
+
+public:
+
+    // writes metadata to a single file, called from the write stage thread
+    typedef std::function<bool (const QString& filePath)> WriteFunction;
+
+    enum Error
+    {
+        NoError,
+        // user cancelled the run at the backup question
+        BackupCancelled,
+        BackupFailed,
+        WriteFailed
+    };
+
+    BatchPipeline(const WriteFunction& write, QWidget* const parent);
+    ~BatchPipeline();
+
+    // back up every file before writing it
+    void setBackupPolicy(BackupPolicy* backups)
+    {
+        m_backups = backups;
+    }
+
+    // write through a temporary copy replacing the file
+    void setAtomicWriter(AtomicWriter* writer)
+    {
+        m_writer = writer;
+    }
+
+    // start on the given files and folders, returns immediately
+    void start(const QStringList& paths);
+
+    // stop all stages, files already written stay written;
+    // returns immediately, poll isFinished() and keep the event loop running
+    void cancel();
+
+    bool isFinished() const
+    {
+        return (m_tasksFinished.load() == taskCount);
+    }
+
+    // number of files found so far
+    int filesFound() const;
+
+    // number of files written so far
+    int filesWritten() const
+    {
+        return m_filesWritten.load();
+    }
+
+    // the scan is complete, filesFound() is final
+    bool isScanFinished() const
+    {
+        return (m_scanFinished.load() != 0);
+    }
+
+    // file being written
+    QString currentFile() const;
+
+    // first error, file it happened on
+    Error error() const;
+    QString errorFile() const;
+
+    // files waiting between the stages
+    static const int scanQueueSize = 256;
+    static const int backupQueueSize = 8;
+
+    // concurrent backup copies, reflinks are cheap but still wait for metadata I/O
+    static const int backupThreads = 2;
+
+Q_SIGNALS:
+
+    // file written successfully, emitted from the write thread
+    void fileWritten(const QString& filePath);
+
+private:
+
+    friend class BatchPipelineTask;
+
+    enum Stage
+    {
+        ScanStage,
+        BackupStage,
+        WriteStage
+    };
+
+    // scan and write threads plus the backup ones
+    static const int taskCount = 2 + backupThreads;
+
+    // blocking queue of file names
+    class FileQueue
+    {
+    public:
+        explicit FileQueue(int capacity);
+
+        // blocks while full, false if aborted
+        bool push(const QString& filePath);
+
+        // blocks while empty, false if aborted or closed and empty
+        bool pop(QString& filePath);
+
+        // no more files will be pushed
+        void close();
+
+        // wake everyone up, all further calls fail
+        void abort();
+
+    private:
+        QMutex          m_mutex;
+        QWaitCondition  m_notEmpty;
+        QWaitCondition  m_notFull;
+        QQueue<QString> m_files;
+        int             m_capacity;
+        bool            m_closed;
+        bool            m_aborted;
+    };
+
+    // walker threads feed the scan queue
+    void filesListed(const QStringList& files);
+
+    // stage thread loops
+    void runStage(int stage);
+    void scan();
+    void backup();
+    void write();
+
+    // record the first error and stop all stages
+    void fail(Error error, const QString& filePath);
+
+    bool isCancelled() const
+    {
+        return (m_cancelled.load() != 0);
+    }
+
+    WriteFunction       m_write;
+    BackupPolicy*       m_backups;
+    AtomicWriter*       m_writer;
+    QStringList         m_paths;
+
+    DirectoryWalker     m_walker;
+    FileQueue           m_scanned;
+    FileQueue           m_backedUp;
+    QThreadPool         m_pool;
+
+    QAtomicInt          m_filesWritten;
+    QAtomicInt          m_tasksFinished;
+    QAtomicInt          m_backupsRunning;
+    QAtomicInt          m_scanFinished;
+    QAtomicInt          m_cancelled;
+
+    // guards the members below
+    mutable QMutex      m_mutex;
+    QString             m_currentFile;
+    Error               m_error;
+    QString             m_errorFile;
+};
+
+#endif // BATCHPIPELINE_H
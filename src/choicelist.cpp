@@ -0,0 +1,138 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "choicelist.h"
+
+// Qt includes
+
+#include <QReadWriteLock>
+
+namespace
+{
+    // parsed lists by type, flags and encoded string
+    QHash<QString, QSharedPointer<const ChoiceList> > choiceCache;
+    // lists are also looked up from the batch threads
+    QReadWriteLock choiceCacheLock;
+
+    QString cacheKey(const QString& list, ExifItem::TagType dataType, ExifItem::TagFlags flags)
+    {
+        return QString::number(dataType) + ":" + QString::number((int)flags) + ":" + list;
+    }
+}
+
+ChoiceList::ChoiceList(const QString& list, ExifItem::TagType dataType, ExifItem::TagFlags flags)
+    : integersOnly(true)
+{
+    QStringList items = list.split(";;", QString::SkipEmptyParts);
+
+    foreach(QString itemPair, items)
+    {
+        QStringList values = itemPair.split("||", QString::SkipEmptyParts);
+        if(values.count() != 2)
+        {
+            // malformed list is treated as empty
+            choiceTexts.clear();
+            choiceValues.clear();
+            exifValues.clear();
+            integerIndex.clear();
+
+            return;
+        }
+
+        QVariant value = ExifItem::valueFromString(values.at(1), dataType, true, flags);
+
+        ExifValue exifValue(value);
+
+        choiceTexts << values.at(0);
+        choiceValues << value;
+        exifValues << exifValue;
+
+        if(exifValue.kind() != ExifValue::Integer)
+        {
+            integersOnly = false;
+            continue;
+        }
+
+        qint64 key = exifValue.toLongLong();
+        if(!integerIndex.contains(key))
+            integerIndex.insert(key, exifValues.count() - 1);
+    }
+}
+
+QSharedPointer<const ChoiceList> ChoiceList::get(const QString& list, ExifItem::TagType dataType, ExifItem::TagFlags flags)
+{
+    QString key = cacheKey(list, dataType, flags);
+
+    {
+        QReadLocker locker(&choiceCacheLock);
+
+        QHash<QString, QSharedPointer<const ChoiceList> >::const_iterator it = choiceCache.constFind(key);
+        if(it != choiceCache.constEnd())
+            return it.value();
+    }
+
+    QSharedPointer<const ChoiceList> choices(new ChoiceList(list, dataType, flags));
+
+    QWriteLocker locker(&choiceCacheLock);
+
+    // another thread could have parsed it meanwhile
+    QHash<QString, QSharedPointer<const ChoiceList> >::const_iterator it = choiceCache.constFind(key);
+    if(it != choiceCache.constEnd())
+        return it.value();
+
+    choiceCache.insert(key, choices);
+
+    return choices;
+}
+
+void ChoiceList::clearCache()
+{
+    QWriteLocker locker(&choiceCacheLock);
+
+    choiceCache.clear();
+}
+
+int ChoiceList::indexOf(const ExifValue& value) const
+{
+    if(value.kind() == ExifValue::Integer)
+    {
+        int idx = integerIndex.value(value.toLongLong(), -1);
+
+        if((idx >= 0) || integersOnly)
+            return idx;
+    }
+
+    // other kinds follow QVariant comparison, e.g. a string equals a number
+    for(int i = 0; i < exifValues.count(); i++)
+    {
+        if(exifValues.at(i) == value)
+            return i;
+    }
+
+    return -1;
+}
+
+QString ChoiceList::textOf(const ExifValue& value) const
+{
+    int idx = indexOf(value);
+
+    if(idx < 0)
+        return QString();
+
+    return choiceTexts.at(idx);
+}
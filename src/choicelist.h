@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CHOICELIST_H
+#define CHOICELIST_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QHash>
+#include <QVector>
+#include <QSharedPointer>
+
+// Local includes
+
+#include "exifitem.h"
+
+// parsed "text||value;;text||value" list of a Choice tag
+//
+// lists are parsed once when the template is loaded and kept by the tag
+// items, display and editors look values up instead of splitting the
+// encoded string
+class ChoiceList
+{
+public:
+    // parsed list for the encoded string, from the cache if possible
+    static QSharedPointer<const ChoiceList> get(const QString& list, ExifItem::TagType dataType, ExifItem::TagFlags flags = ExifItem::None);
+
+    // forget all parsed lists, call when the template is changed
+    static void clearCache();
+
+    // number of choices, 0 for an empty or malformed list
+    int count() const
+    {
+        return choiceValues.count();
+    }
+
+    const QString& text(int idx) const
+    {
+        return choiceTexts.at(idx);
+    }
+
+    const QVariant& value(int idx) const
+    {
+        return choiceValues.at(idx);
+    }
+
+    // position of the value, -1 if not in the list
+    int indexOf(const ExifValue& value) const;
+
+    int indexOf(const QVariant& value) const
+    {
+        return indexOf(ExifValue(value));
+    }
+
+    // text of the value, empty if not in the list
+    QString textOf(const ExifValue& value) const;
+
+    QString textOf(const QVariant& value) const
+    {
+        return textOf(ExifValue(value));
+    }
+
+private:
+    ChoiceList(const QString& list, ExifItem::TagType dataType, ExifItem::TagFlags flags);
+
+    QStringList choiceTexts;
+    QVariantList choiceValues;
+    // same values, compared without conversion
+    QVector<ExifValue> exifValues;
+    // integer value -> first position, the usual case
+    QHash<qint64, int> integerIndex;
+    // all values are integers, the index alone decides
+    bool integersOnly;
+};
+
+#endif // CHOICELIST_H
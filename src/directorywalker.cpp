@@ -0,0 +1,440 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "directorywalker.h"
+
+// Qt includes
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
+
+// Local includes
+
+#include "folderwatcher.h"
+
+// C++ includes
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <dirent.h>
+#else
+#   include <QDirIterator>
+#endif
+
+namespace
+{
+    bool localeAwareLessThan(const QString& left, const QString& right)
+    {
+        return (QString::localeAwareCompare(left, right) < 0);
+    }
+}
+
+// single walker thread
+class DirectoryWalkerTask : public QRunnable
+{
+public:
+
+    DirectoryWalkerTask(DirectoryWalker* const walker, int worker)
+        : m_walker(walker),
+          m_worker(worker)
+    {
+    }
+
+    void run()
+    {
+        m_walker->work(m_worker);
+    }
+
+private:
+
+    DirectoryWalker*    m_walker;
+    int                 m_worker;
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+DirectoryWalker::DirectoryWalker(const QStringList& suffixes, bool includeDirs)
+    : m_suffixes(suffixes),
+      m_includeDirs(includeDirs),
+      m_required(ImageFormats::None),
+      m_sink(0),
+      m_filesFound(0),
+      m_filesRejected(0),
+      m_cancelled(0),
+      m_pendingDirs(0)
+{
+    // mostly waiting for (network) storage, more threads than cores pay off
+    int threads = qBound(4, QThread::idealThreadCount(), 16);
+
+    for(int i = 0; i < threads; i++)
+        m_queues.append(new WorkQueue);
+}
+
+DirectoryWalker::~DirectoryWalker()
+{
+    qDeleteAll(m_queues);
+}
+
+QStringList DirectoryWalker::walk(const QStringList& paths)
+{
+    QStringList result;
+    QStringList roots;
+
+    foreach(const QString& path, paths)
+    {
+        QFileInfo fInfo(path);
+
+        if(!fInfo.exists() || !fInfo.isDir())
+            continue;
+
+        roots << fInfo.absoluteFilePath();
+    }
+
+    // single files are known already, hand them over first
+    if(m_sink)
+    {
+        foreach(const QString& path, paths)
+        {
+            QFileInfo fInfo(path);
+
+            if(!fInfo.exists() || fInfo.isDir() || !accept(path))
+                continue;
+
+            m_filesFound.ref();
+            m_sink->filesListed(QStringList() << QDir::toNativeSeparators(path));
+        }
+    }
+
+    // spread the roots over the queues
+    for(int i = 0; i < roots.count(); i++)
+        pushWork(i % m_queues.count(), roots.at(i));
+
+    if(!roots.isEmpty())
+    {
+        QThreadPool pool;
+        pool.setMaxThreadCount(m_queues.count());
+
+        for(int i = 0; i < m_queues.count(); i++)
+            pool.start(new DirectoryWalkerTask(this, i));
+
+        pool.waitForDone();
+    }
+
+    if(isCancelled() || m_sink)
+        return QStringList();
+
+    // merge per-thread buffers
+    QHash<QString, Listing> listings;
+
+    for(int i = 0; i < m_queues.count(); i++)
+    {
+        listings.unite(m_queues.at(i)->results);
+        m_queues.at(i)->results.clear();
+    }
+
+    // keep the order of the given paths
+    foreach(const QString& path, paths)
+    {
+        QFileInfo fInfo(path);
+
+        if(!fInfo.exists())
+            continue;
+
+        // if file - just add the file to the list
+        if(!fInfo.isDir())
+        {
+            if(accept(path))
+            {
+                result << QDir::toNativeSeparators(path);
+                m_filesFound.ref();
+            }
+
+            continue;
+        }
+
+        collect(fInfo.absoluteFilePath(), listings, result);
+    }
+
+    return result;
+}
+
+void DirectoryWalker::cancel()
+{
+    m_cancelled.store(1);
+
+    // pending folders are abandoned, nobody else wakes the idle threads
+    QMutexLocker locker(&m_idleMutex);
+    m_idleCondition.wakeAll();
+}
+
+void DirectoryWalker::work(int worker)
+{
+    QString dir;
+
+    while(!isCancelled())
+    {
+        if(!takeWork(worker, dir))
+        {
+            // checked again under the lock the wakers take, so no wake-up is missed
+            QMutexLocker locker(&m_idleMutex);
+
+            // nothing queued and nothing being listed - done
+            if((m_pendingDirs.load() == 0) || isCancelled())
+                break;
+
+            if(takeWork(worker, dir))
+            {
+                locker.unlock();
+            }
+            else
+            {
+                m_idleCondition.wait(&m_idleMutex);
+                continue;
+            }
+        }
+
+        Listing listing;
+        listDirectory(dir, listing);
+
+        foreach(const QString& subDir, listing.subDirs)
+            pushWork(worker, subDir);
+
+        m_filesFound.fetchAndAddRelaxed(listing.files.count() + (m_includeDirs ? 1 : 0));
+
+        if(m_sink)
+        {
+            if(m_includeDirs)
+                listing.files << QDir::toNativeSeparators(dir);
+
+            if(!listing.files.isEmpty())
+                m_sink->filesListed(listing.files);
+        }
+        else
+        {
+            m_queues.at(worker)->results.insert(dir, listing);
+        }
+
+        // children are queued already, so zero means really done
+        if(!m_pendingDirs.deref())
+        {
+            QMutexLocker locker(&m_idleMutex);
+            m_idleCondition.wakeAll();
+        }
+    }
+}
+
+bool DirectoryWalker::takeWork(int worker, QString& dir)
+{
+    // own queue - depth first, keeps the queue short
+    {
+        WorkQueue* const queue = m_queues.at(worker);
+        QMutexLocker locker(&queue->mutex);
+
+        if(!queue->dirs.isEmpty())
+        {
+            dir = queue->dirs.takeLast();
+            return true;
+        }
+    }
+
+    // steal the oldest (usually largest) folder of another thread
+    for(int i = 1; i < m_queues.count(); i++)
+    {
+        WorkQueue* const queue = m_queues.at((worker + i) % m_queues.count());
+        QMutexLocker locker(&queue->mutex);
+
+        if(!queue->dirs.isEmpty())
+        {
+            dir = queue->dirs.takeFirst();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DirectoryWalker::pushWork(int worker, const QString& dir)
+{
+    m_pendingDirs.ref();
+
+    {
+        WorkQueue* const queue = m_queues.at(worker);
+        QMutexLocker locker(&queue->mutex);
+
+        queue->dirs.append(dir);
+    }
+
+    QMutexLocker locker(&m_idleMutex);
+    m_idleCondition.wakeOne();
+}
+
+bool DirectoryWalker::accept(const QString& filePath)
+{
+    if(m_required == ImageFormats::None)
+        return true;
+
+    // a few bytes read here save an Exiv2 open later
+    const ImageFormats::Format* const format = ImageFormats::sniff(filePath);
+
+    if(format && ((format->capabilities & m_required) == m_required))
+        return true;
+
+    qDebug("AnalogExif: DirectoryWalker::accept() skipping unsupported file %s", qPrintable(filePath));
+    m_filesRejected.ref();
+
+    return false;
+}
+
+bool DirectoryWalker::readDirectory(const QString& path, QStringList& files, QStringList& dirs)
+{
+#ifdef Q_OS_UNIX
+
+    DIR* const dir = opendir(QFile::encodeName(path).constData());
+
+    if(!dir)
+        return false;
+
+    while(struct dirent* const entry = readdir(dir))
+    {
+        // skips . and .. as well
+        if(entry->d_name[0] == '.')
+            continue;
+
+        QString name = QFile::decodeName(entry->d_name);
+        bool isDir = false;
+        bool isFile = false;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        // file type comes with the entry on most file systems
+        if(entry->d_type == DT_DIR)
+            isDir = true;
+        else if(entry->d_type == DT_REG)
+            isFile = true;
+        else if((entry->d_type == DT_LNK) || (entry->d_type == DT_UNKNOWN))
+#endif
+        {
+            // symbolic link or no type information, stat is needed
+            struct stat st;
+
+            if(stat(QFile::encodeName(path + "/" + name).constData(), &st) == 0)
+            {
+                isDir = S_ISDIR(st.st_mode);
+                isFile = S_ISREG(st.st_mode);
+            }
+        }
+
+        if(isDir)
+            dirs << name;
+        else if(isFile)
+            files << name;
+    }
+
+    closedir(dir);
+
+#else
+
+    if(!QFileInfo(path).isDir())
+        return false;
+
+    // file information is filled from the directory listing itself here
+    QDirIterator it(path, QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot);
+
+    while(it.hasNext())
+    {
+        it.next();
+
+        QFileInfo fInfo = it.fileInfo();
+
+        if(fInfo.isDir())
+            dirs << fInfo.fileName();
+        else
+            files << fInfo.fileName();
+    }
+
+#endif
+
+    return true;
+}
+
+void DirectoryWalker::listDirectory(const QString& path, Listing& listing)
+{
+    QStringList allFiles;
+    QStringList dirs;
+
+    // watched folders are kept up to date without listing them again
+    FolderWatcher* const watcher = FolderWatcher::instance();
+
+    if(!watcher || !watcher->cachedListing(path, allFiles, dirs))
+    {
+        if(watcher)
+            watcher->beginListing(path);
+
+        if(!readDirectory(path, allFiles, dirs))
+            return;
+
+        if(watcher)
+            watcher->storeListing(path, allFiles, dirs);
+    }
+
+    QStringList files;
+
+    foreach(const QString& name, allFiles)
+    {
+        if(m_suffixes.contains(name.section('.', -1).toLower()))
+            files << name;
+    }
+
+    std::sort(files.begin(), files.end(), localeAwareLessThan);
+    std::sort(dirs.begin(), dirs.end(), localeAwareLessThan);
+
+    foreach(const QString& name, files)
+    {
+        QString filePath = path + "/" + name;
+
+        if(accept(filePath))
+            listing.files << QDir::toNativeSeparators(filePath);
+    }
+
+    foreach(const QString& name, dirs)
+        listing.subDirs << path + "/" + name;
+}
+
+void DirectoryWalker::collect(const QString& dir, const QHash<QString, Listing>& listings, QStringList& result) const
+{
+    QHash<QString, Listing>::const_iterator it = listings.constFind(dir);
+
+    if(it == listings.constEnd())
+        return;
+
+    result << it->files;
+
+    foreach(const QString& subDir, it->subDirs)
+        collect(subDir, listings, result);
+
+    if(m_includeDirs)
+        result << QDir::toNativeSeparators(dir);
+}
@@ -0,0 +1,159 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+
+// Local includes
+
+#include "imageformats.h"
+
+// receiver of the files while the walk is still running
+class DirectoryWalkerSink
+{
+public:
+    virtual ~DirectoryWalkerSink()
+    {
+    }
+
+    // called from the walker threads, once per listed folder;
+    // blocking here slows the walk down
+    virtual void filesListed(const QStringList& files) = 0;
+};
+
+// parallel recursive file lister
+//
+// folders are listed by several threads, each with its own work queue;
+// idle threads steal folders from the others; listings are buffered per
+// thread and merged at the end, so the result is ordered exactly like a
+// single-threaded walk: sorted files of a folder, then its sorted subfolders
+// (recursively), then the folder itself if requested
+class DirectoryWalker
+{
+public:
+    // suffixes (lower case, without dot) of the files to list
+    explicit DirectoryWalker(const QStringList& suffixes, bool includeDirs = false);
+    ~DirectoryWalker();
+
+    // check the contents of every matching file, keep only those of a format
+    // having the required capabilities (no check by default)
+    void setRequiredCapabilities(ImageFormats::Capabilities required)
+    {
+        m_required = required;
+    }
+
+    // hand files over to the sink as soon as their folder is listed,
+    // in no particular order; walk() returns an empty list then
+    void setSink(DirectoryWalkerSink* sink)
+    {
+        m_sink = sink;
+    }
+
+    // list files of the given files or folders, blocks until done or cancelled
+    QStringList walk(const QStringList& paths);
+
+    // number of files dropped by the contents check
+    int filesRejected() const
+    {
+        return m_filesRejected.load();
+    }
+
+    // number of entries found so far, can be read from any thread
+    int filesFound() const
+    {
+        return m_filesFound.load();
+    }
+
+    // stop walking, walk() returns an empty list
+    void cancel();
+
+    bool isCancelled() const
+    {
+        return (m_cancelled.load() != 0);
+    }
+
+private:
+    friend class DirectoryWalkerTask;
+
+    // sorted contents of a single folder, full native paths of files
+    struct Listing
+    {
+        QStringList files;
+        QStringList subDirs;
+    };
+
+    // per-thread state
+    struct WorkQueue
+    {
+        // folders waiting to be listed, guarded by the mutex
+        QMutex      mutex;
+        QStringList dirs;
+
+        // listings done by the thread, touched by the owner only
+        QHash<QString, Listing> results;
+    };
+
+    // thread loop
+    void work(int worker);
+
+    // take folder from own queue or steal one from the others
+    bool takeWork(int worker, QString& dir);
+    void pushWork(int worker, const QString& dir);
+
+    // list single folder
+    void listDirectory(const QString& path, Listing& listing);
+
+    // names of the regular files and subfolders, hidden ones excluded
+    static bool readDirectory(const QString& path, QStringList& files, QStringList& dirs);
+
+    // file passes the contents check
+    bool accept(const QString& filePath);
+
+    // append merged results of the folder
+    void collect(const QString& dir, const QHash<QString, Listing>& listings, QStringList& result) const;
+
+    QStringList             m_suffixes;
+    bool                    m_includeDirs;
+    ImageFormats::Capabilities m_required;
+    DirectoryWalkerSink*    m_sink;
+
+    QAtomicInt              m_filesFound;
+    QAtomicInt              m_filesRejected;
+    QAtomicInt              m_cancelled;
+    // folders queued or being listed
+    QAtomicInt              m_pendingDirs;
+
+    // idle threads wait for new folders, the end of the walk or cancel
+    QMutex                  m_idleMutex;
+    QWaitCondition          m_idleCondition;
+
+    QVector<WorkQueue*>     m_queues;
+};
+
+#endif // DIRECTORYWALKER_H
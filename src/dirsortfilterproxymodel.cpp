@@ -26,7 +26,7 @@
 
 // Local includes
 
-#include "exiftreemodel.h"
+#include "fileiconprovider.h"
 
 bool DirSortFilterProxyModel::lessThan(const QModelIndex& left, const QModelIndex& right) const
 {
@@ -66,29 +66,49 @@ QVariant DirSortFilterProxyModel::data(const QModelIndex& index, int role) const
         return srcModel->fileName(index);
     }
 
-    return QSortFilterProxyModel::data(index, role);
-}
+    // thumbnail is only requested for the rows actually painted
+    if ((role == Qt::DecorationRole) && m_thumbnailProvider && (index.column() == 0))
+    {
+        QModelIndex srcIndex = mapToSource(index);
 
-// -----------------------------------------------------------------------------------------------------------
+        if (!srcModel->isDir(srcIndex))
+        {
+            return m_thumbnailProvider->thumbnail(srcModel->filePath(srcIndex));
+        }
+    }
 
-FileIconProvider::FileIconProvider(ExifTreeModel* const model)
-{
-    m_model = model;
+    return QSortFilterProxyModel::data(index, role);
 }
-    
-QIcon FileIconProvider::icon(const QFileInfo& info) const
+
+void DirSortFilterProxyModel::setThumbnailProvider(FileIconProvider* const provider)
 {
-    if (!QFileInfo(info.filePath()).isDir())
+    if (m_thumbnailProvider)
+    {
+        disconnect(m_thumbnailProvider, 0, this, 0);
+    }
+
+    m_thumbnailProvider = provider;
+
+    if (m_thumbnailProvider)
     {
-        // if the file is image
+        connect(m_thumbnailProvider, SIGNAL(thumbnailReady(QString)),
+                this, SLOT(slotThumbnailReady(QString)));
+    }
+}
 
-        QImage preview = m_model->getPreview(info.filePath());
-        QIcon myIcon(QPixmap::fromImage(preview));
+void DirSortFilterProxyModel::slotThumbnailReady(const QString& filePath)
+{
+    QFileSystemModel* const srcModel = dynamic_cast<QFileSystemModel*>(sourceModel());
 
-        return myIcon;
+    if (!srcModel)
+    {
+        return;
     }
 
-    // if the file is not image, return default icon
+    QModelIndex idx = mapFromSource(srcModel->index(filePath));
 
-    return QFileIconProvider::icon(info);
+    if (idx.isValid())
+    {
+        emit dataChanged(idx, idx, QVector<int>() << Qt::DecorationRole);
+    }
 }
@@ -23,11 +23,9 @@
 // Qt includes
 
 #include <QSortFilterProxyModel>
-#include <QFileIconProvider>
-#include <QFileInfo>
-#include <QIcon>
+#include <QPointer>
 
-class ExifTreeModel;
+class FileIconProvider;
 
 /**
  * sorts the files/directory view
@@ -45,21 +43,17 @@ public:
 
     bool lessThan(const QModelIndex &left, const QModelIndex &right)            const;
     virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
-};
 
-// -------------------------------------------------------------------------------------
+    // serve file decorations from the thumbnail provider
+    void setThumbnailProvider(FileIconProvider* const provider);
 
-class FileIconProvider : public QFileIconProvider
-{
-public:
+private Q_SLOTS:
+
+    void slotThumbnailReady(const QString& filePath);
 
-    FileIconProvider(ExifTreeModel* const model);
-    
-    QIcon icon(const QFileInfo& info) const;
-    
 private:
-    
-    ExifTreeModel* m_model;
+
+    QPointer<FileIconProvider> m_thumbnailProvider;
 };
 
 #endif // DIRSORTFILTERPROXYMODEL_H
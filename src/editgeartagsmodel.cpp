@@ -42,44 +42,48 @@ Qt::ItemFlags EditGearTagsModel::flags(const QModelIndex &index) const
 
 QVariant EditGearTagsModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid())
+    if (!index.isValid() || (index.row() >= rows.count()))
         return QVariant();
 
-    if(!query().seek(index.row()))
-        return QVariant();
+    const PropertyRow& row = rows.at(index.row());
 
     // return tag text for column 0
-    if((index.column() == 0)  && (role == Qt::DisplayRole))
-        return query().value(0).toString();
-
-    ExifItem::TagType tagType = (ExifItem::TagType)query().value(2).toInt();
-    QString formatString = query().value(3).toString();
-    ExifItem::TagFlags tagFlags = (ExifItem::TagFlags)query().value(5).toInt();
+    if(index.column() == 0)
+    {
+        if((role == Qt::DisplayRole) || (role == Qt::EditRole))
+            return row.tagText;
+    }
 
     // return tag id
     if(role == GetTagIdRole)
-        return query().value(4);
+        return row.propertyId;
 
     if(index.column() == 1)
     {
-        QVariant itemValue = ExifItem::valueFromString(query().value(1).toString(), tagType, true, tagFlags);
+        if ((role == Qt::EditRole) || (role == Qt::DisplayRole) || (role == ExifTreeModel::GetFlagsRole) ||
+            (role == ExifTreeModel::GetChoiceRole) || (role == ExifTreeModel::GetTypeRole))
+            return ExifTreeModel::getItemData(row.itemValue, row.printFormat, (ExifItem::TagFlags)row.flags, (ExifItem::TagType)row.tagType, role);
+    }
 
-        if(tagFlags.testFlag(ExifItem::AsciiAlt))
-        {
-            QVariantList varList;
-            varList << itemValue << ExifItem::valueFromString(query().value(6).toString(), tagType, true, tagFlags);
+    return QVariant();
+}
 
-            itemValue = varList;
-        }
+QVariant EditGearTagsModel::parseValue(const PropertyRow& row)
+{
+    ExifItem::TagType tagType = (ExifItem::TagType)row.tagType;
+    ExifItem::TagFlags tagFlags = (ExifItem::TagFlags)row.flags;
+
+    QVariant itemValue = ExifItem::valueFromString(row.tagValue, tagType, true, tagFlags);
+
+    if(tagFlags.testFlag(ExifItem::AsciiAlt))
+    {
+        QVariantList varList;
+        varList << itemValue << ExifItem::valueFromString(row.altValue, tagType, true, tagFlags);
 
-        if ((index.column() == 1) && (
-            (role == Qt::EditRole) || (role == Qt::DisplayRole) || (role == ExifTreeModel::GetFlagsRole) ||
-            (role == ExifTreeModel::GetChoiceRole) || (role == ExifTreeModel::GetTypeRole)
-            ))
-            return ExifTreeModel::getItemData(itemValue, formatString, tagFlags, tagType, role);
+        itemValue = varList;
     }
 
-    return QSqlQueryModel::data(index, role);
+    return itemValue;
 }
 
 // TODO: again, should be abstracted somewhere
@@ -88,17 +92,19 @@ bool EditGearTagsModel::setData(const QModelIndex &index, const QVariant &dataVa
     if (role != Qt::EditRole)
         return false;
 
-    if(!query().seek(index.row()))
+    if(!index.isValid() || (index.row() >= rows.count()))
         return false;
 
-    ExifItem::TagType tagType = (ExifItem::TagType)query().value(2).toInt();
-    ExifItem::TagFlags tagFlags = (ExifItem::TagFlags)query().value(5).toInt();
+    PropertyRow row = rows.at(index.row());
+
+    ExifItem::TagType tagType = (ExifItem::TagType)row.tagType;
+    ExifItem::TagFlags tagFlags = (ExifItem::TagFlags)row.flags;
 
     // return value according to the tag type
     QString updateValue;
     QString updateAltValue;
 
-    QVariant oldValue = query().value(1);
+    QVariant oldValue = row.tagValue;
     QVariant value = dataValue;
 
     QVariantList varList;
@@ -136,12 +142,18 @@ bool EditGearTagsModel::setData(const QModelIndex &index, const QVariant &dataVa
         return false;
 
     // update the record
-    QSqlQuery updQuery(QString("UPDATE UserGearProperties SET TagValue = '%1', AltValue = '%2' WHERE id = %3").arg(updateValue.replace("'", "''")).arg(updateAltValue.replace("'", "''")).arg(query().value(4).toInt()));
+    QSqlQuery updQuery(QString("UPDATE UserGearProperties SET TagValue = '%1', AltValue = '%2' WHERE id = %3").arg(QString(updateValue).replace("'", "''")).arg(QString(updateAltValue).replace("'", "''")).arg(row.propertyId));
 
     if(updQuery.lastError().isValid())
         return false;
 
-    reload();
+    // write through to the cached row
+    row.tagValue = updateValue;
+    row.altValue = updateAltValue;
+    row.itemValue = parseValue(row);
+
+    rows[index.row()] = row;
+
     emit dataChanged(index, index);
 
     return true;
@@ -150,7 +162,33 @@ bool EditGearTagsModel::setData(const QModelIndex &index, const QVariant &dataVa
 void EditGearTagsModel::reload(int id)
 {
     gearId = id;
-    setQuery(QString("SELECT a.TagText, b.TagValue, a.TagType, a.PrintFormat, b.id, a.Flags, b.AltValue FROM MetaTags a, UserGearProperties b WHERE b.GearId = %1 AND a.id = b.TagId ORDER BY b.OrderBy").arg(id));
+
+    beginResetModel();
+
+    rows.clear();
+
+    // read all properties once, values are parsed here rather than on every paint
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.exec(QString("SELECT a.TagText, b.TagValue, a.TagType, a.PrintFormat, b.id, a.Flags, b.AltValue FROM MetaTags a, UserGearProperties b WHERE b.GearId = %1 AND a.id = b.TagId ORDER BY b.OrderBy").arg(id));
+
+    while(query.next())
+    {
+        PropertyRow row;
+
+        row.tagText     = query.value(0).toString();
+        row.tagValue    = query.value(1).toString();
+        row.tagType     = query.value(2).toInt();
+        row.printFormat = query.value(3).toString();
+        row.propertyId  = query.value(4).toInt();
+        row.flags       = query.value(5).toInt();
+        row.altValue    = query.value(6).toString();
+        row.itemValue   = parseValue(row);
+
+        rows.append(row);
+    }
+
+    endResetModel();
 }
 
 bool EditGearTagsModel::addNewTag(int tagId, int orderBy)
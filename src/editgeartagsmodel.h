@@ -20,14 +20,21 @@
 #ifndef EDITGEARTAGSMODEL_H
 #define EDITGEARTAGSMODEL_H
 
-#include <QSqlQueryModel>
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QVariant>
 
-class EditGearTagsModel : public QSqlQueryModel
+class EditGearTagsModel : public QAbstractTableModel
 {
     Q_OBJECT
 
 public:
-    EditGearTagsModel(QObject *parent) : QSqlQueryModel(parent), gearId(-1) { }
+    EditGearTagsModel(QObject *parent) : QAbstractTableModel(parent), gearId(-1) { }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : rows.count();
+    }
 
     QVariant data(const QModelIndex &index, int role) const;
     Qt::ItemFlags flags(const QModelIndex &index) const;
@@ -52,7 +59,10 @@ public:
 
     virtual void clear()
     {
-        QSqlQueryModel::clear();
+        beginResetModel();
+        rows.clear();
+        endResetModel();
+
         emit cleared();
     }
 
@@ -63,6 +73,27 @@ Q_SIGNALS:
     void cleared();
 
 private:
+    // gear property as loaded from the database
+    struct PropertyRow
+    {
+        QString tagText;
+        QString tagValue;
+        int     tagType;
+        QString printFormat;
+        int     propertyId;
+        int     flags;
+        QString altValue;
+
+        // value parsed from tagValue/altValue
+        QVariant itemValue;
+    };
+
+    // parse stored value(s) of the row
+    static QVariant parseValue(const PropertyRow& row);
+
+    // properties of the current gear, in display order
+    QVector<PropertyRow> rows;
+
     int gearId;
 };
 
@@ -236,9 +236,18 @@ bool EditGearTreeModel::dropMimeData(const QMimeData *data, Qt::DropAction actio
     return true;
 }
 
+QString EditGearTreeModel::subtreeQuery(int rootId)
+{
+    // UNION drops ids already visited, so a cycle in a damaged library ends the recursion
+    return QString("WITH RECURSIVE Subtree(id) AS (SELECT %1 UNION "
+                   "SELECT a.id FROM UserGearItems a, Subtree s WHERE a.ParentId = s.id) ").arg(rootId);
+}
+
 int EditGearTreeModel::createNewGear(int copyId, int parentId, int gearType, QString prefix, int orderBy)
 {
-    QSqlQuery query, subquery;
+    QSqlQuery query;
+
+    prefix.replace("'", "''");
 
     // start inner transaction
     query.exec("SAVEPOINT InsertGear");
@@ -247,108 +256,105 @@ int EditGearTreeModel::createNewGear(int copyId, int parentId, int gearType, QSt
     {
         // insert new row
         query.exec(QString("INSERT INTO UserGearItems(ParentId, GearType, GearName, OrderBy) VALUES(%1, %2, '%3', %4)").arg(parentId).arg(gearType).arg(prefix).arg(orderBy));
-    }
-    else
-    {
-        // copy from existing one
-        if(orderBy == -1)
-            query.exec(QString("INSERT INTO UserGearItems(ParentId, GearType, GearName, OrderBy) SELECT %1, GearType, '%2' || GearName, OrderBy FROM UserGearItems WHERE id = %3").arg(parentId).arg(prefix).arg(copyId));
-        else
-            query.exec(QString("INSERT INTO UserGearItems(ParentId, GearType, GearName, OrderBy) SELECT %1, GearType, '%2' || GearName, %3 FROM UserGearItems WHERE id = %4").arg(parentId).arg(prefix).arg(orderBy).arg(copyId));
-    }
-
-    // check validity
-    if(!query.lastInsertId().isValid())
-    {
-        query.exec("ROLLBACK TO InsertGear");
-        return -1;
-    }
 
-    if(query.lastError().isValid())
-    {
-        query.exec("ROLLBACK TO InsertGear");
-        return -1;
-    }
+        // check validity
+        if(query.lastError().isValid() || !query.lastInsertId().isValid())
+        {
+            query.exec("ROLLBACK TO InsertGear");
+            query.exec("RELEASE InsertGear");
+            return -1;
+        }
 
-    int newId = query.lastInsertId().toInt();
+        int newId = query.lastInsertId().toInt();
 
-    // set properties
-    if(copyId == -1)
-    {
         // insert properties from template
         query.exec(QString("INSERT INTO UserGearProperties(GearId, TagId, OrderBy) SELECT %1, TagId, OrderBy FROM GearTemplate WHERE GearType = %2").arg(newId).arg(gearType));
 
         if(query.lastError().isValid())
         {
             query.exec("ROLLBACK TO InsertGear");
+            query.exec("RELEASE InsertGear");
             return -1;
         }
+
+        // "commit" inner transaction
+        query.exec("RELEASE InsertGear");
+
+        return newId;
     }
-    else
-    {
-        // copy properties
-        query.exec(QString("INSERT INTO UserGearProperties(GearId, TagId, TagValue, OrderBy) SELECT %1, TagId, TagValue, OrderBy FROM UserGearProperties WHERE GearId = %2").arg(newId).arg(copyId));
 
-        if(query.lastError().isValid())
+    // copy the whole subtree at once: map old ids to the new ones first
+    QStringList statements;
+
+    statements << "CREATE TEMP TABLE IF NOT EXISTS GearCopy(OldId INTEGER PRIMARY KEY, NewId INTEGER)"
+               << "DELETE FROM GearCopy"
+               << subtreeQuery(copyId) + "INSERT INTO GearCopy(OldId) SELECT id FROM Subtree"
+               // new ids follow the last one AUTOINCREMENT handed out, ids of deleted gear are never reused
+               << "UPDATE GearCopy SET NewId = max((SELECT ifnull(max(id), 0) FROM UserGearItems), "
+                  "(SELECT ifnull(max(seq), 0) FROM sqlite_sequence WHERE name = 'UserGearItems')) "
+                  "+ (SELECT COUNT(*) FROM GearCopy c WHERE c.OldId <= GearCopy.OldId)"
+               // copied root gets the new parent, name prefix and order, children are re-parented to the copies
+               // (prefix goes in last, a % in it is not taken for a placeholder)
+               << QString("INSERT INTO UserGearItems(id, ParentId, GearType, GearName, OrderBy) "
+                          "SELECT c.NewId, CASE WHEN c.OldId = %3 THEN %1 ELSE p.NewId END, a.GearType, "
+                          "CASE WHEN c.OldId = %3 THEN '%4' || a.GearName ELSE a.GearName END, "
+                          "CASE WHEN c.OldId = %3 AND %2 <> -1 THEN %2 ELSE a.OrderBy END "
+                          "FROM UserGearItems a JOIN GearCopy c ON c.OldId = a.id LEFT JOIN GearCopy p ON p.OldId = a.ParentId").arg(parentId).arg(orderBy).arg(copyId).arg(prefix)
+               << "INSERT INTO UserGearProperties(GearId, TagId, TagValue, AltValue, OrderBy) "
+                  "SELECT c.NewId, b.TagId, b.TagValue, b.AltValue, b.OrderBy FROM UserGearProperties b, GearCopy c WHERE b.GearId = c.OldId ORDER BY b.GearId, b.id";
+
+    foreach(QString statement, statements)
+    {
+        if(!query.exec(statement))
         {
             query.exec("ROLLBACK TO InsertGear");
+            query.exec("RELEASE InsertGear");
             return -1;
         }
+    }
 
-        // copy children
-        if(gearType == 0)
-        {
-            subquery.exec(QString("SELECT id, GearType FROM UserGearItems WHERE ParentId = %1 ORDER BY OrderBy").arg(copyId));
-            while(subquery.next())
-            {
-                if(createNewGear(subquery.value(0).toInt(), newId, subquery.value(1).toInt(), "", -1) == -1)
-                {
-                    query.exec("ROLLBACK TO InsertGear");
-                    return -1;
-                }
-            }
-        }
+    query.exec(QString("SELECT NewId FROM GearCopy WHERE OldId = %1").arg(copyId));
+    query.first();
+
+    if(!query.isValid())
+    {
+        query.exec("ROLLBACK TO InsertGear");
+        query.exec("RELEASE InsertGear");
+        return -1;
     }
 
+    int newId = query.value(0).toInt();
+
     // "commit" inner transaction
     query.exec("RELEASE InsertGear");
 
     return newId;
 }
 
-bool EditGearTreeModel::deleteGear(int gearId, int gearType)
+bool EditGearTreeModel::deleteGear(int gearId, int)
 {
     QSqlQuery query;
 
     // start inner transaction
     query.exec("SAVEPOINT DeleteGear");
 
-    // delete children
-    if(gearType == 0)
-    {
-        query.exec(QString("SELECT id, GearType FROM UserGearItems WHERE ParentId = %1 ORDER BY OrderBy").arg(gearId));
-
-        while(query.next())
-        {
-            deleteGear(query.value(0).toInt(), query.value(1).toInt());
-        }
-    }
-
-    // delete properties
-    query.exec(QString("DELETE FROM UserGearProperties WHERE GearId = %1").arg(gearId));
+    // delete properties of the gear and all its children
+    query.exec(subtreeQuery(gearId) + "DELETE FROM UserGearProperties WHERE GearId IN (SELECT id FROM Subtree)");
 
     if(query.lastError().isValid())
     {
         query.exec("ROLLBACK TO DeleteGear");
+        query.exec("RELEASE DeleteGear");
         return false;
     }
 
     // delete gear
-    query.exec(QString("DELETE FROM UserGearItems WHERE id = %1").arg(gearId));
+    query.exec(subtreeQuery(gearId) + "DELETE FROM UserGearItems WHERE id IN (SELECT id FROM Subtree)");
 
     if(query.lastError().isValid())
     {
         query.exec("ROLLBACK TO DeleteGear");
+        query.exec("RELEASE DeleteGear");
         return false;
     }
 
@@ -59,6 +59,9 @@ public:
     bool deleteGear(int gearId, int gearType);
 
 private:
+    // recursive CTE selecting the ids of the gear and all its children
+    static QString subtreeQuery(int rootId);
+
     int gearType;
     bool treeView;
     QString emptyMessage;
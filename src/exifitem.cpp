@@ -22,6 +22,7 @@
 #include <QDateTime>
 
 #include "exifutils.h"
+#include "choicelist.h"
 #include <cmath>
 
 // insert child
@@ -58,7 +59,7 @@ void ExifItem::reset()
     dirty = false;
     if(metaTag != "")
     {
-        metaValue = QVariant();
+        metaValue = ExifValue();
     }
     if(childCount() > 0)
     {
@@ -205,7 +206,7 @@ QString ExifItem::typeName(TagType type)
 
 QString ExifItem::getValueAsString(bool convertReal)
 {
-    return valueToString(metaValue, type, QVariant(), convertReal);
+    return valueToString(metaValue.toVariant(), type, QVariant(), convertReal);
 }
 
 QString ExifItem::flagName(TagFlag flag)
@@ -544,16 +545,12 @@ QList<QVariantList> ExifItem::parseEncodedChoiceList(QString list, TagType dataT
 {
     QList<QVariantList> res;
 
-    QStringList items = list.split(";;", QString::SkipEmptyParts);
+    QSharedPointer<const ChoiceList> choices = ChoiceList::get(list, dataType, flags);
 
-    foreach(QString itemPair, items)
+    for(int i = 0; i < choices->count(); i++)
     {
-        QStringList values = itemPair.split("||", QString::SkipEmptyParts);
-        if(values.count() != 2)
-            return QList<QVariantList>();
-
         QVariantList varList;
-        varList << values.at(0) << valueFromString(values.at(1), dataType, true, flags);
+        varList << choices->text(i) << choices->value(i);
 
         res << varList;
     }
@@ -563,17 +560,5 @@ QList<QVariantList> ExifItem::parseEncodedChoiceList(QString list, TagType dataT
 
 QString ExifItem::findChoiceTextByValue(QString list, QVariant value, TagType dataType, TagFlags flags)
 {
-    QStringList items = list.split(";;", QString::SkipEmptyParts);
-
-    foreach(QString itemPair, items)
-    {
-        QStringList values = itemPair.split("||", QString::SkipEmptyParts);
-        if(values.count() != 2)
-            return QString();
-
-        if(valueFromString(values.at(1), dataType, true, flags) == value)
-            return values.at(0);
-    }
-
-    return QString();
+    return ChoiceList::get(list, dataType, flags)->textOf(value);
 }
@@ -24,6 +24,13 @@
 #include <QVariant>
 #include <QList>
 #include <QFlags>
+#include <QSharedPointer>
+
+// Local includes
+
+#include "exifvalue.h"
+
+class ChoiceList;
 
 class ExifItem
 {
@@ -67,7 +74,7 @@ public:
         metaTag = tag;
         metaAltTag = altTag;
         metaTagText = tagText;
-        metaValue = tagValue;
+        metaValue = ExifValue(tagValue);
         this->flags = flags;
         dirty = false;
         checked = true;
@@ -100,6 +107,7 @@ public:
         checked = item.checked;
         srcTagType = item.srcTagType;
         printFormat = item.printFormat;
+        choices = item.choices;
     }
 
     ~ExifItem(void)
@@ -157,6 +165,12 @@ public:
 
     // return either caption or tag value
     QVariant value() const
+    {
+        return metaValue.toVariant();
+    }
+
+    // stored value without conversion
+    const ExifValue& exifValue() const
     {
         return metaValue;
     }
@@ -167,6 +181,17 @@ public:
         return printFormat;
     }
 
+    // parsed choice list of a Choice tag, 0 if not set
+    const ChoiceList* choiceList() const
+    {
+        return choices.data();
+    }
+
+    void setChoiceList(const QSharedPointer<const ChoiceList>& choiceList)
+    {
+        choices = choiceList;
+    }
+
     // tag type
     TagType tagType() const
     {
@@ -175,6 +200,11 @@ public:
 
     // set caption or value
     void setValue(const QVariant& value, bool setDirty = false)
+    {
+        setValue(ExifValue(value), setDirty);
+    }
+
+    void setValue(const ExifValue& value, bool setDirty = false)
     {
         if(metaValue != value)
         {
@@ -276,9 +306,11 @@ private:
     // readable meta tag text
     QString metaTagText;
     // value - either tag value or caption
-    QVariant metaValue;
+    ExifValue metaValue;
     // print format in QString arg() style
     QString printFormat;
+    // choices parsed from the print format
+    QSharedPointer<const ChoiceList> choices;
     // tag type
     TagType type;
     // has changed data
@@ -24,6 +24,7 @@
 #include "multitagvaluesdialog.h"
 #include "asciistringdialog.h"
 #include "asciitextdialog.h"
+#include "choicelist.h"
 
 #include <QComboBox>
 #include <QLineEdit>
@@ -51,15 +52,12 @@ QWidget* ExifItemDelegate::createEditor(QWidget *parent, const QStyleOptionViewI
     {
         QComboBox* combo = new QComboBox(parent);
 
-        QList<QVariantList> values = ExifItem::parseEncodedChoiceList(index.data(ExifTreeModel::GetChoiceRole).toString(), typeRole, tagFlags);
+        QSharedPointer<const ChoiceList> choices = ChoiceList::get(index.data(ExifTreeModel::GetChoiceRole).toString(), typeRole, tagFlags);
 
-        if(values != QList<QVariantList>())
+        // set the combo box items
+        for(int i = 0; i < choices->count(); i++)
         {
-            // set the combo box items
-            foreach(QVariantList valuePair, values)
-            {
-                combo->addItem(valuePair.at(0).toString(), valuePair.at(1));
-            }
+            combo->addItem(choices->text(i), choices->value(i));
         }
 
         //combo->setFrame(false);
@@ -271,24 +269,12 @@ void ExifItemDelegate::setEditorData(QWidget *editor, const QModelIndex &index)
     {
         QComboBox* combo = static_cast<QComboBox*>(editor);
 
-        QList<QVariantList> values = ExifItem::parseEncodedChoiceList(index.data(ExifTreeModel::GetChoiceRole).toString(), typeRole, tagFlags);
+        QSharedPointer<const ChoiceList> choices = ChoiceList::get(index.data(ExifTreeModel::GetChoiceRole).toString(), typeRole, tagFlags);
 
-        if(values != QList<QVariantList>())
+        if(choices->count() > 0)
         {
-            int selIdx = 0;
-            QVariant curValue = index.data(Qt::EditRole);
-
-            // set the combo box items
-            foreach(QVariantList valuePair, values)
-            {
-                if(curValue == valuePair.at(1))
-                    break;
-
-                selIdx++;               
-            }
-
-            // set current index
-            combo->setCurrentIndex(selIdx);
+            // set current index, none if the value is not in the list
+            combo->setCurrentIndex(choices->indexOf(index.data(Qt::EditRole)));
         }
 
         return;
@@ -19,6 +19,7 @@
 
 #include "exiftreemodel.h"
 #include "exifutils.h"
+#include "choicelist.h"
 
 #include <QSqlQuery>
 #include <QStringList>
@@ -32,6 +33,7 @@
 #include <QFile>
 #include <QTextStream>
 #include <QImageReader>
+#include <QMutexLocker>
 
 #include <cmath>
 
@@ -64,24 +66,29 @@ ExifTreeModel::ExifTreeModel(QObject* const parent)
     populateModel();
     editable = false;
 
-    fillNotSupportedTags();
-    
-    ThumbnailLoadThread* const thread = new ThumbnailLoadThread;
-    thread->setThumbnailSize(256);
-    thread->setPixmapRequested(false);
-    m_catcher                         = new ThumbnailImageCatcher(thread, this);
+    // not supported tags list and thumbnail loader are set up on first use
+    m_catcher = nullptr;
 
+    etagsTemplateValid = false;
+    etagsStorage = 0;
 }
 
 ExifTreeModel::~ExifTreeModel()
 {
     delete rootItem;
-    
-    m_catcher->thread()->stopAllTasks();
-    m_catcher->cancel();
 
-    delete m_catcher->thread();
-    delete m_catcher; 
+    // wait for a preview request still running on a pool thread
+    QMutexLocker locker(&m_catcherMutex);
+
+    if(m_catcher)
+    {
+        m_catcher->thread()->stopAllTasks();
+        m_catcher->cancel();
+
+        delete m_catcher->thread();
+        delete m_catcher;
+        m_catcher = nullptr;
+    }
 }
 
 // clear data
@@ -252,6 +259,11 @@ QModelIndex ExifTreeModel::parent(const QModelIndex &index) const
 }
 
 QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& itemFormat, ExifItem::TagFlags tagFlags, ExifItem::TagType itemType, int role)
+{
+    return getItemValue(ExifValue(itemValue), itemFormat, tagFlags, itemType, role);
+}
+
+QVariant ExifTreeModel::getItemValue(const ExifValue& itemValue, const QString& itemFormat, ExifItem::TagFlags tagFlags, ExifItem::TagType itemType, int role)
 {
     // return value according to the tag type
     switch(itemType)
@@ -286,7 +298,7 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
             }
         }
         else if(role == Qt::EditRole)
-            return itemValue;
+            return itemValue.toVariant();
         break;
     case ExifItem::TagInteger:
     case ExifItem::TagUInteger:
@@ -294,7 +306,7 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
         if(role == Qt::DisplayRole)
             return QString(itemFormat).arg(itemValue.toInt());
         else if(role == Qt::EditRole)
-            return itemValue;
+            return itemValue.toVariant();
         break;
     case ExifItem::TagRational:
     case ExifItem::TagURational:
@@ -321,8 +333,18 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
     case ExifItem::TagFraction:
     case ExifItem::TagShutter:
         {
-            QVariantList rational = itemValue.toList();
-            double value = (double)rational.at(0).toInt() / (double)rational.at(1).toInt();
+            int first = itemValue.numerator();
+            int second = itemValue.denominator();
+
+            // stored as a rational unless set from an unusual source
+            if(itemValue.kind() != ExifValue::Rational)
+            {
+                QVector<ExifValue> rational = itemValue.toList();
+                first = rational.at(0).toInt();
+                second = rational.at(1).toInt();
+            }
+
+            double value = (double)first / (double)second;
 
             if(role == Qt::DisplayRole)
             {
@@ -336,9 +358,6 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
                     if((itemType == ExifItem::TagFraction) &&(value > 0))
                         signChar = '+';
 
-                    int first = rational.at(0).toInt();
-                    int second = rational.at(1).toInt();
-
                     if(abs(first) > abs(second))
                     {
                         int val = first / abs(second);
@@ -350,7 +369,7 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
                 }
             }
             else if(role == Qt::EditRole)
-                return rational;
+                return itemValue.toVariant();
 
             break;
         }
@@ -367,10 +386,10 @@ QVariant ExifTreeModel::getItemValue(const QVariant& itemValue, const QString& i
     }
 
     // just return item value
-    return itemValue;
+    return itemValue.toVariant();
 }
 
-QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role)
+QVariant ExifTreeModel::getItemData(const ExifValue& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role, const ChoiceList* choices)
 {
     // return tag type
     if(role == GetTypeRole)
@@ -387,13 +406,16 @@ QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& it
     if((role != Qt::EditRole) && (role != Qt::DisplayRole))
         return QVariant();
 
-    if(itemValue == QVariant())
+    if(itemValue.isNull())
         return QVariant();
 
     if(itemFlags.testFlag(ExifItem::Choice) && (role == Qt::DisplayRole))
     {
-        // special care for choice tags
-        return ExifItem::findChoiceTextByValue(itemFormat, itemValue, itemType, itemFlags);
+        // special care for choice tags, parsed with the template
+        if(choices)
+            return choices->textOf(itemValue);
+
+        return ExifItem::findChoiceTextByValue(itemFormat, itemValue.toVariant(), itemType, itemFlags);
     }
 
     if(!itemFlags.testFlag(ExifItem::Choice) && itemFlags.testFlag(ExifItem::Multi))
@@ -402,7 +424,7 @@ QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& it
         {
             // for edit - process the whole list before giving up to editor (required for e.g. APEX adjustments)
             QVariantList processedList;
-            foreach(QVariant value, itemValue.toList())
+            foreach(const ExifValue& value, itemValue.toList())
             {
                 processedList << getItemValue(value, itemFormat, itemFlags, itemType, role);
             }
@@ -412,7 +434,7 @@ QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& it
         else if(role == Qt::DisplayRole)
         {
             QString result;
-            foreach(QVariant value, itemValue.toList())
+            foreach(const ExifValue& value, itemValue.toList())
             {
                 result += getItemValue(value, itemFormat, itemFlags, itemType, role).toString() + "; ";
             }
@@ -425,6 +447,11 @@ QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& it
     return getItemValue(itemValue, itemFormat, itemFlags, itemType, role);
 }
 
+QVariant ExifTreeModel::getItemData(const QVariant& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role)
+{
+    return getItemData(ExifValue(itemValue), itemFormat, itemFlags, itemType, role);
+}
+
 // return item data
 QVariant ExifTreeModel::data(const QModelIndex &index, int role) const
 {
@@ -458,7 +485,7 @@ QVariant ExifTreeModel::data(const QModelIndex &index, int role) const
     if((index.column() == 0)  && (role == Qt::DisplayRole))
         return item->tagText();
 
-    return getItemData(item->value(), item->format(), item->tagFlags(), (ExifItem::TagType)item->tagType(), role);
+    return getItemData(item->exifValue(), item->format(), item->tagFlags(), (ExifItem::TagType)item->tagType(), role, item->choiceList());
 }
 
 QVariant ExifTreeModel::processItemData(const ExifItem *item, const QVariant& value, bool& ok)
@@ -490,10 +517,15 @@ QVariant ExifTreeModel::processItemData(const ExifItem *item, const QVariant& va
                 val = 2*log(val)/log(2.0);
             }
 
-            if(!item->tagFlags().testFlag(ExifItem::Multi) && (item->value() != QVariant()))
+            if(!item->tagFlags().testFlag(ExifItem::Multi) && (!item->exifValue().isNull()))
             {
                 // special check whether value is changed for rational numbers
-                double oldvalue = item->value().toDouble();
+                const ExifValue& oldExifValue = item->exifValue();
+                double oldvalue = oldExifValue.toDouble();
+
+                // compared by its value, QVariant conversion gives 0 for it
+                if((oldExifValue.kind() == ExifValue::Rational) && (oldExifValue.denominator() != 0))
+                    oldvalue = (double)oldExifValue.numerator() / oldExifValue.denominator();
 
                 if((int)(oldvalue*100) == (int)(val*100))
                 {
@@ -524,7 +556,7 @@ bool ExifTreeModel::setData(const QModelIndex &index, const QVariant &value, int
     ExifItem *item = getItem(index);
 
     // don't change the same values
-    if(item->value() == value)
+    if(item->exifValue() == ExifValue(value))
         return false;
 
     if(value == QVariant())
@@ -568,6 +600,11 @@ bool ExifTreeModel::setData(const QModelIndex &index, const QVariant &value, int
 // populate model
 void ExifTreeModel::populateModel()
 {
+    // template items are about to change
+    etagsTemplateValid = false;
+    etagsTemplate.clear();
+    ChoiceList::clearCache();
+
     // connect to internal database
     QSqlQuery query("SELECT a.GearType, b.TagName, b.TagText, b.PrintFormat, b.TagType, b.Flags, b.AltTag FROM GearTemplate a, MetaTags b WHERE b.id=a.TagId ORDER BY a.GearType, a.OrderBy");
 
@@ -611,8 +648,12 @@ void ExifTreeModel::populateModel()
         }
 
         // insert a tag
-        headerItem->insertChild(query.value(1).toString(), query.value(2).toString(), QVariant(), query.value(3).toString(), (ExifItem::TagType)query.value(4).toInt(), (ExifItem::TagFlags)query.value(5).toInt(), query.value(6).toString());
+        ExifItem* tagItem = headerItem->insertChild(query.value(1).toString(), query.value(2).toString(), QVariant(), query.value(3).toString(), (ExifItem::TagType)query.value(4).toInt(), (ExifItem::TagFlags)query.value(5).toInt(), query.value(6).toString());
         nRows++;
+
+        // parse choice lists once, display and etags use them from the item
+        if(tagItem->tagFlags().testFlag(ExifItem::Choice))
+            tagItem->setChoiceList(ChoiceList::get(tagItem->format(), tagItem->tagType(), tagItem->tagFlags()));
     }
     beginInsertRows(QModelIndex(), 0, nRows);
     endInsertRows();
@@ -820,14 +861,78 @@ QVariant ExifTreeModel::getTagValueFromExif(ExifItem::TagType tagType, const Exi
     return QVariant();
 }
 
+QString ExifTreeModel::stripEtags(const QString& commentValue, int offset)
+{
+    int etagsStartIndex;
+
+    // the stored offset saves the search, as long as the marker is still there
+    if((offset >= 0) && commentValue.midRef(offset).startsWith(QLatin1String(ETAGS_START_MARKER_IN_COMMENTS)))
+        etagsStartIndex = offset;
+    else
+        etagsStartIndex = commentValue.indexOf(QLatin1String(ETAGS_START_MARKER_IN_COMMENTS));
+
+    if(etagsStartIndex == -1)
+        return commentValue;
+
+    int delimeterLen = QString(ETAGS_DELIMETER_IN_COMMENTS).length();
+    if(commentValue.indexOf(ETAGS_DELIMETER_IN_COMMENTS, etagsStartIndex - delimeterLen) == (etagsStartIndex - delimeterLen))
+        etagsStartIndex -= delimeterLen;
+
+    return commentValue.left(etagsStartIndex);
+}
+
+int ExifTreeModel::etagsOffset(Exiv2::XmpData& xmpData, int field)
+{
+    Exiv2::XmpData::const_iterator pos = xmpData.findKey(Exiv2::XmpKey("Xmp.AnalogExif.ExtraTagsOffset"));
+
+    if(pos == xmpData.end())
+        return -1;
+
+    // "<UserComment offset>,<XPComment offset>"
+    bool ok = false;
+    int offset = QString::fromStdString(pos->toString()).section(',', field, field).toInt(&ok);
+
+    return (ok ? offset : -1);
+}
+
+QMap<QString, QString> ExifTreeModel::readExtraTags(const Exiv2::XmpData& xmpData)
+{
+    QMap<QString, QString> etags;
+
+    Exiv2::XmpData::const_iterator pos = xmpData.findKey(Exiv2::XmpKey("Xmp.AnalogExif.ExtraTags"));
+
+    if(pos == xmpData.end())
+        return etags;
+
+    for(int i = 0; i < pos->count(); i++)
+    {
+        std::string str = pos->toString(i);
+        QString etag = QString::fromUtf8(str.data(), str.length());
+
+        int separator = etag.indexOf('=');
+
+        if(separator > 0)
+            etags.insert(etag.left(separator), etag.mid(separator + 1));
+    }
+
+    return etags;
+}
+
+QStringList ExifTreeModel::splitTagNames(QString tagNames)
+{
+    return tagNames.remove(QChar(' ')).split(",", QString::SkipEmptyParts);
+}
+
 QVariant ExifTreeModel::readTagValue(QString tagNames, int& srcTagType, ExifItem::TagType type, ExifItem::TagFlags tagFlags, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
 {
-    // get list of tags
-    QStringList tags = tagNames.remove(QChar(' ')).split(",", QString::SkipEmptyParts);
+    return readTagValue(splitTagNames(tagNames), srcTagType, type, tagFlags, exifData, iptcData, xmpData);
+}
 
-    foreach(QString tagName, tags)
+QVariant ExifTreeModel::readTagValue(const QStringList& tags, int& srcTagType, ExifItem::TagType type, ExifItem::TagFlags tagFlags, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
+{
+    foreach(const QString& tagName, tags)
     {
-        QString tagType = tagName.split(".").at(0);
+        QStringRef tagType = tagName.leftRef(tagName.indexOf('.'));
         if(tagType == "Exif")
         {
             // Exif data
@@ -855,16 +960,7 @@ QVariant ExifTreeModel::readTagValue(QString tagNames, int& srcTagType, ExifItem
                 QString commentValue = ExifUtfToQString(tagValue, true);
 
                 // strip tags values
-                int etagsStartIndex = commentValue.indexOf(ETAGS_START_MARKER_IN_COMMENTS);
-
-                if(etagsStartIndex != -1)
-                {
-                    int delimeterLen = QString(ETAGS_DELIMETER_IN_COMMENTS).length();
-                    if(commentValue.indexOf(ETAGS_DELIMETER_IN_COMMENTS, etagsStartIndex - delimeterLen) == (etagsStartIndex - delimeterLen))
-                        etagsStartIndex -= delimeterLen;
-
-                    commentValue = commentValue.left(etagsStartIndex);
-                }
+                commentValue = stripEtags(commentValue, etagsOffset(xmpData, 0));
 
                 return commentValue.replace(" \n", "\n");
             }
@@ -874,16 +970,7 @@ QVariant ExifTreeModel::readTagValue(QString tagNames, int& srcTagType, ExifItem
                 QString commentValue = ExifUtfToQString(tagValue);
 
                 // strip tags values
-                int etagsStartIndex = commentValue.indexOf(ETAGS_START_MARKER_IN_COMMENTS);
-
-                if(etagsStartIndex != -1)
-                {
-                    int delimeterLen = QString(ETAGS_DELIMETER_IN_COMMENTS).length();
-                    if(commentValue.indexOf(ETAGS_DELIMETER_IN_COMMENTS, etagsStartIndex - delimeterLen) == (etagsStartIndex - delimeterLen))
-                        etagsStartIndex -= delimeterLen;
-
-                    commentValue = commentValue.left(etagsStartIndex);
-                }
+                commentValue = stripEtags(commentValue, etagsOffset(xmpData, 1));
 
                 return commentValue.replace(" \n", "\n");
             }
@@ -1051,14 +1138,35 @@ void ExifTreeModel::processTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::
     int srcTagType;
 
     // get tag value
-    QVariant tagValue = readTagValue(tag->tagName(), srcTagType, tag->tagType(), tag->tagFlags(), exifData, iptcData, xmpData);
+    QVariant tagValue = readItemValue(tag, splitTagNames(tag->tagName()), splitTagNames(tag->tagAltName()), srcTagType, exifData, iptcData, xmpData);
     tag->setSrcTagType(srcTagType);
 
+    // check only existing values
+    if(tagValue != QVariant())
+    {
+        tag->setChecked(true);
+    }
+    else
+    {
+        tag->setChecked(false);
+    }
+
+    tag->setValue(tagValue);
+}
+
+QVariant ExifTreeModel::readItemValue(const ExifItem* tag, const QStringList& tagNames, const QStringList& altTagNames, int& srcTagType,
+                                      Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
+{
+    // get tag value
+    QVariant tagValue = readTagValue(tagNames, srcTagType, tag->tagType(), tag->tagFlags(), exifData, iptcData, xmpData);
+
     // get alt tag value
     if(tag->tagFlags().testFlag(ExifItem::AsciiAlt))
     {
+        int altSrcTagType;
+
         // get alt value
-        QVariant altTagValue = readTagValue(tag->tagAltName(), srcTagType, tag->tagType(), tag->tagFlags() & ~ExifItem::AsciiAlt, exifData, iptcData, xmpData);
+        QVariant altTagValue = readTagValue(altTagNames, altSrcTagType, tag->tagType(), tag->tagFlags() & ~ExifItem::AsciiAlt, exifData, iptcData, xmpData);
 
         // if alt value exists
         if(tagValue == QVariant())
@@ -1075,17 +1183,7 @@ void ExifTreeModel::processTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::
         }
     }
 
-    // check only existing values
-    if(tagValue != QVariant())
-    {
-        tag->setChecked(true);
-    }
-    else
-    {
-        tag->setChecked(false);
-    }
-
-    tag->setValue(tagValue);
+    return tagValue;
 }
 
 bool ExifTreeModel::readMetaValues(Exiv2::Image::AutoPtr& exivHandle)
@@ -1495,7 +1593,7 @@ bool ExifTreeModel::storeTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::Ip
         // for alt tags store value in different set of tags
         if(tag->tagFlags().testFlag(ExifItem::AsciiAlt))
         {
-            if(tag->value() == QVariant())
+            if(tag->exifValue().isNull())
             {
                 // erase both sets of values
                 writeTagValue(tag->tagName(), QVariant(), tag->tagType(), tag->tagFlags(), exifData, iptcData, xmpData);
@@ -1528,14 +1626,77 @@ bool ExifTreeModel::prepareMetadata()
     curXmpData.clear();
     curIptcData.clear();
 
+    // new batch starts
+    compileEtagsTemplate();
+
     return prepareMetadata(curExifData, curIptcData, curXmpData);
 }
 
-bool ExifTreeModel::prepareMetadata(Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
+void ExifTreeModel::compileEtagsTemplate()
 {
-    etagsString = "";
+    etagsTemplate.clear();
+    etagsStorage = settings.value("ExtraTagsStorage", 0x03).toInt();
 
-    int etagsStorageOptions = settings.value("ExtraTagsStorage", 0x03).toInt();
+    // browse through all categories, pick extra tags
+    for(int i = 0; i < rootItem->childCount(); i++)
+    {
+        ExifItem* category = rootItem->child(i);
+        for(int j = 0; j < category->childCount(); j++)
+        {
+            ExifItem* tag = category->child(j);
+
+            if(!tag->tagFlags().testFlag(ExifItem::Extra))
+                continue;
+
+            EtagsTemplateEntry entry;
+            entry.tag = tag;
+            entry.label = "\t" + tag->tagText() + ": ";
+            entry.tagNames = splitTagNames(tag->tagName());
+            entry.altTagNames = splitTagNames(tag->tagAltName());
+
+            etagsTemplate.append(entry);
+        }
+    }
+
+    etagsTemplateValid = true;
+}
+
+void ExifTreeModel::ensureEtagsTemplate()
+{
+    if(!etagsTemplateValid)
+        compileEtagsTemplate();
+}
+
+void ExifTreeModel::beginEtags()
+{
+    // keep the buffer of the previous file, the size is about the same
+    int capacity = etagsString.capacity();
+
+    etagsValues.clear();
+    etagsString.clear();
+    etagsString.reserve(qMax(capacity, etagsTemplate.count() * 48));
+}
+
+void ExifTreeModel::appendEtag(const EtagsTemplateEntry& entry, const QVariant& value)
+{
+    etagsString += entry.label;
+    etagsString += getItemData(ExifValue(value), entry.tag->format(), entry.tag->tagFlags(), entry.tag->tagType(), Qt::DisplayRole, entry.tag->choiceList()).toString();
+    etagsString += QLatin1String(". \n");
+
+    // structured copy, raw value without the alt tag
+    ExifItem::TagFlags flags = entry.tag->tagFlags();
+    QVariant rawValue = value;
+
+    if(flags.testFlag(ExifItem::AsciiAlt) && (value.type() == QVariant::List))
+        rawValue = value.toList().value(0);
+
+    etagsValues << entry.tagNames.value(0) + "=" + ExifItem::valueToStringMulti(rawValue, entry.tag->tagType(), flags & ~ExifItem::AsciiAlt, QVariant());
+}
+
+bool ExifTreeModel::prepareMetadata(Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
+{
+    ensureEtagsTemplate();
+    beginEtags();
 
     // browse through all categories and fill Exiv2 structures
     for(int i = 0; i < rootItem->childCount(); i++)
@@ -1558,11 +1719,16 @@ bool ExifTreeModel::prepareMetadata(Exiv2::ExifData& exifData, Exiv2::IptcData&
                     return false;
                 }
             }
-            // store extra tags in comments, if required
-            if((tag->value() != QVariant()) && (etagsStorageOptions != 0 ) && tag->tagFlags().testFlag(ExifItem::Extra))
-            {
-                etagsString += "\t" + tag->tagText() + ": " + getItemData(tag->value(), tag->format(), tag->tagFlags(), (ExifItem::TagType)tag->tagType()).toString() + ". \n";
-            }
+        }
+    }
+
+    // store extra tags in comments, if required
+    if(etagsStorage != 0)
+    {
+        foreach(const EtagsTemplateEntry& entry, etagsTemplate)
+        {
+            if(!entry.tag->exifValue().isNull())
+                appendEtag(entry, entry.tag->value());
         }
     }
 
@@ -1648,13 +1814,21 @@ QString ExifTreeModel::ExifUtfToQString(const Exiv2::Value& exifData, bool check
 }
 
 // store extra tags string in the given Exiv2 ExifData, can throw Exiv2 exceptions
-void ExifTreeModel::storeEtags(Exiv2::ExifData& exifData)
+void ExifTreeModel::storeEtags(Exiv2::ExifData& exifData, Exiv2::XmpData& xmpData)
 {
-    int etagsStorageOptions = settings.value("ExtraTagsStorage", 0x03).toInt();
+    ensureEtagsTemplate();
+
+    int etagsStorageOptions = etagsStorage;
+
+    // where the marker starts in the comments, -1 if not written
+    int userCommentOffset = -1;
+    int xpCommentOffset = -1;
 
     // store extra tags in comment fields
     if(etagsString != "")
     {
+        const QString etagsBlock = QString(ETAGS_START_MARKER_IN_COMMENTS) + etagsString;
+
         if(etagsStorageOptions & 0x01)
         {
             // store in Exif.Photo.UserComment
@@ -1677,7 +1851,8 @@ void ExifTreeModel::storeEtags(Exiv2::ExifData& exifData)
                     commentValue = commentValue.left(etagsStartIndex);
             }
 
-            commentValue += (QString(ETAGS_START_MARKER_IN_COMMENTS) + etagsString);
+            userCommentOffset = commentValue.length();
+            commentValue += etagsBlock;
 
             exifData["Exif.Photo.UserComment"] = *QStringToExifUtf(commentValue, true, false, Exiv2::comment);
         }
@@ -1703,10 +1878,39 @@ void ExifTreeModel::storeEtags(Exiv2::ExifData& exifData)
                     commentValue = commentValue.left(etagsStartIndex);
             }
 
-            commentValue += (QString(ETAGS_START_MARKER_IN_COMMENTS) + etagsString);
+            xpCommentOffset = commentValue.length();
+            commentValue += etagsBlock;
 
             exifData["Exif.Image.XPComment"] = *QStringToExifUtf(commentValue);
         }
+
+        // machine readable copy, "<tag name>=<value>" each
+        Exiv2::XmpKey etagsKey("Xmp.AnalogExif.ExtraTags");
+
+        Exiv2::XmpData::iterator pos = xmpData.findKey(etagsKey);
+        if(pos != xmpData.end())
+            xmpData.erase(pos);
+
+        Exiv2::Value::AutoPtr v = Exiv2::Value::create(Exiv2::xmpSeq);
+
+        foreach(const QString& etag, etagsValues)
+            v->read(etag.toUtf8().constData());
+
+        xmpData.add(etagsKey, v.get());
+
+        // lets readers strip the comments without searching for the marker
+        xmpData["Xmp.AnalogExif.ExtraTagsOffset"] = QString("%1,%2").arg(userCommentOffset).arg(xpCommentOffset).toStdString();
+    }
+    else
+    {
+        // no extra tags left, do not keep the stale copy
+        Exiv2::XmpData::iterator pos = xmpData.findKey(Exiv2::XmpKey("Xmp.AnalogExif.ExtraTags"));
+        if(pos != xmpData.end())
+            xmpData.erase(pos);
+
+        pos = xmpData.findKey(Exiv2::XmpKey("Xmp.AnalogExif.ExtraTagsOffset"));
+        if(pos != xmpData.end())
+            xmpData.erase(pos);
     }
 }
 
@@ -1729,7 +1933,7 @@ bool ExifTreeModel::saveFile(QString filename, bool overwrite)
         // replace image metadata
         if(overwrite)
         {
-            storeEtags(curExifData);
+            storeEtags(curExifData, curXmpData);
             image->setExifData(curExifData);
             image->setIptcData(curIptcData);
             image->setXmpData(curXmpData);
@@ -1772,7 +1976,7 @@ bool ExifTreeModel::saveFile(QString filename, bool overwrite)
                 imgXmpData[i->key()] = *i;
             }
 
-            storeEtags(imgExifData);
+            storeEtags(imgExifData, imgXmpData);
         }
 
         image->writeMetadata();
@@ -1790,6 +1994,22 @@ bool ExifTreeModel::saveFile(QString filename, bool overwrite)
 
 QImage ExifTreeModel::getPreview(const QString& filename) const
 {
+    QMutexLocker locker(&m_catcherMutex);
+
+    // spawning the loader thread is not for the startup
+    if(!m_catcher)
+    {
+        ThumbnailLoadThread* const thread = new ThumbnailLoadThread;
+        thread->setThumbnailSize(256);
+        thread->setPixmapRequested(false);
+        m_catcher                         = new ThumbnailImageCatcher(thread);
+
+        // may be called from a pool thread, keep both objects with the model
+        // so the destructor deletes them in their own thread
+        thread->moveToThread(this->thread());
+        m_catcher->moveToThread(this->thread());
+    }
+
     m_catcher->setActive(true);
 
     m_catcher->thread()->find(ThumbnailIdentifier(filename));
@@ -1806,6 +2026,64 @@ QImage ExifTreeModel::getPreview(const QString& filename) const
     return QImage();
 }
 
+const char* ExifTreeModel::previewSourceName(PreviewSource source)
+{
+    switch(source)
+    {
+    case PreviewEmbedded:
+        return "embedded preview";
+    case PreviewCache:
+        return "thumbnail cache";
+    case PreviewThumbnailer:
+        return "thumbnail loader";
+    case PreviewDecoded:
+        return "full image";
+    default:
+        return "none";
+    }
+}
+
+QByteArray ExifTreeModel::getEmbeddedPreview(int minSize) const
+{
+    if(exifHandle.get() == 0)
+        return QByteArray();
+
+    try
+    {
+        Exiv2::PreviewManager loader(*exifHandle);
+
+        // sorted from the smallest to the largest one
+        Exiv2::PreviewPropertiesList list = loader.getPreviewProperties();
+
+        if(list.empty())
+            return QByteArray();
+
+        Exiv2::PreviewPropertiesList::const_iterator best = list.end() - 1;
+
+        for(Exiv2::PreviewPropertiesList::const_iterator it = list.begin(); it != list.end(); ++it)
+        {
+            if((int)qMax(it->width_, it->height_) >= minSize)
+            {
+                best = it;
+                break;
+            }
+        }
+
+        // extraction only copies the stored stream, decoding is up to the caller
+        Exiv2::PreviewImage preview = loader.getPreviewImage(*best);
+
+        qDebug("AnalogExif: ExifTreeModel::getEmbeddedPreview() %dx%d %s, %d bytes", best->width_, best->height_, best->mimeType_.c_str(), (int)preview.size());
+
+        return QByteArray((const char*)preview.pData(), preview.size());
+    }
+    catch(Exiv2::AnyError& exc)
+    {
+        qDebug("AnalogExif: ExifTreeModel::getEmbeddedPreview() Exiv2 exception (%d) = %s", exc.code(), exc.what());
+    }
+
+    return QByteArray();
+}
+
 // clears dirty flag from all tags
 void ExifTreeModel::resetDirty()
 {
@@ -1820,19 +2098,28 @@ void ExifTreeModel::resetDirty()
     }
 }
 
-static QStringList notSupportedTags;
+const QStringList& ExifTreeModel::notSupportedTags()
+{
+    // read once, on first use (thread safe since C++11)
+    static const QStringList tags = readNotSupportedTags();
 
-void ExifTreeModel::fillNotSupportedTags()
+    return tags;
+}
+
+QStringList ExifTreeModel::readNotSupportedTags()
 {
+    QStringList tags;
     QFile file(":/not-supported.txt");
 
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return;
+        return tags;
 
     QTextStream in(&file);
     while (!in.atEnd()) {
-        notSupportedTags << in.readLine();
+        tags << in.readLine();
     }
+
+    return tags;
 }
 
 bool ExifTreeModel::tagSupported(const QString tagName)
@@ -1875,7 +2162,7 @@ bool ExifTreeModel::tagSupported(const QString tagName)
     // if no exception was thrown so far - tag exists
 
     // check in non-supported taglist
-    if(notSupportedTags.contains(tagName))
+    if(notSupportedTags().contains(tagName))
         return false;
 
     // verify AnalogExif namespace
@@ -1884,27 +2171,17 @@ bool ExifTreeModel::tagSupported(const QString tagName)
 
 void ExifTreeModel::prepareEtags()
 {
-    int etagsStorageOptions = settings.value("ExtraTagsStorage", 0x03).toInt();
+    ensureEtagsTemplate();
 
-    if(etagsStorageOptions)
+    if(etagsStorage)
     {
-        etagsString = "";
+        beginEtags();
 
-        // browse through all categories and fill Exiv2 structures
-        for(int i = 0; i < rootItem->childCount(); i++)
+        foreach(const EtagsTemplateEntry& entry, etagsTemplate)
         {
-            ExifItem* category = rootItem->child(i);
-            for(int j = 0; j < category->childCount(); j++)
-            {
-                ExifItem* tag = category->child(j);
-
-                // store extra tags in comments, if required
-                if((tag->value() != QVariant()) && tag->tagFlags().testFlag(ExifItem::Extra))
-                {
-                    // add extra tag value
-                    etagsString += "\t" + tag->tagText() + ": " + getItemData(tag->value(), tag->format(), tag->tagFlags(), tag->tagType()).toString() + ". \n";
-                }
-            }
+            // add extra tag value
+            if(!entry.tag->exifValue().isNull())
+                appendEtag(entry, entry.tag->value());
         }
     }
 }
@@ -1953,14 +2230,62 @@ void ExifTreeModel::eraseTag(QString tagNames, Exiv2::ExifData& exifData, Exiv2:
 
 bool ExifTreeModel::prepareEtagsAndErase(Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData)
 {
-    int etagsStorageOptions = settings.value("ExtraTagsStorage", 0x03).toInt();
+    ensureEtagsTemplate();
 
-    if(etagsStorageOptions)
+    if(etagsStorage)
     {
-        etagsString = "";
+        beginEtags();
+
+        try
+        {
+            // structured copy of the previous save, for the tags missing from the file
+            QMap<QString, QString> storedEtags = readExtraTags(xmpData);
+
+            foreach(const EtagsTemplateEntry& entry, etagsTemplate)
+            {
+                ExifItem* tag = entry.tag;
+                QVariant value = tag->value();
+
+                if(!tag->isDirty())
+                {
+                    if(tag->tagType() == ExifItem::TagGPS)
+                    {
+                        // GPS position is assembled from several tags
+                        ExifItem bkpTag = *tag;
+                        processTag(&bkpTag, exifData, iptcData, xmpData);
+                        value = bkpTag.value();
+                    }
+                    else
+                    {
+                        // try to get etag value from the file, the template item stays untouched
+                        int srcTagType;
+                        value = readItemValue(tag, entry.tagNames, entry.altTagNames, srcTagType, exifData, iptcData, xmpData);
+
+                        // the tag itself may have been stripped by another tool
+                        if((value == QVariant()) && storedEtags.contains(entry.tagNames.value(0)))
+                        {
+                            value = ExifItem::valueFromString(storedEtags.value(entry.tagNames.value(0)), tag->tagType(), true, tag->tagFlags() & ~ExifItem::AsciiAlt);
+
+                            // same shape as readItemValue(), the alt value is not kept
+                            if((value != QVariant()) && tag->tagFlags().testFlag(ExifItem::AsciiAlt))
+                                value = QVariantList() << value << QVariant();
+                        }
+                    }
+                }
+
+                // add extra tag value
+                if(value != QVariant())
+                    appendEtag(entry, value);
+            }
+        }
+        catch (Exiv2::Error& err)
+        {
+            qDebug("AnalogExif: ExifTreeModel::prepareEtags() Exiv2 exception (%d) = %s", err.code(), err.what());
+            return false;
+        }
     }
 
-    // browse through all categories and fill Exiv2 structures
+    // browse through all categories and erase changed tags
     for(int i = 0; i < rootItem->childCount(); i++)
     {
         ExifItem* category = rootItem->child(i);
@@ -1970,21 +2295,6 @@ bool ExifTreeModel::prepareEtagsAndErase(Exiv2::ExifData& exifData, Exiv2::IptcD
 
             try
             {
-                // store extra tags in comments, if required
-                if(etagsStorageOptions && tag->tagFlags().testFlag(ExifItem::Extra))
-                {
-                    ExifItem bkpTag = *tag;
-
-                    if(!tag->isDirty())
-                    {
-                        // try to get etag value from the file
-                        processTag(&bkpTag, exifData, iptcData, xmpData);
-                    }
-                    // add extra tag value
-                    if(bkpTag.value() != QVariant())
-                        etagsString += "\t" + bkpTag.tagText() + ": " + getItemData(bkpTag.value(), bkpTag.format(), bkpTag.tagFlags(), bkpTag.tagType()).toString() + ". \n";
-                }
-
                 if(tag->isDirty())
                 {
                     // erase tags
@@ -2036,7 +2346,7 @@ bool ExifTreeModel::setExposureNumber(QString filename, int exposure)
 
             Exiv2::ExifData& imgExifData = image->exifData();
 
-            storeEtags(imgExifData);
+            storeEtags(imgExifData, imgXmpData);
         }
 
         image->writeMetadata();
@@ -2106,7 +2416,7 @@ bool ExifTreeModel::mergeMetadata(QString filename, QVariantList metadata)
         // if store etags in comments - read meta values
         if(etagsStorageOptions)
         {
-            storeEtags(image->exifData());
+            storeEtags(image->exifData(), image->xmpData());
         }
 
         image->writeMetadata();
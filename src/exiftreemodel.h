@@ -27,6 +27,9 @@
 #include <QSettings>
 #include <QStringList>
 #include <QImage>
+#include <QMutex>
+#include <QVector>
+#include <QMap>
 
 // Exiv2 includes
 
@@ -57,6 +60,9 @@ public:
     bool openFile(QString filename);
     // fill the Exiv2 data structures with user data
     bool prepareMetadata();
+    // collect the extra tags and storage options once per batch,
+    // done by prepareMetadata() as well
+    void compileEtagsTemplate();
     // save current metatada set in to the specified file
     bool saveFile(QString filename, bool overwrite = false);
     // set exposure number on the given file
@@ -73,6 +79,8 @@ public:
     /// item model methods
     virtual QVariant data(const QModelIndex &index, int role) const;
     static QVariant getItemData(const QVariant& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role = Qt::DisplayRole);
+    // choices are parsed from itemFormat if not given
+    static QVariant getItemData(const ExifValue& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role = Qt::DisplayRole, const ChoiceList* choices = 0);
 
     virtual QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
     virtual QModelIndex parent(const QModelIndex &index) const;
@@ -113,6 +121,22 @@ public:
 
     QImage getPreview(const QString& filename) const;
 
+    // where the preview shown to the user came from
+    enum PreviewSource
+    {
+        PreviewNone,
+        PreviewEmbedded,
+        PreviewCache,
+        PreviewThumbnailer,
+        PreviewDecoded
+    };
+
+    static const char* previewSourceName(PreviewSource source);
+
+    // compressed data of the smallest embedded preview of the open file having
+    // at least minSize pixels on the longer side (or the largest one available)
+    QByteArray getEmbeddedPreview(int minSize) const;
+
     // Exif UTF-QString conversion
     static Exiv2::Value::AutoPtr QStringToExifUtf(QString qstr, bool addUnicodeMarker = false, bool isUtf8 = false, Exiv2::TypeId typeId = Exiv2::unsignedByte);
     static void QStringToExifUtf(Exiv2::Value& v, QString qstr, bool addUnicodeMarker = false, bool isUtf8 = false, Exiv2::TypeId typeId = Exiv2::unsignedByte);
@@ -139,18 +163,46 @@ protected:
 
     bool storeTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
     void processTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData,  Exiv2::XmpData& xmpData);
+    // value of the tag (and its alt tag) in the given Exiv2 containers
+    QVariant readItemValue(const ExifItem* tag, const QStringList& tagNames, const QStringList& altTagNames, int& srcTagType,
+                           Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
     void eraseTag(ExifItem* tag, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
     void eraseTag(QString tagNames, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
     void tagValueToMetadata(QVariant value, ExifItem::TagType tagType, Exiv2::Value& v);
 
-    // store extra tags values in the comments of the given Exiv2 ExifData, can throw Exiv2 exceptions
+    // store extra tags values in the comments of the given Exiv2 ExifData and
+    // their structured copy in XMP, can throw Exiv2 exceptions
     // etags string should be prepared by prepareMetadata()
-    void storeEtags(Exiv2::ExifData& exifData);
+    void storeEtags(Exiv2::ExifData& exifData, Exiv2::XmpData& xmpData);
+
+    // comment without the extra tags, offset of the marker if known or -1
+    static QString stripEtags(const QString& commentValue, int offset);
+    // extra tags stored in Xmp.AnalogExif.ExtraTags, tag name to value string
+    // as written by ExifItem::valueToStringMulti()
+    static QMap<QString, QString> readExtraTags(const Exiv2::XmpData& xmpData);
+    // stored marker offset of the comment, 0 - UserComment, 1 - XPComment
+    static int etagsOffset(Exiv2::XmpData& xmpData, int field);
 
     // prepares etags string
     void prepareEtags();
     bool prepareEtagsAndErase(Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
 
+    // extra tag of the compiled template
+    struct EtagsTemplateEntry
+    {
+        ExifItem* tag;
+        // "\t<tag text>: "
+        QString label;
+        QStringList tagNames;
+        QStringList altTagNames;
+    };
+
+    // compile template if not done for the batch yet
+    void ensureEtagsTemplate();
+    // start new etags string, sized after the previous one
+    void beginEtags();
+    void appendEtag(const EtagsTemplateEntry& entry, const QVariant& value);
+
     // extract GPS data from Exif or Xmp
     QString getGPSfromExif();
     QString getGPSfromXmp();
@@ -164,18 +216,30 @@ protected:
     // decode tag value from Exiv2 data
     QVariant getTagValueFromExif(ExifItem::TagType tagType, const Exiv2::Value& tagValue, int pos = 0) const;
     static QVariant getItemValue(const QVariant& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role);
+    static QVariant getItemValue(const ExifValue& itemValue, const QString& itemFormat, ExifItem::TagFlags itemFlags, ExifItem::TagType itemType, int role);
     QVariant processItemData(const ExifItem *item, const QVariant& value, bool& ok);
 
     QVariant readTagValue(QString tagNames, int& srcTagType, ExifItem::TagType tagType, ExifItem::TagFlags tagFlags, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
+    QVariant readTagValue(const QStringList& tags, int& srcTagType, ExifItem::TagType tagType, ExifItem::TagFlags tagFlags, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
+    // comma separated tag names to list
+    static QStringList splitTagNames(QString tagNames);
     void writeTagValue(QString tagNames, const QVariant& tagValue, ExifItem::TagType type, ExifItem::TagFlags tagFlags, Exiv2::ExifData& exifData, Exiv2::IptcData& iptcData, Exiv2::XmpData& xmpData);
     
-    void fillNotSupportedTags();
+    static const QStringList& notSupportedTags();
+    static QStringList readNotSupportedTags();
 
 protected:
     
     bool editable;
     // extra tags string
     QString etagsString;
+    // and its structured copy
+    QStringList etagsValues;
+
+    // extra tags of the template and the storage options, compiled per batch
+    QVector<EtagsTemplateEntry> etagsTemplate;
+    bool etagsTemplateValid;
+    int etagsStorage;
 
     Exiv2::Image::AutoPtr exifHandle;
 
@@ -187,7 +251,10 @@ protected:
 
     QSettings settings;
     
-    ThumbnailImageCatcher* m_catcher;
+    // created on first getPreview(), owned and deleted by the model
+    mutable ThumbnailImageCatcher* m_catcher;
+    // catcher serves one request at a time
+    mutable QMutex m_catcherMutex;
 };
 
 #endif // EXIFTREEMODEL_H
@@ -0,0 +1,496 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "exifvalue.h"
+
+// C++ includes
+
+#include <new>
+#include <cstring>
+
+ExifValue::ExifValue(const QVariant& value)
+    : m_kind(Null),
+      m_shortLength(-1),
+      m_type(QMetaType::UnknownType)
+{
+    // objects placed into the union must fit
+    static_assert(sizeof(QString) <= sizeof(Data), "QString does not fit ExifValue");
+    static_assert(sizeof(QDateTime) <= sizeof(Data), "QDateTime does not fit ExifValue");
+    static_assert(sizeof(QVector<ExifValue>) <= sizeof(Data), "QVector does not fit ExifValue");
+    static_assert(sizeof(QVariant) <= sizeof(Data), "QVariant does not fit ExifValue");
+
+    if(!value.isValid())
+        return;
+
+    int type = value.userType();
+    m_type = type;
+
+    switch(type)
+    {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Char:
+    case QMetaType::UChar:
+    case QMetaType::Bool:
+        m_kind = Integer;
+        m_data.integer = value.toLongLong();
+        break;
+
+    case QMetaType::ULongLong:
+        m_kind = Integer;
+        m_data.integer = (qint64)value.toULongLong();
+        break;
+
+    case QMetaType::Double:
+    case QMetaType::Float:
+        m_kind = Real;
+        m_data.real = value.toDouble();
+        break;
+
+    case QMetaType::QString:
+    {
+        QString str = value.toString();
+
+        m_kind = String;
+
+        if(str.size() <= shortStringCapacity)
+        {
+            m_shortLength = str.size();
+            memcpy(m_data.chars, str.utf16(), str.size() * sizeof(ushort));
+        }
+        else
+        {
+            new (m_data.storage) QString(str);
+        }
+        break;
+    }
+
+    case QMetaType::QDateTime:
+        m_kind = DateTime;
+        new (m_data.storage) QDateTime(value.toDateTime());
+        break;
+
+    case QMetaType::QVariantList:
+    {
+        QVariantList values = value.toList();
+
+        // the tag readers store rationals as two ints
+        if((values.count() == 2) &&
+           (values.at(0).userType() == QMetaType::Int) &&
+           (values.at(1).userType() == QMetaType::Int))
+        {
+            m_kind = Rational;
+            m_data.rational[0] = values.at(0).toInt();
+            m_data.rational[1] = values.at(1).toInt();
+        }
+        else
+        {
+            m_kind = List;
+            QVector<ExifValue>* items = new (m_data.storage) QVector<ExifValue>();
+            items->reserve(values.count());
+
+            foreach(const QVariant& item, values)
+            {
+                items->append(ExifValue(item));
+            }
+        }
+        break;
+    }
+
+    default:
+        m_kind = Other;
+        new (m_data.storage) QVariant(value);
+        break;
+    }
+}
+
+ExifValue::ExifValue(const ExifValue& other)
+    : m_kind(Null),
+      m_shortLength(-1),
+      m_type(QMetaType::UnknownType)
+{
+    copyFrom(other);
+}
+
+ExifValue::~ExifValue()
+{
+    clear();
+}
+
+ExifValue& ExifValue::operator=(const ExifValue& other)
+{
+    if(this != &other)
+    {
+        clear();
+        copyFrom(other);
+    }
+
+    return *this;
+}
+
+void ExifValue::clear()
+{
+    switch(m_kind)
+    {
+    case String:
+        if(m_shortLength < 0)
+            string().~QString();
+        break;
+    case DateTime:
+        dateTime().~QDateTime();
+        break;
+    case List:
+        list().~QVector<ExifValue>();
+        break;
+    case Other:
+        variant().~QVariant();
+        break;
+    default:
+        break;
+    }
+
+    m_kind = Null;
+    m_shortLength = -1;
+    m_type = QMetaType::UnknownType;
+}
+
+void ExifValue::copyFrom(const ExifValue& other)
+{
+    m_kind = other.m_kind;
+    m_shortLength = other.m_shortLength;
+    m_type = other.m_type;
+
+    switch(m_kind)
+    {
+    case String:
+        if(m_shortLength < 0)
+            new (m_data.storage) QString(other.string());
+        else
+            memcpy(m_data.chars, other.m_data.chars, m_shortLength * sizeof(ushort));
+        break;
+    case DateTime:
+        new (m_data.storage) QDateTime(other.dateTime());
+        break;
+    case List:
+        new (m_data.storage) QVector<ExifValue>(other.list());
+        break;
+    case Other:
+        new (m_data.storage) QVariant(other.variant());
+        break;
+    default:
+        // plain data
+        m_data = other.m_data;
+        break;
+    }
+}
+
+QString& ExifValue::string()
+{
+    return *reinterpret_cast<QString*>(m_data.storage);
+}
+
+const QString& ExifValue::string() const
+{
+    return *reinterpret_cast<const QString*>(m_data.storage);
+}
+
+QDateTime& ExifValue::dateTime()
+{
+    return *reinterpret_cast<QDateTime*>(m_data.storage);
+}
+
+const QDateTime& ExifValue::dateTime() const
+{
+    return *reinterpret_cast<const QDateTime*>(m_data.storage);
+}
+
+QVector<ExifValue>& ExifValue::list()
+{
+    return *reinterpret_cast<QVector<ExifValue>*>(m_data.storage);
+}
+
+const QVector<ExifValue>& ExifValue::list() const
+{
+    return *reinterpret_cast<const QVector<ExifValue>*>(m_data.storage);
+}
+
+QVariant& ExifValue::variant()
+{
+    return *reinterpret_cast<QVariant*>(m_data.storage);
+}
+
+const QVariant& ExifValue::variant() const
+{
+    return *reinterpret_cast<const QVariant*>(m_data.storage);
+}
+
+int ExifValue::count() const
+{
+    switch(m_kind)
+    {
+    case Null:
+        return 0;
+    case Rational:
+        return 2;
+    case List:
+        return list().count();
+    default:
+        return 1;
+    }
+}
+
+int ExifValue::toInt() const
+{
+    switch(m_kind)
+    {
+    case Integer:
+        return (int)m_data.integer;
+    case Null:
+    case Rational:
+    case DateTime:
+    case List:
+        return 0;
+    default:
+        return toVariant().toInt();
+    }
+}
+
+qint64 ExifValue::toLongLong() const
+{
+    switch(m_kind)
+    {
+    case Integer:
+        return m_data.integer;
+    case Null:
+    case Rational:
+    case DateTime:
+    case List:
+        return 0;
+    default:
+        return toVariant().toLongLong();
+    }
+}
+
+double ExifValue::toDouble() const
+{
+    switch(m_kind)
+    {
+    case Integer:
+        if(m_type == QMetaType::ULongLong)
+            return (double)(quint64)m_data.integer;
+        return (double)m_data.integer;
+    case Real:
+        return m_data.real;
+    case String:
+        return toString().toDouble();
+    case Other:
+        return variant().toDouble();
+    default:
+        return 0;
+    }
+}
+
+QString ExifValue::toString() const
+{
+    switch(m_kind)
+    {
+    case String:
+        if(m_shortLength < 0)
+            return string();
+        return QString::fromUtf16(m_data.chars, m_shortLength);
+    case Integer:
+        if(m_type == QMetaType::Bool)
+            return toVariant().toString();
+        if(m_type == QMetaType::ULongLong)
+            return QString::number((quint64)m_data.integer);
+        return QString::number(m_data.integer);
+    case Null:
+    case Rational:
+    case List:
+        return QString();
+    case Other:
+        return variant().toString();
+    default:
+        return toVariant().toString();
+    }
+}
+
+QStringList ExifValue::toStringList() const
+{
+    switch(m_kind)
+    {
+    case Null:
+        return QStringList();
+    case Other:
+        return variant().toStringList();
+    case List:
+    {
+        QStringList strings;
+
+        foreach(const ExifValue& item, list())
+        {
+            strings << item.toString();
+        }
+
+        return strings;
+    }
+    default:
+        return toVariant().toStringList();
+    }
+}
+
+QDateTime ExifValue::toDateTime() const
+{
+    if(m_kind == DateTime)
+        return dateTime();
+
+    if(m_kind == Null)
+        return QDateTime();
+
+    return toVariant().toDateTime();
+}
+
+QVector<ExifValue> ExifValue::toList() const
+{
+    switch(m_kind)
+    {
+    case List:
+        return list();
+    case Rational:
+    {
+        QVector<ExifValue> items;
+        items << ExifValue(QVariant(m_data.rational[0])) << ExifValue(QVariant(m_data.rational[1]));
+
+        return items;
+    }
+    case Other:
+    {
+        QVector<ExifValue> items;
+
+        foreach(const QVariant& item, variant().toList())
+        {
+            items << ExifValue(item);
+        }
+
+        return items;
+    }
+    default:
+        return QVector<ExifValue>();
+    }
+}
+
+QVariant ExifValue::toVariant() const
+{
+    switch(m_kind)
+    {
+    case Integer:
+    {
+        QVariant result;
+
+        if(m_type == QMetaType::ULongLong)
+            result = QVariant((qulonglong)m_data.integer);
+        else
+            result = QVariant((qlonglong)m_data.integer);
+
+        // restore int, uint etc.
+        if(m_type != (quint16)result.userType())
+            result.convert(m_type);
+
+        return result;
+    }
+    case Real:
+        if(m_type == QMetaType::Float)
+            return QVariant((float)m_data.real);
+        return QVariant(m_data.real);
+    case Rational:
+        return QVariantList() << m_data.rational[0] << m_data.rational[1];
+    case String:
+        return toString();
+    case DateTime:
+        return dateTime();
+    case List:
+    {
+        QVariantList values;
+        values.reserve(list().count());
+
+        foreach(const ExifValue& item, list())
+        {
+            values << item.toVariant();
+        }
+
+        return values;
+    }
+    case Other:
+        return variant();
+    default:
+        return QVariant();
+    }
+}
+
+bool ExifValue::stringEquals(const ExifValue& other) const
+{
+    if((m_shortLength >= 0) && (other.m_shortLength >= 0))
+    {
+        return (m_shortLength == other.m_shortLength) &&
+               (memcmp(m_data.chars, other.m_data.chars, m_shortLength * sizeof(ushort)) == 0);
+    }
+
+    // a long string never equals a short one
+    if((m_shortLength >= 0) != (other.m_shortLength >= 0))
+        return false;
+
+    return string() == other.string();
+}
+
+bool ExifValue::operator==(const ExifValue& other) const
+{
+    if(m_kind != other.m_kind)
+    {
+        if((m_kind == Null) || (other.m_kind == Null))
+            return false;
+
+        // mixed kinds follow QVariant conversions
+        return toVariant() == other.toVariant();
+    }
+
+    switch(m_kind)
+    {
+    case Null:
+        return true;
+    case Integer:
+        return m_data.integer == other.m_data.integer;
+    case Real:
+        return m_data.real == other.m_data.real;
+    case Rational:
+        return (m_data.rational[0] == other.m_data.rational[0]) &&
+               (m_data.rational[1] == other.m_data.rational[1]);
+    case String:
+        return stringEquals(other);
+    case DateTime:
+        return dateTime() == other.dateTime();
+    case List:
+        return list() == other.list();
+    default:
+        return variant() == other.variant();
+    }
+}
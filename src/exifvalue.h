@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EXIFVALUE_H
+#define EXIFVALUE_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QDateTime>
+#include <QVector>
+#include <QMetaType>
+
+// compact tag value of ExifItem
+//
+// numbers and rationals are kept inline, short strings in a small inline
+// buffer, multi-values in a shared vector; nothing is allocated for the
+// common tags and comparing two values needs no conversion
+//
+// QVariant is produced on demand at the model boundary, with the same
+// types the tag readers gave (rationals as a two-item QVariantList)
+class ExifValue
+{
+public:
+    enum Kind
+    {
+        Null,
+        Integer,
+        Real,
+        // numerator and denominator
+        Rational,
+        String,
+        DateTime,
+        List,
+        // anything else, kept as QVariant
+        Other
+    };
+
+    ExifValue()
+        : m_kind(Null),
+          m_shortLength(-1),
+          m_type(QMetaType::UnknownType)
+    {
+    }
+
+    explicit ExifValue(const QVariant& value);
+    ExifValue(const ExifValue& other);
+    ~ExifValue();
+
+    ExifValue& operator=(const ExifValue& other);
+
+    Kind kind() const
+    {
+        return (Kind)m_kind;
+    }
+
+    bool isNull() const
+    {
+        return (m_kind == Null);
+    }
+
+    // number of items of a list, 1 for a single value, 0 if null;
+    // a rational counts as its two items, it may as well be a two-value tag
+    int count() const;
+
+    // numerator and denominator of a Rational
+    qint32 numerator() const
+    {
+        return (m_kind == Rational) ? m_data.rational[0] : 0;
+    }
+
+    qint32 denominator() const
+    {
+        return (m_kind == Rational) ? m_data.rational[1] : 0;
+    }
+
+    // conversions give the same results as the QVariant the value stands
+    // for, e.g. 0 for a rational, which is a QVariantList there
+    int toInt() const;
+    qint64 toLongLong() const;
+    double toDouble() const;
+    QString toString() const;
+    QStringList toStringList() const;
+    QDateTime toDateTime() const;
+
+    // items of a list
+    QVector<ExifValue> toList() const;
+
+    // convert at the Qt boundary
+    QVariant toVariant() const;
+
+    // same result as comparing the QVariants
+    bool operator==(const ExifValue& other) const;
+
+    bool operator!=(const ExifValue& other) const
+    {
+        return !operator==(other);
+    }
+
+    // UTF-16 units kept inline
+    static const int shortStringCapacity = 11;
+
+private:
+    void clear();
+    void copyFrom(const ExifValue& other);
+
+    // objects constructed inside m_data
+    QString& string();
+    const QString& string() const;
+    QDateTime& dateTime();
+    const QDateTime& dateTime() const;
+    QVector<ExifValue>& list();
+    const QVector<ExifValue>& list() const;
+    QVariant& variant();
+    const QVariant& variant() const;
+
+    // short strings are compared without building a QString
+    bool stringEquals(const ExifValue& other) const;
+
+    union Data
+    {
+        qint64  integer;
+        double  real;
+        qint32  rational[2];
+        ushort  chars[shortStringCapacity];
+        // room for QString, QDateTime, QVector or QVariant, the largest one
+        void*   storage[(sizeof(QVariant) + sizeof(void*) - 1) / sizeof(void*)];
+    } m_data;
+
+    quint8  m_kind;
+    // length of an inline string, -1 if a QString is stored
+    qint8   m_shortLength;
+    // QMetaType of the original number, restored by toVariant()
+    quint16 m_type;
+};
+
+Q_DECLARE_TYPEINFO(ExifValue, Q_MOVABLE_TYPE);
+
+#endif // EXIFVALUE_H
@@ -0,0 +1,201 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fileiconprovider.h"
+
+// Qt includes
+
+#include <QPixmap>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+// digiKam includes
+
+#include "thumbnailidentifier.h"
+
+// Local includes
+
+#include "thumbnailcache.h"
+
+FileIconProvider::FileIconProvider(QObject* const parent)
+    : QObject(parent),
+      m_icons(maxCached)
+{
+    m_placeholder = QFileIconProvider::icon(QFileIconProvider::File);
+
+    m_thread = new ThumbnailLoadThread;
+    m_thread->setThumbnailSize(thumbnailSize);
+    m_thread->setPixmapRequested(true);
+
+    connect(m_thread, SIGNAL(signalThumbnailLoaded(LoadingDescription,QPixmap)),
+            this, SLOT(slotThumbnailLoaded(LoadingDescription,QPixmap)));
+}
+
+FileIconProvider::~FileIconProvider()
+{
+    m_thread->stopAllTasks();
+    delete m_thread;
+}
+
+QIcon FileIconProvider::icon(const QFileInfo& info) const
+{
+    // never render here: QFileSystemModel asks for every file it lists
+    if(info.isFile())
+        return m_placeholder;
+
+    return QFileIconProvider::icon(info);
+}
+
+QIcon FileIconProvider::thumbnail(const QString& filePath)
+{
+    if(QIcon* const cached = m_icons.object(filePath))
+        return *cached;
+
+    if(m_failed.contains(filePath) || m_inFlight.contains(filePath))
+        return m_placeholder;
+
+    // the most recently painted rows go first
+    m_prefetch.removeOne(filePath);
+    m_pending.removeOne(filePath);
+    m_pending.prepend(filePath);
+
+    requestNext();
+
+    return m_placeholder;
+}
+
+void FileIconProvider::prefetch(const QStringList& filePaths)
+{
+    m_prefetch.clear();
+
+    foreach(const QString& filePath, filePaths)
+    {
+        if(m_icons.contains(filePath) || m_inFlight.contains(filePath) || m_failed.contains(filePath) || m_pending.contains(filePath))
+            continue;
+
+        m_prefetch.append(filePath);
+    }
+
+    requestNext();
+}
+
+void FileIconProvider::cancelPending()
+{
+    m_pending.clear();
+    m_prefetch.clear();
+}
+
+void FileIconProvider::invalidate(const QString& filePath)
+{
+    m_icons.remove(filePath);
+    m_failed.remove(filePath);
+
+    ThumbnailCache::remove(filePath);
+
+    // views ask again and get the new thumbnail rendered
+    emit thumbnailReady(filePath);
+}
+
+void FileIconProvider::requestNext()
+{
+    while(m_inFlight.count() < maxInFlight)
+    {
+        QString filePath;
+
+        // visible rows always go first
+        if(!m_pending.isEmpty())
+            filePath = m_pending.takeFirst();
+        else if(!m_prefetch.isEmpty() && (m_inFlight.count() < maxPrefetchInFlight))
+            filePath = m_prefetch.takeFirst();
+        else
+            break;
+
+        // prefetched meanwhile
+        if(m_icons.contains(filePath) || m_inFlight.contains(filePath))
+            continue;
+
+        m_inFlight.insert(filePath);
+
+        // disk level of the cache is read off the GUI thread
+        QFutureWatcher<QImage>* const watcher = new QFutureWatcher<QImage>(this);
+        watcher->setProperty("filePath", filePath);
+
+        connect(watcher, SIGNAL(finished()),
+                this, SLOT(slotCacheLookupFinished()));
+
+        watcher->setFuture(QtConcurrent::run(&ThumbnailCache::find, filePath, false));
+    }
+}
+
+void FileIconProvider::slotCacheLookupFinished()
+{
+    QFutureWatcher<QImage>* const watcher = static_cast<QFutureWatcher<QImage>*>(sender());
+    QString filePath = watcher->property("filePath").toString();
+    QImage cached = watcher->result();
+
+    watcher->deleteLater();
+
+    if(!cached.isNull())
+    {
+        thumbnailDone(filePath, QPixmap::fromImage(cached));
+        return;
+    }
+
+    // already in the digiKam thumbnail cache, otherwise
+    // loading starts and slotThumbnailLoaded() is called when done
+    QPixmap pix;
+
+    if(m_thread->find(ThumbnailIdentifier(filePath), pix))
+    {
+        ThumbnailCache::insert(filePath, pix.toImage());
+        thumbnailDone(filePath, pix);
+    }
+}
+
+void FileIconProvider::slotThumbnailLoaded(const LoadingDescription& description, const QPixmap& pix)
+{
+    QString filePath = description.filePath;
+
+    if(!m_inFlight.contains(filePath))
+        return;
+
+    if(pix.isNull())
+    {
+        qDebug("AnalogExif: FileIconProvider::slotThumbnailLoaded() no thumbnail for %s", qPrintable(filePath));
+
+        m_inFlight.remove(filePath);
+        m_failed.insert(filePath);
+
+        requestNext();
+        return;
+    }
+
+    ThumbnailCache::insert(filePath, pix.toImage());
+    thumbnailDone(filePath, pix);
+}
+
+void FileIconProvider::thumbnailDone(const QString& filePath, const QPixmap& pix)
+{
+    m_inFlight.remove(filePath);
+    m_icons.insert(filePath, new QIcon(pix));
+
+    emit thumbnailReady(filePath);
+
+    requestNext();
+}
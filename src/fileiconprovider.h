@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEICONPROVIDER_H
+#define FILEICONPROVIDER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QFileIconProvider>
+#include <QFileInfo>
+#include <QIcon>
+#include <QCache>
+#include <QSet>
+#include <QStringList>
+
+// digiKam includes
+
+#include "thumbnailloadthread.h"
+#include "loadingdescription.h"
+
+using namespace Digikam;
+
+// icon provider for the file view
+// files get a placeholder at once, thumbnails are rendered in the background
+class FileIconProvider : public QObject, public QFileIconProvider
+{
+    Q_OBJECT
+
+public:
+
+    explicit FileIconProvider(QObject* const parent = nullptr);
+    ~FileIconProvider();
+
+    // called by QFileSystemModel, possibly from its gatherer thread
+    QIcon icon(const QFileInfo& info) const;
+    QIcon icon(IconType type) const
+    {
+        return QFileIconProvider::icon(type);
+    }
+
+    // returns cached thumbnail or placeholder, in the latter case the thumbnail is requested
+    QIcon thumbnail(const QString& filePath);
+
+    // low priority requests, served only while no visible thumbnail is waiting
+    void prefetch(const QStringList& filePaths);
+
+    // drop the requests not yet started (e.g. folder changed)
+    void cancelPending();
+
+    // forget all thumbnails of the file (e.g. file was modified), views are notified
+    void invalidate(const QString& filePath);
+
+    static const int thumbnailSize = 256;
+
+Q_SIGNALS:
+
+    void thumbnailReady(const QString& filePath);
+
+private Q_SLOTS:
+
+    void slotCacheLookupFinished();
+    void slotThumbnailLoaded(const LoadingDescription& description, const QPixmap& pix);
+
+private:
+
+    // start pending requests while there is a free slot
+    void requestNext();
+
+    // store rendered thumbnail and notify the views
+    void thumbnailDone(const QString& filePath, const QPixmap& pix);
+
+    ThumbnailLoadThread*    m_thread;
+
+    // icons of rendered thumbnails, images are kept in ThumbnailCache
+    QCache<QString, QIcon>  m_icons;
+    // requests waiting for a slot, last requested first
+    QStringList             m_pending;
+    // prefetch requests, nearest to the visible rows first
+    QStringList             m_prefetch;
+    // requests being looked up in the cache or rendered
+    QSet<QString>           m_inFlight;
+    // files which could not be rendered
+    QSet<QString>           m_failed;
+
+    QIcon                   m_placeholder;
+
+    // maximum number of thumbnails rendered at once
+    static const int maxInFlight = 4;
+    // prefetching never takes all slots
+    static const int maxPrefetchInFlight = 2;
+    // maximum number of thumbnails kept in memory
+    static const int maxCached = 1000;
+};
+
+#endif // FILEICONPROVIDER_H
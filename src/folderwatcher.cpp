@@ -0,0 +1,331 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "folderwatcher.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSocketNotifier>
+#include <QFileSystemWatcher>
+#include <QMetaObject>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#   include <sys/inotify.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   include <errno.h>
+#endif
+
+FolderWatcher* FolderWatcher::m_instance = 0;
+
+FolderWatcher::FolderWatcher(QObject* const parent)
+    : QObject(parent),
+      m_inotifyFd(-1),
+      m_notifier(0),
+      m_fallback(0)
+{
+#ifdef Q_OS_LINUX
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if(m_inotifyFd >= 0)
+    {
+        m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(slotInotifyActivated()));
+    }
+    else
+    {
+        qDebug("AnalogExif: FolderWatcher::FolderWatcher() inotify not available (%d), using QFileSystemWatcher", errno);
+    }
+#endif
+
+    if(m_inotifyFd < 0)
+    {
+        m_fallback = new QFileSystemWatcher(this);
+        connect(m_fallback, SIGNAL(directoryChanged(QString)), this, SLOT(slotDirectoryChanged(QString)));
+    }
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(coalesceInterval);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(slotFlush()));
+
+    m_instance = this;
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    if(m_instance == this)
+        m_instance = 0;
+
+#ifdef Q_OS_LINUX
+    if(m_inotifyFd >= 0)
+        close(m_inotifyFd);
+#endif
+}
+
+FolderWatcher* FolderWatcher::instance()
+{
+    return m_instance;
+}
+
+void FolderWatcher::watch(const QString& dir)
+{
+    QString path = QDir::cleanPath(QDir::fromNativeSeparators(dir));
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if(m_dirWatches.contains(path))
+            return;
+
+        if(m_dirWatches.count() >= maxWatchedFolders)
+            return;
+
+#ifdef Q_OS_LINUX
+        if(m_inotifyFd >= 0)
+        {
+            // the syscall is thread safe, no need to go through the event loop
+            int wd = inotify_add_watch(m_inotifyFd, QFile::encodeName(path).constData(),
+                                       IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                       IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+            if(wd < 0)
+                return;
+
+            m_watchDirs.insert(wd, path);
+            m_dirWatches.insert(path, wd);
+
+            return;
+        }
+#endif
+
+        m_dirWatches.insert(path, -1);
+    }
+
+    // QFileSystemWatcher belongs to the watcher thread
+    QMetaObject::invokeMethod(this, "slotAddPath", Qt::QueuedConnection, Q_ARG(QString, path));
+}
+
+void FolderWatcher::slotAddPath(const QString& dir)
+{
+    if(m_fallback && m_fallback->addPath(dir))
+    {
+        QMutexLocker locker(&m_mutex);
+        m_fallbackPaths.insert(dir);
+    }
+}
+
+bool FolderWatcher::cachedListing(const QString& dir, QStringList& files, QStringList& subDirs)
+{
+    QString path = QDir::cleanPath(QDir::fromNativeSeparators(dir));
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Listing>::const_iterator it = m_listings.constFind(path);
+
+    if(it == m_listings.constEnd())
+        return false;
+
+    files = it->files.toList();
+    subDirs = it->subDirs.toList();
+
+    return true;
+}
+
+void FolderWatcher::beginListing(const QString& dir)
+{
+    QString path = QDir::cleanPath(QDir::fromNativeSeparators(dir));
+
+    // changes made while the folder is listed must not be missed
+    watch(path);
+
+    QMutexLocker locker(&m_mutex);
+
+    m_pendingListings.insert(path, false);
+}
+
+void FolderWatcher::storeListing(const QString& dir, const QStringList& files, const QStringList& subDirs)
+{
+    QString path = QDir::cleanPath(QDir::fromNativeSeparators(dir));
+
+    QMutexLocker locker(&m_mutex);
+
+    // listing is only trustworthy if the folder was watched before it was read
+    // and did not change meanwhile
+    QHash<QString, bool>::iterator pending = m_pendingListings.find(path);
+
+    if(pending == m_pendingListings.end())
+        return;
+
+    bool changed = pending.value();
+    m_pendingListings.erase(pending);
+
+    if(changed || !m_dirWatches.contains(path))
+        return;
+
+    // QFileSystemWatcher is added from the event loop, possibly too late
+    if(m_fallback && !m_fallbackPaths.contains(path))
+        return;
+
+    Listing listing;
+    listing.files = files.toSet();
+    listing.subDirs = subDirs.toSet();
+
+    m_listings.insert(path, listing);
+}
+
+void FolderWatcher::slotInotifyActivated()
+{
+#ifdef Q_OS_LINUX
+    char buffer[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    QMutexLocker locker(&m_mutex);
+
+    for(;;)
+    {
+        ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+
+        if(length <= 0)
+            break;
+
+        for(char* ptr = buffer; ptr < buffer + length; )
+        {
+            const struct inotify_event* const event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            // events were lost, nothing cached can be trusted
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                qDebug("AnalogExif: FolderWatcher::slotInotifyActivated() event queue overflow");
+                m_listings.clear();
+
+                for(QHash<QString, bool>::iterator it = m_pendingListings.begin(); it != m_pendingListings.end(); ++it)
+                    it.value() = true;
+
+                continue;
+            }
+
+            QString dir = m_watchDirs.value(event->wd);
+
+            if(dir.isEmpty())
+                continue;
+
+            // watched folder itself gone
+            if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                forget(dir);
+                continue;
+            }
+
+            if(event->len == 0)
+                continue;
+
+            QString name = QFile::decodeName(event->name);
+            bool removed = (event->mask & (IN_DELETE | IN_MOVED_FROM));
+
+            entryChanged(dir, name, removed);
+        }
+    }
+
+    if(!m_changedFiles.isEmpty())
+        m_flushTimer.start();
+#endif
+}
+
+void FolderWatcher::slotDirectoryChanged(const QString& dir)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // no details here, the folder has to be listed again
+    m_listings.remove(dir);
+
+    if(m_pendingListings.contains(dir))
+        m_pendingListings[dir] = true;
+}
+
+void FolderWatcher::entryChanged(const QString& dir, const QString& name, bool removed)
+{
+    QString path = dir + "/" + name;
+
+    if(m_pendingListings.contains(dir))
+        m_pendingListings[dir] = true;
+
+    // hidden entries are never listed
+    if(!name.startsWith('.'))
+    {
+        QHash<QString, Listing>::iterator it = m_listings.find(dir);
+
+        if(it != m_listings.end())
+        {
+            if(removed)
+            {
+                it->files.remove(name);
+                it->subDirs.remove(name);
+            }
+            else
+            {
+                QFileInfo info(path);
+
+                if(info.isDir())
+                    it->subDirs.insert(name);
+                else if(info.isFile())
+                    it->files.insert(name);
+            }
+        }
+    }
+
+    if(removed && m_dirWatches.contains(path))
+        forget(path);
+
+    m_changedFiles.insert(path);
+}
+
+void FolderWatcher::forget(const QString& dir)
+{
+    m_listings.remove(dir);
+    m_fallbackPaths.remove(dir);
+
+    if(m_pendingListings.contains(dir))
+        m_pendingListings[dir] = true;
+
+    int wd = m_dirWatches.take(dir);
+    m_watchDirs.remove(wd);
+
+#ifdef Q_OS_LINUX
+    if((m_inotifyFd >= 0) && (wd >= 0))
+        inotify_rm_watch(m_inotifyFd, wd);
+#endif
+}
+
+void FolderWatcher::slotFlush()
+{
+    QStringList filePaths;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        filePaths = m_changedFiles.toList();
+        m_changedFiles.clear();
+    }
+
+    if(!filePaths.isEmpty())
+        emit filesChanged(filePaths);
+}
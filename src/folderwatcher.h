@@ -0,0 +1,120 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QTimer>
+
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+// keeps track of changes in the folders the user works with
+//
+// folder listings made by the directory walker are cached and kept up to
+// date from the change notifications (inotify on Linux, QFileSystemWatcher
+// elsewhere), so a watched folder is never listed twice; changed files are
+// reported in batches to let the views drop stale thumbnails and metadata
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit FolderWatcher(QObject* const parent = nullptr);
+    ~FolderWatcher();
+
+    // the watcher of the application window, 0 if none
+    static FolderWatcher* instance();
+
+    // start watching the folder, can be called from any thread
+    void watch(const QString& dir);
+
+    // cached names of the regular files and subfolders of a watched folder
+    bool cachedListing(const QString& dir, QStringList& files, QStringList& subDirs);
+
+    // watch the folder before it is listed, can be called from any thread
+    void beginListing(const QString& dir);
+
+    // remember the listing started by beginListing(), dropped if the folder
+    // changed meanwhile, can be called from any thread
+    void storeListing(const QString& dir, const QStringList& files, const QStringList& subDirs);
+
+    // folders watched at most, leaves room in the inotify limit for others
+    static const int maxWatchedFolders = 4096;
+
+    // delay used to coalesce bursts of changes
+    static const int coalesceInterval = 250;
+
+Q_SIGNALS:
+
+    // files created, modified, renamed or deleted since the last report
+    void filesChanged(const QStringList& filePaths);
+
+private Q_SLOTS:
+
+    void slotInotifyActivated();
+    void slotDirectoryChanged(const QString& dir);
+    void slotAddPath(const QString& dir);
+    void slotFlush();
+
+private:
+
+    struct Listing
+    {
+        QSet<QString> files;
+        QSet<QString> subDirs;
+    };
+
+    // entry of a watched folder changed, called with the mutex held
+    void entryChanged(const QString& dir, const QString& name, bool removed);
+
+    // stop caching the folder, called with the mutex held
+    void forget(const QString& dir);
+
+    static FolderWatcher*   m_instance;
+
+    // guards the members below
+    QMutex                  m_mutex;
+    QHash<QString, Listing> m_listings;
+    QHash<int, QString>     m_watchDirs;
+    QHash<QString, int>     m_dirWatches;
+    QSet<QString>           m_changedFiles;
+    // folders being listed, true if changed since beginListing()
+    QHash<QString, bool>    m_pendingListings;
+    // folders added to the QFileSystemWatcher
+    QSet<QString>           m_fallbackPaths;
+
+    // inotify descriptor, -1 if QFileSystemWatcher is used
+    int                     m_inotifyFd;
+    QSocketNotifier*        m_notifier;
+    QFileSystemWatcher*     m_fallback;
+
+    QTimer                  m_flushTimer;
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,180 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gearfilter.h"
+
+// Qt includes
+
+#include <QStringList>
+#include <QRegExp>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+// Local includes
+
+#include "libraryconnectionmanager.h"
+
+bool GearFilter::ftsAvailable = false;
+
+namespace
+{
+    // concatenated tag values of a single gear
+    const char* const tagValuesSql =
+        "(SELECT group_concat(ifnull(TagValue, '') || ' ' || ifnull(AltValue, ''), ' ') FROM UserGearProperties WHERE GearId = %1)";
+
+    const char* const triggerNames[] = {
+        "GearSearchItemInsert", "GearSearchItemUpdate", "GearSearchItemDelete",
+        "GearSearchPropertyInsert", "GearSearchPropertyUpdate", "GearSearchPropertyDelete"
+    };
+
+    const int triggerCount = sizeof(triggerNames) / sizeof(triggerNames[0]);
+}
+
+bool GearFilter::setup()
+{
+    ftsAvailable = false;
+
+    QSqlQuery query;
+
+    // the index is in sync as long as all the triggers are in place
+    query.exec("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'GearSearch%'");
+    query.first();
+
+    bool inSync = query.isValid() && (query.value(0).toInt() == triggerCount);
+
+    QString newValues = QString(tagValuesSql).arg("new.GearId");
+    QString oldValues = QString(tagValuesSql).arg("old.GearId");
+
+    QStringList statements;
+    // trigger and gear lookups by the gear id
+    statements << "CREATE INDEX IF NOT EXISTS UserGearPropertiesGearId ON UserGearProperties(GearId)";
+
+    statements << "CREATE VIRTUAL TABLE IF NOT EXISTS GearSearch USING fts5(GearName, TagValues, tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3')";
+
+    if(!inSync)
+    {
+        statements << "CREATE TRIGGER IF NOT EXISTS GearSearchItemInsert AFTER INSERT ON UserGearItems BEGIN "
+                      "INSERT INTO GearSearch(rowid, GearName, TagValues) VALUES (new.id, new.GearName, ''); END"
+                   << "CREATE TRIGGER IF NOT EXISTS GearSearchItemUpdate AFTER UPDATE OF GearName ON UserGearItems BEGIN "
+                      "UPDATE GearSearch SET GearName = new.GearName WHERE rowid = new.id; END"
+                   << "CREATE TRIGGER IF NOT EXISTS GearSearchItemDelete AFTER DELETE ON UserGearItems BEGIN "
+                      "DELETE FROM GearSearch WHERE rowid = old.id; END"
+                   << QString("CREATE TRIGGER IF NOT EXISTS GearSearchPropertyInsert AFTER INSERT ON UserGearProperties BEGIN "
+                              "UPDATE GearSearch SET TagValues = %1 WHERE rowid = new.GearId; END").arg(newValues)
+                   << QString("CREATE TRIGGER IF NOT EXISTS GearSearchPropertyUpdate AFTER UPDATE OF GearId, TagValue, AltValue ON UserGearProperties BEGIN "
+                              "UPDATE GearSearch SET TagValues = %1 WHERE rowid = old.GearId; "
+                              "UPDATE GearSearch SET TagValues = %2 WHERE rowid = new.GearId; END").arg(oldValues).arg(newValues)
+                   << QString("CREATE TRIGGER IF NOT EXISTS GearSearchPropertyDelete AFTER DELETE ON UserGearProperties BEGIN "
+                              "UPDATE GearSearch SET TagValues = %1 WHERE rowid = old.GearId; END").arg(oldValues)
+                   // (re)build the index contents
+                   << "DELETE FROM GearSearch"
+                   << QString("INSERT INTO GearSearch(rowid, GearName, TagValues) SELECT a.id, a.GearName, %1 FROM UserGearItems a").arg(QString(tagValuesSql).arg("a.id"));
+    }
+
+    query.exec("SAVEPOINT GearFilterSetup");
+
+    foreach(QString statement, statements)
+    {
+        if(!query.exec(statement))
+        {
+            // no FTS5 in the SQLite build or read-only library - fall back to LIKE
+            qDebug("AnalogExif: GearFilter::setup() full-text index is not available: %s", query.lastError().text().toLatin1().constData());
+
+            query.exec("ROLLBACK TO GearFilterSetup");
+            query.exec("RELEASE GearFilterSetup");
+
+            dropTriggers();
+
+            return false;
+        }
+    }
+
+    query.exec("RELEASE GearFilterSetup");
+
+    ftsAvailable = true;
+
+    return true;
+}
+
+void GearFilter::dropTriggers()
+{
+    QSqlQuery query;
+
+    for(int i = 0; i < triggerCount; i++)
+        query.exec(QString("DROP TRIGGER IF EXISTS %1").arg(triggerNames[i]));
+}
+
+QString GearFilter::ftsQuery(const QString& text)
+{
+    // every word is a quoted prefix term, terms are AND-ed
+    QStringList terms;
+
+    foreach(QString word, text.split(QRegExp("\\s+"), QString::SkipEmptyParts))
+    {
+        terms << QString("\"%1\"*").arg(word.replace("\"", "\"\""));
+    }
+
+    return terms.join(" ");
+}
+
+QSet<int> GearFilter::match(const QString& text, const QList<int>& gearTypes)
+{
+    QSet<int> ids;
+
+    QStringList types;
+    foreach(int type, gearTypes)
+        types << QString::number(type);
+
+    QSqlQuery query(LibraryConnectionManager::threadConnection());
+
+    if(ftsAvailable)
+    {
+        QString ftsText = ftsQuery(text);
+
+        if(ftsText.isEmpty())
+            return ids;
+
+        query.prepare(QString("SELECT a.id FROM GearSearch s, UserGearItems a WHERE GearSearch MATCH ? AND a.id = s.rowid AND a.GearType IN (%1)").arg(types.join(",")));
+        query.addBindValue(ftsText);
+    }
+    else
+    {
+        QString likeText = QString(text.trimmed()).replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+
+        query.prepare(QString("SELECT a.id FROM UserGearItems a WHERE a.GearType IN (%1) AND (a.GearName LIKE ? ESCAPE '\\' OR "
+                              "EXISTS (SELECT 1 FROM UserGearProperties b WHERE b.GearId = a.id AND (b.TagValue LIKE ? ESCAPE '\\' OR b.AltValue LIKE ? ESCAPE '\\')))").arg(types.join(",")));
+
+        likeText = "%" + likeText + "%";
+        query.addBindValue(likeText);
+        query.addBindValue(likeText);
+        query.addBindValue(likeText);
+    }
+
+    if(!query.exec())
+    {
+        qDebug("AnalogExif: GearFilter::match() query failed: %s", query.lastError().text().toLatin1().constData());
+        return ids;
+    }
+
+    while(query.next())
+        ids.insert(query.value(0).toInt());
+
+    return ids;
+}
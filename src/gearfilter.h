@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GEARFILTER_H
+#define GEARFILTER_H
+
+// Qt includes
+
+#include <QString>
+#include <QList>
+#include <QSet>
+
+// full-text filter over the equipment library
+//
+// GearSearch is an FTS5 index over the gear names and property values,
+// kept in sync with UserGearItems and UserGearProperties by triggers
+class GearFilter
+{
+public:
+    // create the index if missing and make sure it is up to date
+    static bool setup();
+
+    // ids of the gear items of the given types matching the text
+    static QSet<int> match(const QString& text, const QList<int>& gearTypes);
+
+private:
+    // convert user input into the prefix query
+    static QString ftsQuery(const QString& text);
+
+    // remove the triggers so the library stays editable without FTS5
+    static void dropTriggers();
+
+    // whether the index could be set up
+    static bool ftsAvailable;
+};
+
+#endif // GEARFILTER_H
@@ -38,6 +38,14 @@ void GearListModel::setApplicable(bool applicable)
     endResetModel();
 }
 
+int GearListModel::gearId(int row) const
+{
+    if(QSqlQueryModel::rowCount() == 0)
+        return -1;
+
+    return record(row).value(1).toInt();
+}
+
 int GearListModel::rowCount(const QModelIndex &index) const
 {
     int i = QSqlQueryModel::rowCount(index.parent());
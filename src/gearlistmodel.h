@@ -51,6 +51,15 @@ public:
     // reloads the gear
     void reload();
 
+    // gear type of the list
+    int type() const
+    {
+        return gearType;
+    }
+
+    // gear id at the row, -1 for the empty list message
+    int gearId(int row) const;
+
 protected:
     // can user get data from the gear
     bool isApplicable;
@@ -0,0 +1,241 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imageformats.h"
+
+// Qt includes
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#endif
+
+namespace
+{
+    // number of bytes needed to recognize any of the formats
+    const int sniffSize = 16;
+
+    // bounds the sniff cache
+    const int maxSniffCacheSize = 100000;
+
+    QList<ImageFormats::Format> buildFormats()
+    {
+        QList<ImageFormats::Format> list;
+        ImageFormats::Format format;
+
+        const QByteArray tiffLE("II*\0", 4);
+        const QByteArray tiffBE("MM\0*", 4);
+
+        format.name = QCoreApplication::translate("ImageFormats", "JPEG images");
+        format.suffixes = QStringList() << "jpg" << "jpeg" << "jpe";
+        format.magics = QList<QByteArray>() << QByteArray("\xFF\xD8\xFF", 3);
+        format.capabilities = ImageFormats::WriteInPlace | ImageFormats::EmbeddedPreview;
+        list << format;
+
+        format.name = QCoreApplication::translate("ImageFormats", "JPEG2000 images");
+        format.suffixes = QStringList() << "jpf" << "jpx" << "jp2" << "j2c" << "j2k" << "jpc";
+        format.magics = QList<QByteArray>() << QByteArray("\0\0\0\x0CjP  \r\n\x87\n", 12) << QByteArray("\xFF\x4F\xFF\x51", 4);
+        format.capabilities = ImageFormats::WriteInPlace;
+        list << format;
+
+        format.name = QCoreApplication::translate("ImageFormats", "TIFF images");
+        format.suffixes = QStringList() << "tif" << "tiff";
+        format.magics = QList<QByteArray>() << tiffLE << tiffBE;
+        format.capabilities = ImageFormats::WriteInPlace | ImageFormats::EmbeddedPreview;
+        list << format;
+
+        format.name = QCoreApplication::translate("ImageFormats", "DNG images");
+        format.suffixes = QStringList() << "dng";
+        format.magics = QList<QByteArray>() << tiffLE << tiffBE;
+        format.capabilities = ImageFormats::WriteInPlace | ImageFormats::EmbeddedPreview;
+        list << format;
+
+        format.name = QCoreApplication::translate("ImageFormats", "Photoshop PSD images");
+        format.suffixes = QStringList() << "psd";
+        format.magics = QList<QByteArray>() << QByteArray("8BPS");
+        format.capabilities = ImageFormats::WriteInPlace;
+        list << format;
+
+        // mostly TIFF based, some with their own signatures
+        format.name = QCoreApplication::translate("ImageFormats", "Camera raw images");
+        format.suffixes = QStringList() << "cr2" << "nef" << "pef" << "rw2" << "arw" << "sr2" << "orf" << "raf" << "mrw";
+        format.magics = QList<QByteArray>() << tiffLE << tiffBE << QByteArray("IIRO") << QByteArray("IIRS") << QByteArray("MMOR")
+                                            << QByteArray("IIU\0", 4) << QByteArray("FUJIFILM") << QByteArray("\0MRM", 4);
+        format.capabilities = ImageFormats::SidecarOnly | ImageFormats::EmbeddedPreview;
+        list << format;
+
+        return list;
+    }
+
+    // sniffed format index (-1 for unsupported), guarded by the mutex
+    QMutex                  sniffMutex;
+    QHash<QByteArray, int>  sniffCache;
+
+    // identity of the current file state
+    QByteArray sniffKey(const QString& filePath)
+    {
+#ifdef Q_OS_UNIX
+        struct stat st;
+
+        if(stat(QFile::encodeName(filePath).constData(), &st) != 0)
+            return QByteArray();
+
+        QByteArray key;
+        key += QByteArray::number((qulonglong)st.st_dev) + ':';
+        key += QByteArray::number((qulonglong)st.st_ino) + ':';
+        key += QByteArray::number((qlonglong)st.st_size) + ':';
+        key += QByteArray::number((qlonglong)st.st_mtime);
+
+        return key;
+#else
+        QFileInfo info(filePath);
+
+        if(!info.exists())
+            return QByteArray();
+
+        return info.absoluteFilePath().toUtf8() + ':' + QByteArray::number(info.size()) + ':' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+#endif
+    }
+}
+
+const QList<ImageFormats::Format>& ImageFormats::formats()
+{
+    static const QList<Format> list = buildFormats();
+
+    return list;
+}
+
+QStringList ImageFormats::suffixes(Capabilities required)
+{
+    QStringList result;
+
+    foreach(const Format& format, formats())
+    {
+        if((format.capabilities & required) == required)
+            result << format.suffixes;
+    }
+
+    return result;
+}
+
+QStringList ImageFormats::nameFilters(Capabilities required)
+{
+    QStringList result;
+
+    foreach(const QString& suffix, suffixes(required))
+        result << "*." + suffix;
+
+    return result;
+}
+
+QString ImageFormats::fileDialogFilter()
+{
+    QStringList filters;
+
+    foreach(const Format& format, formats())
+    {
+        QStringList patterns;
+
+        foreach(const QString& suffix, format.suffixes)
+            patterns << "*." + suffix;
+
+        filters << QString("%1 (%2)").arg(format.name).arg(patterns.join(" "));
+    }
+
+    filters << QCoreApplication::translate("ImageFormats", "All files (*.*)");
+
+    return filters.join(";;");
+}
+
+const ImageFormats::Format* ImageFormats::sniff(const QString& filePath)
+{
+    const QList<Format>& list = formats();
+    QByteArray key = sniffKey(filePath);
+
+    if(key.isEmpty())
+        return 0;
+
+    {
+        QMutexLocker locker(&sniffMutex);
+        QHash<QByteArray, int>::const_iterator it = sniffCache.constFind(key);
+
+        if(it != sniffCache.constEnd())
+            return (it.value() < 0) ? 0 : &list.at(it.value());
+    }
+
+    QByteArray header;
+    QFile file(filePath);
+
+    if(file.open(QIODevice::ReadOnly))
+        header = file.read(sniffSize);
+
+    // several formats share a signature (TIFF based ones), prefer the one matching the suffix
+    QString suffix = QFileInfo(filePath).suffix().toLower();
+    int found = -1;
+
+    for(int i = 0; i < list.count(); i++)
+    {
+        bool matches = false;
+
+        foreach(const QByteArray& magic, list.at(i).magics)
+        {
+            if(header.startsWith(magic))
+            {
+                matches = true;
+                break;
+            }
+        }
+
+        if(!matches)
+            continue;
+
+        if(found < 0)
+            found = i;
+
+        if(list.at(i).suffixes.contains(suffix))
+        {
+            found = i;
+            break;
+        }
+    }
+
+    QMutexLocker locker(&sniffMutex);
+
+    if(sniffCache.count() >= maxSniffCacheSize)
+        sniffCache.clear();
+
+    sniffCache.insert(key, found);
+
+    return (found < 0) ? 0 : &list.at(found);
+}
+
+bool ImageFormats::canWrite(const QString& filePath)
+{
+    const Format* const format = sniff(filePath);
+
+    return (format && format->capabilities.testFlag(WriteInPlace));
+}
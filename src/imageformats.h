@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEFORMATS_H
+#define IMAGEFORMATS_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QFlags>
+
+// registry of the supported image containers
+//
+// used for the file view and file dialog filters, for the batch file lists
+// and for checking the file contents before it is opened by Exiv2
+class ImageFormats
+{
+public:
+    enum Capability
+    {
+        None            = 0,
+        // metadata can be written into the file itself
+        WriteInPlace    = 1,
+        // file usually carries an embedded preview
+        EmbeddedPreview = 2,
+        // metadata can only be read, changes would need a sidecar
+        SidecarOnly     = 4
+    };
+    Q_DECLARE_FLAGS(Capabilities, Capability);
+
+    struct Format
+    {
+        // file dialog title
+        QString             name;
+        // lower case, without dot
+        QStringList         suffixes;
+        // possible file signatures
+        QList<QByteArray>   magics;
+        Capabilities        capabilities;
+    };
+
+    // all known formats
+    static const QList<Format>& formats();
+
+    // suffixes of the formats having all the required capabilities
+    static QStringList suffixes(Capabilities required = None);
+
+    // "*.suffix" filters of the formats having all the required capabilities
+    static QStringList nameFilters(Capabilities required = None);
+
+    // filter string for QFileDialog
+    static QString fileDialogFilter();
+
+    // format of the file determined by its contents, 0 if not supported;
+    // results are cached per file (inode, size and modification time)
+    static const Format* sniff(const QString& filePath);
+
+    // file contents is supported and metadata can be written in place
+    static bool canWrite(const QString& filePath);
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(ImageFormats::Capabilities);
+
+#endif // IMAGEFORMATS_H
@@ -0,0 +1,180 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libraryconnectionmanager.h"
+
+// Qt includes
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadStorage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlQuery>
+#include <QSqlError>
+
+namespace
+{
+    // current library file and its generation, guarded by the mutex
+    QMutex  libraryMutex;
+    QString libraryName;
+    int     libraryGeneration = 0;
+
+    // worker thread connection, removed together with the thread
+    class ThreadConnection
+    {
+    public:
+        explicit ThreadConnection(const QString& connName) : name(connName), generation(-1) { }
+
+        ~ThreadConnection()
+        {
+            close();
+        }
+
+        void close()
+        {
+            if(!QSqlDatabase::contains(name))
+                return;
+
+            // database handle has to be released before removal
+            {
+                QSqlDatabase db = QSqlDatabase::database(name, false);
+                db.close();
+            }
+
+            QSqlDatabase::removeDatabase(name);
+        }
+
+        QString name;
+        int     generation;
+    };
+
+    QThreadStorage<ThreadConnection*> readConnections;
+    QThreadStorage<ThreadConnection*> writeConnections;
+}
+
+bool LibraryConnectionManager::setupMainConnection(QSqlDatabase& db)
+{
+    QSqlQuery query(db);
+
+    // write-ahead log - readers never block the writer and vice versa
+    if(!query.exec("PRAGMA journal_mode=WAL") || !query.first())
+    {
+        qDebug("AnalogExif: LibraryConnectionManager::setupMainConnection() unable to set journal mode: %s", query.lastError().text().toLatin1().constData());
+        return false;
+    }
+
+    // WAL is not available for e.g. network shares - keep working with the rollback journal
+    if(query.value(0).toString().compare("wal", Qt::CaseInsensitive) != 0)
+    {
+        qDebug("AnalogExif: LibraryConnectionManager::setupMainConnection() WAL is not supported, journal mode is %s", query.value(0).toString().toLatin1().constData());
+    }
+    else
+    {
+        // in WAL mode NORMAL is still safe against corruption
+        query.exec("PRAGMA synchronous=NORMAL");
+    }
+
+    QMutexLocker lock(&libraryMutex);
+
+    libraryName = db.databaseName();
+    libraryGeneration++;
+
+    return true;
+}
+
+void LibraryConnectionManager::invalidate()
+{
+    QMutexLocker lock(&libraryMutex);
+
+    libraryName.clear();
+    libraryGeneration++;
+}
+
+QSqlDatabase LibraryConnectionManager::threadConnection(bool writable)
+{
+    // GUI thread works with the default read-write connection
+    if(QThread::currentThread() == QCoreApplication::instance()->thread())
+        return QSqlDatabase::database();
+
+    QString name;
+    int generation;
+
+    {
+        QMutexLocker lock(&libraryMutex);
+
+        name = libraryName;
+        generation = libraryGeneration;
+    }
+
+    QThreadStorage<ThreadConnection*>& connections = writable ? writeConnections : readConnections;
+
+    if(!connections.hasLocalData())
+        connections.setLocalData(new ThreadConnection(connectionName(writable)));
+
+    ThreadConnection* conn = connections.localData();
+
+    if(conn->generation == generation)
+        return QSqlDatabase::database(conn->name, false);
+
+    // library was switched or not opened yet - reconnect
+    conn->close();
+
+    if(name.isEmpty())
+        return QSqlDatabase();
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", conn->name);
+    db.setDatabaseName(name);
+    // writers wait for the editor's transaction to finish
+    db.setConnectOptions(writable ? "QSQLITE_BUSY_TIMEOUT=5000" : "QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+
+    if(!db.open())
+    {
+        qDebug("AnalogExif: LibraryConnectionManager::threadConnection() unable to open %s: %s", name.toLocal8Bit().constData(), db.lastError().text().toLatin1().constData());
+        return db;
+    }
+
+    conn->generation = generation;
+
+    return db;
+}
+
+bool LibraryConnectionManager::checkpoint(bool truncate)
+{
+    QSqlDatabase db = QSqlDatabase::database(QSqlDatabase::defaultConnection, false);
+
+    if(!db.isOpen())
+        return false;
+
+    // passive checkpoint never waits for the readers, truncate resets the log
+    QSqlQuery query(db);
+
+    if(!query.exec(QString("PRAGMA wal_checkpoint(%1)").arg(truncate ? "TRUNCATE" : "PASSIVE")))
+    {
+        qDebug("AnalogExif: LibraryConnectionManager::checkpoint() failed: %s", query.lastError().text().toLatin1().constData());
+        return false;
+    }
+
+    return true;
+}
+
+QString LibraryConnectionManager::connectionName(bool writable)
+{
+    return QString("AnalogExifWorker-%1%2").arg(reinterpret_cast<quintptr>(QThread::currentThreadId())).arg(writable ? "-rw" : "");
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARYCONNECTIONMANAGER_H
+#define LIBRARYCONNECTIONMANAGER_H
+
+// Qt includes
+
+#include <QString>
+#include <QSqlDatabase>
+
+// per-thread access to the equipment library
+//
+// the main (GUI) thread owns the default read-write connection, every other
+// thread gets its own read-only (or, for imports, read-write) connection to
+// the same library file; the library is switched to WAL journaling so
+// readers never block the editor
+class LibraryConnectionManager
+{
+public:
+    // prepare freshly opened main connection (WAL, synchronous mode)
+    static bool setupMainConnection(QSqlDatabase& db);
+
+    // forget the current library, worker connections are dropped lazily
+    static void invalidate();
+
+    // connection usable from the calling thread, read-only unless asked otherwise
+    static QSqlDatabase threadConnection(bool writable = false);
+
+    // fold the write-ahead log back into the library file
+    static bool checkpoint(bool truncate = false);
+
+    // interval between the periodic checkpoints
+    static const int checkpointInterval = 5 * 60 * 1000;
+
+private:
+    // builds the per-thread connection name
+    static QString connectionName(bool writable);
+};
+
+#endif // LIBRARYCONNECTIONMANAGER_H
@@ -0,0 +1,561 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librarytransfer.h"
+
+// Qt includes
+
+#include <QObject>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QVector>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QJsonParseError>
+
+// Local includes
+
+#include "libraryconnectionmanager.h"
+
+namespace
+{
+    // prepared insert executed in batches of rows
+    class BatchInsert
+    {
+    public:
+        BatchInsert(QSqlDatabase& db, const QString& sql, int nColumns)
+            : query(db), columns(nColumns), pending(0)
+        {
+            prepared = query.prepare(sql);
+        }
+
+        bool add(const QVariantList& row)
+        {
+            for(int i = 0; i < columns.count(); i++)
+                columns[i] << row.at(i);
+
+            if(++pending >= LibraryTransfer::batchSize)
+                return flush();
+
+            return prepared;
+        }
+
+        bool flush()
+        {
+            if(!prepared)
+                return false;
+
+            if(pending == 0)
+                return true;
+
+            for(int i = 0; i < columns.count(); i++)
+            {
+                query.addBindValue(columns.at(i));
+                columns[i].clear();
+            }
+
+            pending = 0;
+
+            return query.execBatch();
+        }
+
+        bool hasPending() const
+        {
+            return pending != 0;
+        }
+
+        QString errorText() const
+        {
+            return query.lastError().text();
+        }
+
+    private:
+        QSqlQuery              query;
+        QVector<QVariantList>  columns;
+        int                    pending;
+        bool                   prepared;
+    };
+}
+
+LibraryTransfer::Format LibraryTransfer::formatForFile(const QString& fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+
+    if((suffix == "json") || (suffix == "jsonl"))
+        return Json;
+
+    return Csv;
+}
+
+QStringList LibraryTransfer::fieldNames(const QString& table)
+{
+    static QHash<QString, QStringList> names;
+
+    if(names.isEmpty())
+    {
+        names.insert("Library", QStringList() << "Version");
+        names.insert("MetaTags", QStringList() << "TagName" << "TagText" << "PrintFormat" << "TagType" << "Flags" << "AltTag");
+        names.insert("GearTemplate", QStringList() << "GearType" << "TagName" << "OrderBy");
+        names.insert("UserGearItems", QStringList() << "id" << "ParentId" << "GearType" << "GearName" << "OrderBy");
+        names.insert("UserGearProperties", QStringList() << "GearId" << "TagName" << "TagValue" << "AltValue" << "OrderBy");
+    }
+
+    return names.value(table);
+}
+
+bool LibraryTransfer::exportLibrary(const QString& fileName)
+{
+    QSqlDatabase db = LibraryConnectionManager::threadConnection();
+
+    if(!db.isOpen())
+    {
+        error = QObject::tr("Equipment library is not open.");
+        return false;
+    }
+
+    // the old file is only replaced on success
+    QSaveFile file(fileName);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+
+    writeRecord(out, "Library", QVariantList() << formatVersion);
+
+    // tags go first, the rest references them by name
+    bool result = exportTable(out, db, "MetaTags", "SELECT TagName, TagText, PrintFormat, TagType, Flags, AltTag FROM MetaTags ORDER BY id") &&
+                  exportTable(out, db, "GearTemplate", "SELECT a.GearType, b.TagName, a.OrderBy FROM GearTemplate a, MetaTags b WHERE b.id = a.TagId ORDER BY a.GearType, a.OrderBy") &&
+                  exportTable(out, db, "UserGearItems", "SELECT id, ParentId, GearType, GearName, OrderBy FROM UserGearItems ORDER BY ParentId, id") &&
+                  exportTable(out, db, "UserGearProperties", "SELECT a.GearId, b.TagName, a.TagValue, a.AltValue, a.OrderBy FROM UserGearProperties a, MetaTags b WHERE b.id = a.TagId ORDER BY a.GearId, a.OrderBy");
+
+    out.flush();
+
+    if(!result)
+    {
+        file.cancelWriting();
+        return false;
+    }
+
+    if(!file.commit())
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool LibraryTransfer::exportTable(QTextStream& out, QSqlDatabase& db, const QString& table, const QString& sql)
+{
+    QSqlQuery query(db);
+
+    // rows are streamed, never held in memory
+    query.setForwardOnly(true);
+
+    if(!query.exec(sql))
+    {
+        error = query.lastError().text();
+        return false;
+    }
+
+    int nFields = query.record().count();
+
+    while(query.next())
+    {
+        if(cancelled.load())
+        {
+            error = QObject::tr("Cancelled.");
+            return false;
+        }
+
+        QVariantList values;
+
+        for(int i = 0; i < nFields; i++)
+            values << query.value(i);
+
+        writeRecord(out, table, values);
+
+        rows.ref();
+    }
+
+    return true;
+}
+
+bool LibraryTransfer::importLibrary(const QString& fileName)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+
+    QString table;
+    QVariantList values;
+
+    // check the header record
+    if(!readRecord(in, table, values) || (table != "Library") || (values.at(0).toInt() != formatVersion))
+    {
+        if(error.isEmpty())
+            error = QObject::tr("Not an AnalogExif equipment file or unsupported version.");
+
+        return false;
+    }
+
+    QSqlDatabase db = LibraryConnectionManager::threadConnection(true);
+
+    if(!db.isOpen())
+    {
+        error = QObject::tr("Equipment library is not open.");
+        return false;
+    }
+
+    QSqlQuery query(db);
+
+    // existing tags are matched by name
+    QHash<QString, int> tagIds;
+
+    query.setForwardOnly(true);
+    query.exec("SELECT TagName, id FROM MetaTags");
+
+    while(query.next())
+        tagIds.insert(query.value(0).toString(), query.value(1).toInt());
+
+    // imported gear is appended after the existing one
+    query.exec("SELECT ifnull(max(id), 0), ifnull(max(OrderBy), -1) + 1 FROM UserGearItems");
+    query.first();
+
+    if(!query.isValid())
+    {
+        error = query.lastError().text();
+        return false;
+    }
+
+    int idBase = query.value(0).toInt();
+    int orderBase = query.value(1).toInt();
+
+    query.finish();
+
+    if(!query.exec("SAVEPOINT ImportLibrary"))
+    {
+        error = query.lastError().text();
+        return false;
+    }
+
+    QSqlQuery tagInsert(db);
+    tagInsert.prepare("INSERT INTO MetaTags(TagName, TagText, PrintFormat, TagType, Flags, AltTag) VALUES(?, ?, ?, ?, ?, ?)");
+
+    BatchInsert templates(db, "INSERT INTO GearTemplate(GearType, TagId, OrderBy) SELECT ?, ?, ? "
+                              "WHERE NOT EXISTS (SELECT 1 FROM GearTemplate WHERE GearType = ? AND TagId = ?)", 5);
+    BatchInsert items(db, "INSERT INTO UserGearItems(id, ParentId, GearType, GearName, OrderBy) VALUES(?, ?, ?, ?, ?)", 5);
+    BatchInsert properties(db, "INSERT INTO UserGearProperties(GearId, TagId, TagValue, AltValue, OrderBy) VALUES(?, ?, ?, ?, ?)", 5);
+
+    bool result = true;
+
+    while(result && readRecord(in, table, values))
+    {
+        if(cancelled.load())
+        {
+            error = QObject::tr("Cancelled.");
+            result = false;
+            break;
+        }
+
+        if(table == "MetaTags")
+        {
+            QString tagName = values.at(0).toString();
+
+            // keep the existing tag definition
+            if(!tagIds.contains(tagName))
+            {
+                for(int i = 0; i < values.count(); i++)
+                    tagInsert.addBindValue(values.at(i));
+
+                if(!tagInsert.exec())
+                {
+                    error = tagInsert.lastError().text();
+                    result = false;
+                    break;
+                }
+
+                tagIds.insert(tagName, tagInsert.lastInsertId().toInt());
+            }
+        }
+        else if(table == "UserGearItems")
+        {
+            int id = values.at(0).toInt();
+            int parentId = values.at(1).toInt();
+
+            if(id <= 0)
+            {
+                error = QObject::tr("Invalid equipment id at line %1.").arg(lineNumber);
+                result = false;
+                break;
+            }
+
+            result = items.add(QVariantList() << idBase + id << ((parentId > 0) ? idBase + parentId : -1)
+                                              << values.at(2) << values.at(3) << orderBase + values.at(4).toInt());
+
+            if(!result)
+                error = items.errorText();
+        }
+        else
+        {
+            // GearTemplate or UserGearProperties - resolve the tag
+            QString tagName = values.at(1).toString();
+
+            if(!tagIds.contains(tagName))
+            {
+                error = QObject::tr("Unknown tag %1 at line %2.").arg(tagName).arg(lineNumber);
+                result = false;
+                break;
+            }
+
+            int tagId = tagIds.value(tagName);
+
+            if(table == "GearTemplate")
+            {
+                result = templates.add(QVariantList() << values.at(0) << tagId << values.at(2) << values.at(0) << tagId);
+
+                if(!result)
+                    error = templates.errorText();
+            }
+            else
+            {
+                // properties may only follow their gear items
+                if(items.hasPending() && !items.flush())
+                {
+                    error = items.errorText();
+                    result = false;
+                    break;
+                }
+
+                result = properties.add(QVariantList() << idBase + values.at(0).toInt() << tagId << values.at(2) << values.at(3) << values.at(4));
+
+                if(!result)
+                    error = properties.errorText();
+            }
+        }
+
+        rows.ref();
+    }
+
+    // write the remaining rows
+    if(result && error.isEmpty())
+    {
+        if(!templates.flush())
+            error = templates.errorText();
+        else if(!items.flush())
+            error = items.errorText();
+        else if(!properties.flush())
+            error = properties.errorText();
+    }
+
+    if(!error.isEmpty())
+    {
+        query.exec("ROLLBACK TO ImportLibrary");
+        query.exec("RELEASE ImportLibrary");
+
+        return false;
+    }
+
+    if(!query.exec("RELEASE ImportLibrary"))
+    {
+        error = query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+void LibraryTransfer::writeRecord(QTextStream& out, const QString& table, const QVariantList& values)
+{
+    if(format == Json)
+    {
+        QJsonObject object;
+        QStringList names = fieldNames(table);
+
+        object.insert("table", table);
+
+        for(int i = 0; i < values.count(); i++)
+            object.insert(names.at(i), values.at(i).isNull() ? QJsonValue(QJsonValue::Null) : QJsonValue::fromVariant(values.at(i)));
+
+        out << QJsonDocument(object).toJson(QJsonDocument::Compact) << "\n";
+    }
+    else
+    {
+        out << table;
+
+        foreach(QVariant value, values)
+            out << "," << csvField(value);
+
+        out << "\n";
+    }
+}
+
+bool LibraryTransfer::readRecord(QTextStream& in, QString& table, QVariantList& values)
+{
+    QString text;
+
+    // skip empty lines
+    while(text.isEmpty())
+    {
+        if(in.atEnd())
+            return false;
+
+        text = in.readLine();
+        lineNumber++;
+    }
+
+    values.clear();
+
+    if(format == Json)
+    {
+        QJsonParseError parseError;
+        QJsonObject object = QJsonDocument::fromJson(text.toUtf8(), &parseError).object();
+
+        if(parseError.error != QJsonParseError::NoError)
+        {
+            error = QObject::tr("%1 at line %2.").arg(parseError.errorString()).arg(lineNumber);
+            return false;
+        }
+
+        table = object.value("table").toString();
+
+        foreach(QString name, fieldNames(table))
+            values << object.value(name).toVariant();
+    }
+    else
+    {
+        // quoted values may span several lines
+        while(text.count('"') % 2)
+        {
+            if(in.atEnd())
+            {
+                error = QObject::tr("Unterminated quoted value at line %1.").arg(lineNumber);
+                return false;
+            }
+
+            text += "\n" + in.readLine();
+            lineNumber++;
+        }
+
+        parseCsv(text, values);
+
+        table = values.isEmpty() ? QString() : values.takeFirst().toString();
+    }
+
+    int nFields = fieldNames(table).count();
+
+    if((nFields == 0) || (values.count() != nFields))
+    {
+        error = QObject::tr("Invalid record at line %1.").arg(lineNumber);
+        return false;
+    }
+
+    return true;
+}
+
+QString LibraryTransfer::csvField(const QVariant& value)
+{
+    // NULL is written as nothing, empty string as ""
+    if(value.isNull())
+        return QString();
+
+    QString text = value.toString();
+
+    if(text.isEmpty() || text.contains(',') || text.contains('"') || text.contains('\n') || text.contains('\r'))
+        return "\"" + text.replace("\"", "\"\"") + "\"";
+
+    return text;
+}
+
+bool LibraryTransfer::parseCsv(const QString& text, QVariantList& fields)
+{
+    QString field;
+    bool quoted = false;
+    bool inQuotes = false;
+
+    fields.clear();
+
+    for(int i = 0; i <= text.length(); i++)
+    {
+        if((i == text.length()) || (!inQuotes && (text.at(i) == ',')))
+        {
+            if(quoted)
+                fields << QVariant(field.isNull() ? QString("") : field);
+            else
+                fields << (field.isEmpty() ? QVariant() : QVariant(field));
+
+            field.clear();
+            quoted = false;
+
+            continue;
+        }
+
+        QChar c = text.at(i);
+
+        if(inQuotes)
+        {
+            if(c == '"')
+            {
+                // doubled quote is the quote itself
+                if((i + 1 < text.length()) && (text.at(i + 1) == '"'))
+                {
+                    field += c;
+                    i++;
+                }
+                else
+                {
+                    inQuotes = false;
+                }
+            }
+            else
+            {
+                field += c;
+            }
+        }
+        else if(c == '"')
+        {
+            inQuotes = true;
+            quoted = true;
+        }
+        else
+        {
+            field += c;
+        }
+    }
+
+    return !inQuotes;
+}
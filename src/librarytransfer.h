@@ -0,0 +1,102 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARYTRANSFER_H
+#define LIBRARYTRANSFER_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QAtomicInt>
+#include <QSqlDatabase>
+#include <QTextStream>
+
+// streaming export and import of the equipment library
+//
+// the file is a sequence of records, one per table row: CSV with the table
+// name in the first column or JSON lines with a "table" member; tags are
+// referenced by TagName so the files can be merged into any library
+class LibraryTransfer
+{
+public:
+    enum Format
+    {
+        Csv,
+        Json
+    };
+
+    explicit LibraryTransfer(Format fmt) : format(fmt), rows(0), cancelled(0), lineNumber(0) { }
+
+    // JSON for .json/.jsonl files, CSV otherwise
+    static Format formatForFile(const QString& fileName);
+
+    // write the library to the file, may run on a worker thread
+    bool exportLibrary(const QString& fileName);
+
+    // merge the file into the library in a single transaction, may run on a worker thread
+    bool importLibrary(const QString& fileName);
+
+    // number of records written or read so far
+    int rowsProcessed() const
+    {
+        return rows.load();
+    }
+
+    // stop at the next record, import is rolled back
+    void cancel()
+    {
+        cancelled.store(1);
+    }
+
+    QString errorString() const
+    {
+        return error;
+    }
+
+    // rows per prepared statement batch
+    static const int batchSize = 1000;
+
+    // version of the file layout
+    static const int formatVersion = 1;
+
+private:
+    // export single table
+    bool exportTable(QTextStream& out, QSqlDatabase& db, const QString& table, const QString& sql);
+
+    // write / read single record
+    void writeRecord(QTextStream& out, const QString& table, const QVariantList& values);
+    bool readRecord(QTextStream& in, QString& table, QVariantList& values);
+
+    // CSV helpers
+    static QString csvField(const QVariant& value);
+    static bool parseCsv(const QString& text, QVariantList& fields);
+
+    // record fields by table name
+    static QStringList fieldNames(const QString& table);
+
+    Format      format;
+    QAtomicInt  rows;
+    QAtomicInt  cancelled;
+    QString     error;
+    int         lineNumber;
+};
+
+#endif // LIBRARYTRANSFER_H
@@ -0,0 +1,451 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "metadataarchive.h"
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QAtomicInt>
+
+// Local includes
+
+#include "atomicwriter.h"
+
+// Exiv2 includes
+
+#include <exiv2/image.hpp>
+#include <exiv2/error.hpp>
+
+namespace
+{
+    // "AEB1"
+    const quint32 archiveMagic = 0x41454231;
+    // 2: image data hash
+    const quint32 archiveVersion = 2;
+
+    // jobs started in the same millisecond
+    QAtomicInt jobCounter;
+
+    Exiv2::Image::AutoPtr openImage(const QString& filePath)
+    {
+#ifdef Q_WS_WIN
+        // unicode paths are supported only in Windows verison
+        return Exiv2::ImageFactory::open(filePath.toStdWString());
+#else
+        // use UTF-8
+        return Exiv2::ImageFactory::open(filePath.toUtf8().data());
+#endif
+    }
+}
+
+const char* const MetadataArchive::folderName = ".analogexif-backup";
+const char* const MetadataArchive::fileSuffix = "aeb";
+
+MetadataArchive::MetadataArchive()
+    : m_jobId(newJobId())
+{
+}
+
+QString MetadataArchive::newJobId()
+{
+    return QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz") + QString("-%1").arg(jobCounter.fetchAndAddRelaxed(1));
+}
+
+MetadataArchive::~MetadataArchive()
+{
+    foreach(QFile* file, m_files)
+    {
+        file->close();
+        delete file;
+    }
+}
+
+QString MetadataArchive::filePath(const QString& archivePath, const Entry& entry)
+{
+    // archive sits in the hidden folder next to the files
+    return QFileInfo(archivePath).dir().absoluteFilePath("../" + entry.fileName);
+}
+
+bool MetadataArchive::tiffDataRanges(Exiv2::Image& image, qint64 fileSize, Ranges& ranges)
+{
+    const Exiv2::ExifData& exifData = image.exifData();
+
+    // strips or tiles of the main image
+    const char* const keys[][2] = {{"Exif.Image.StripOffsets", "Exif.Image.StripByteCounts"},
+                                   {"Exif.Image.TileOffsets", "Exif.Image.TileByteCounts"}};
+
+    for(int i = 0; i < 2; i++)
+    {
+        Exiv2::ExifData::const_iterator offsets = exifData.findKey(Exiv2::ExifKey(keys[i][0]));
+        Exiv2::ExifData::const_iterator counts = exifData.findKey(Exiv2::ExifKey(keys[i][1]));
+
+        if((offsets == exifData.end()) || (counts == exifData.end()) || (offsets->count() != counts->count()))
+            continue;
+
+        for(long j = 0; j < offsets->count(); j++)
+        {
+            qint64 offset = offsets->toLong(j);
+            qint64 length = counts->toLong(j);
+
+            if((offset < 0) || (length < 0) || (offset + length > fileSize))
+                return false;
+
+            ranges << qMakePair(offset, length);
+        }
+
+        return !ranges.isEmpty();
+    }
+
+    return false;
+}
+
+bool MetadataArchive::jpegDataRanges(QFile& file, Ranges& ranges)
+{
+    uchar marker[4];
+
+    if((file.read((char*)marker, 2) != 2) || (marker[0] != 0xff) || (marker[1] != 0xd8))
+        return false;
+
+    // the metadata segments come before the start of scan
+    while(file.read((char*)marker, 2) == 2)
+    {
+        if(marker[0] != 0xff)
+            return false;
+
+        // fill bytes
+        while(marker[1] == 0xff)
+        {
+            if(!file.getChar((char*)&marker[1]))
+                return false;
+        }
+
+        if(marker[1] == 0xda)
+        {
+            qint64 start = file.pos() - 2;
+            ranges << qMakePair(start, file.size() - start);
+
+            return true;
+        }
+
+        // markers without a length
+        if((marker[1] == 0x01) || ((marker[1] >= 0xd0) && (marker[1] <= 0xd7)))
+            continue;
+
+        if(file.read((char*)&marker[2], 2) != 2)
+            return false;
+
+        int length = (marker[2] << 8) | marker[3];
+
+        if((length < 2) || !file.seek(file.pos() + length - 2))
+            return false;
+    }
+
+    return false;
+}
+
+QByteArray MetadataArchive::payloadHash(const QString& filePath, Exiv2::Image& image)
+{
+    QFile file(filePath);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    Ranges ranges;
+    std::string mimeType = image.mimeType();
+
+    if(mimeType == "image/jpeg")
+        jpegDataRanges(file, ranges);
+    else if(!tiffDataRanges(image, file.size(), ranges))
+        ranges.clear();
+
+    // other formats keep metadata at the start, the end is image data
+    if(ranges.isEmpty())
+    {
+        qint64 start = qMax(file.size() - payloadHashBytes, (qint64)0);
+        ranges << qMakePair(start, file.size() - start);
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 total = 0;
+
+    foreach(const Ranges::value_type& range, ranges)
+    {
+        total += range.second;
+    }
+
+    hash.addData(QByteArray::number(total));
+
+    // the start and the end of the image data, a scan can be hundreds of MB
+    qint64 headLeft = qMin(total, (qint64)payloadHashBytes);
+    qint64 tailLeft = qMin(total - headLeft, (qint64)payloadHashBytes);
+
+    for(int i = 0; (i < ranges.count()) && (headLeft > 0); i++)
+    {
+        qint64 length = qMin(ranges.at(i).second, headLeft);
+
+        if(!file.seek(ranges.at(i).first))
+            return QByteArray();
+
+        hash.addData(file.read(length));
+        headLeft -= length;
+    }
+
+    Ranges tail;
+
+    for(int i = ranges.count() - 1; (i >= 0) && (tailLeft > 0); i--)
+    {
+        qint64 length = qMin(ranges.at(i).second, tailLeft);
+
+        tail.prepend(qMakePair(ranges.at(i).first + ranges.at(i).second - length, length));
+        tailLeft -= length;
+    }
+
+    foreach(const Ranges::value_type& range, tail)
+    {
+        if(!file.seek(range.first))
+            return QByteArray();
+
+        hash.addData(file.read(range.second));
+    }
+
+    return hash.result();
+}
+
+bool MetadataArchive::readEntry(const QString& filePath, Entry& entry)
+{
+    QFileInfo fInfo(filePath);
+
+    entry.fileName = fInfo.fileName();
+    entry.size = fInfo.size();
+    entry.modified = fInfo.lastModified().toMSecsSinceEpoch();
+
+    try
+    {
+        Exiv2::Image::AutoPtr image = openImage(filePath);
+
+        if((image.get() == 0) || (!image->good()))
+            return false;
+
+        image->readMetadata();
+
+        entry.payloadHash = payloadHash(filePath, *image);
+
+        if(!image->exifData().empty())
+        {
+            Exiv2::ByteOrder byteOrder = image->byteOrder();
+
+            if(byteOrder == Exiv2::invalidByteOrder)
+                byteOrder = Exiv2::littleEndian;
+
+            Exiv2::Blob blob;
+            Exiv2::ExifParser::encode(blob, byteOrder, image->exifData());
+
+            if(!blob.empty())
+                entry.exif = QByteArray((const char*)&blob[0], (int)blob.size());
+        }
+
+        if(!image->iptcData().empty())
+        {
+            Exiv2::DataBuf buf = Exiv2::IptcParser::encode(image->iptcData());
+
+            entry.iptc = QByteArray((const char*)buf.pData_, buf.size_);
+        }
+
+        // keep the packet as stored, not as re-encoded
+        entry.xmp = QByteArray(image->xmpPacket().data(), (int)image->xmpPacket().size());
+        entry.comment = QByteArray(image->comment().data(), (int)image->comment().size());
+    }
+    catch(Exiv2::AnyError& err)
+    {
+        qDebug("AnalogExif: MetadataArchive::readEntry(%s) Exiv2 exception (%d) = %s", filePath.toStdString().c_str(), err.code(), err.what());
+        return false;
+    }
+
+    return true;
+}
+
+QFile* MetadataArchive::archiveFile(const QString& folder)
+{
+    QFile* file = m_files.value(folder);
+
+    if(file)
+        return file;
+
+    QDir dir(folder);
+
+    if(!dir.mkpath(folderName))
+        return 0;
+
+    QString archivePath = dir.absoluteFilePath(QString("%1/%2.%3").arg(folderName).arg(m_jobId).arg(fileSuffix));
+
+    // a job of another process with the same id, never mix two jobs
+    for(int i = 1; QFile::exists(archivePath); i++)
+        archivePath = dir.absoluteFilePath(QString("%1/%2-%3.%4").arg(folderName).arg(m_jobId).arg(i).arg(fileSuffix));
+
+    file = new QFile(archivePath);
+
+    if(!file->open(QIODevice::WriteOnly))
+    {
+        delete file;
+        return 0;
+    }
+
+    QDataStream out(file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << archiveMagic << archiveVersion;
+
+    // the new archive has to be found after a power loss as well
+    if(!AtomicWriter::syncFile(*file) || !AtomicWriter::syncPath(dir.absoluteFilePath(folderName)))
+    {
+        file->close();
+        file->remove();
+        delete file;
+        return 0;
+    }
+
+    m_files.insert(folder, file);
+
+    return file;
+}
+
+bool MetadataArchive::store(const QString& filePath)
+{
+    Entry entry;
+
+    // the slow part runs unlocked
+    if(!readEntry(filePath, entry))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+
+    QFile* const file = archiveFile(QFileInfo(filePath).absolutePath());
+
+    if(!file)
+        return false;
+
+    QDataStream out(file);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << entry.fileName << entry.size << entry.modified << entry.payloadHash
+        << entry.exif << entry.iptc << entry.xmp << entry.comment;
+
+    // the entry must be on disk before the file is modified
+    return ((out.status() == QDataStream::Ok) && AtomicWriter::syncFile(*file));
+}
+
+bool MetadataArchive::read(const QString& archivePath, QList<Entry>& entries)
+{
+    QFile file(archivePath);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+
+    in >> magic >> version;
+
+    if((magic != archiveMagic) || (version != archiveVersion))
+        return false;
+
+    while(!in.atEnd())
+    {
+        Entry entry;
+
+        in >> entry.fileName >> entry.size >> entry.modified >> entry.payloadHash
+           >> entry.exif >> entry.iptc >> entry.xmp >> entry.comment;
+
+        // a job interrupted while writing leaves a truncated last entry
+        if(in.status() != QDataStream::Ok)
+        {
+            qDebug("AnalogExif: MetadataArchive::read(%s) truncated entry skipped", qPrintable(archivePath));
+            break;
+        }
+
+        entries << entry;
+    }
+
+    return true;
+}
+
+MetadataArchive::RestoreStatus MetadataArchive::restore(const QString& archivePath, const Entry& entry, bool force)
+{
+    QString fileName = filePath(archivePath, entry);
+
+    if(!QFile::exists(fileName))
+        return FileMissing;
+
+    try
+    {
+        Exiv2::Image::AutoPtr image = openImage(fileName);
+
+        if((image.get() == 0) || (!image->good()))
+            return RestoreFailed;
+
+        if(!force)
+        {
+            image->readMetadata();
+
+            if(payloadHash(fileName, *image) != entry.payloadHash)
+                return PayloadChanged;
+        }
+
+        Exiv2::ExifData exifData;
+        Exiv2::IptcData iptcData;
+        Exiv2::XmpData xmpData;
+
+        if(!entry.exif.isEmpty())
+            Exiv2::ExifParser::decode(exifData, (const Exiv2::byte*)entry.exif.constData(), entry.exif.size());
+
+        if(!entry.iptc.isEmpty() && (Exiv2::IptcParser::decode(iptcData, (const Exiv2::byte*)entry.iptc.constData(), entry.iptc.size()) != 0))
+            return RestoreFailed;
+
+        if(!entry.xmp.isEmpty() && (Exiv2::XmpParser::decode(xmpData, std::string(entry.xmp.constData(), entry.xmp.size())) != 0))
+            return RestoreFailed;
+
+        image->setExifData(exifData);
+
+        if(image->supportsMetadata(Exiv2::mdIptc))
+            image->setIptcData(iptcData);
+
+        if(image->supportsMetadata(Exiv2::mdXmp))
+            image->setXmpData(xmpData);
+
+        if(image->supportsMetadata(Exiv2::mdComment))
+            image->setComment(std::string(entry.comment.constData(), entry.comment.size()));
+
+        image->writeMetadata();
+    }
+    catch(Exiv2::AnyError& err)
+    {
+        qDebug("AnalogExif: MetadataArchive::restore(%s) Exiv2 exception (%d) = %s", fileName.toStdString().c_str(), err.code(), err.what());
+        return RestoreFailed;
+    }
+
+    return Restored;
+}
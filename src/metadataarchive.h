@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef METADATAARCHIVE_H
+#define METADATAARCHIVE_H
+
+// Qt includes
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+
+class QFile;
+
+namespace Exiv2
+{
+    class Image;
+}
+
+// metadata-only backups
+//
+// instead of a full copy of the image, only the original Exif, IPTC and XMP
+// blocks and the comment are kept, together with the size, modification time
+// and a hash of the image data to spot a replaced image on restore
+//
+// the image data are the strips or tiles of TIFF files and the scan data of
+// JPEG files, which stay the same when Exiv2 rewrites the metadata; other
+// formats use the end of the file
+//
+// every batch job writes one archive per folder:
+// <folder>/.analogexif-backup/<job id>.aeb
+class MetadataArchive
+{
+public:
+    // original metadata of a single file
+    struct Entry
+    {
+        Entry()
+            : size(0),
+              modified(0)
+        {
+        }
+
+        // relative to the folder of the archive
+        QString     fileName;
+        qint64      size;
+        // msecs since epoch, UTC
+        qint64      modified;
+        QByteArray  payloadHash;
+
+        QByteArray  exif;
+        QByteArray  iptc;
+        QByteArray  xmp;
+        QByteArray  comment;
+    };
+
+    enum RestoreStatus
+    {
+        Restored,
+        FileMissing,
+        // image data differs from the backed up file
+        PayloadChanged,
+        RestoreFailed
+    };
+
+    // start a new job, named after the current time and unique in the process
+    MetadataArchive();
+    ~MetadataArchive();
+
+    QString jobId() const
+    {
+        return m_jobId;
+    }
+
+    // current time plus a counter, unique in the process; shared with the backup store
+    static QString newJobId();
+
+    // append original metadata of the file to the archive of its folder,
+    // can be called from several threads
+    bool store(const QString& filePath);
+
+    // read all complete entries of the archive file
+    static bool read(const QString& archivePath, QList<Entry>& entries);
+
+    // write the metadata of the entry back to its file next to the archive folder,
+    // the image data is checked first unless force is set
+    static RestoreStatus restore(const QString& archivePath, const Entry& entry, bool force = false);
+
+    // file the entry was stored for
+    static QString filePath(const QString& archivePath, const Entry& entry);
+
+    // hidden archive folder inside every backed up folder
+    static const char* const folderName;
+    static const char* const fileSuffix;
+
+    // bytes hashed from the start and the end of the image data
+    static const int payloadHashBytes = 64 * 1024;
+
+private:
+    Q_DISABLE_COPY(MetadataArchive)
+
+    // fill entry from the file, no locking needed
+    static bool readEntry(const QString& filePath, Entry& entry);
+
+    // file ranges holding the image data
+    typedef QList<QPair<qint64, qint64> > Ranges;
+
+    // hash of the image data, image with its metadata read
+    static QByteArray payloadHash(const QString& filePath, Exiv2::Image& image);
+
+    static bool tiffDataRanges(Exiv2::Image& image, qint64 fileSize, Ranges& ranges);
+    static bool jpegDataRanges(QFile& file, Ranges& ranges);
+
+    // opened archive of the folder, guarded by m_mutex
+    QFile* archiveFile(const QString& folder);
+
+    QString                 m_jobId;
+
+    QMutex                  m_mutex;
+    QHash<QString, QFile*>  m_files;
+};
+
+#endif // METADATAARCHIVE_H
@@ -20,6 +20,7 @@
 #include "optgeartemplatemodel.h"
 #include "exiftreemodel.h"
 #include "exifitem.h"
+#include "choicelist.h"
 
 #include <QFont>
 #include <QSqlQuery>
@@ -29,7 +30,34 @@
 void OptGearTemplateModel::reload(int id)
 {
     gearId = id;
-    setQuery(QString("SELECT a.OrderBy, b.TagName, b.TagText, b.TagType, b.PrintFormat, b.Flags, b.id, a.id, b.AltTag FROM GearTemplate a, MetaTags b WHERE a.GearType = %1 AND b.id = a.TagId ORDER BY a.OrderBy").arg(id));
+
+    beginResetModel();
+
+    rows.clear();
+
+    // read the whole template once, all roles are served from memory
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.exec(QString("SELECT a.OrderBy, b.TagName, b.TagText, b.TagType, b.PrintFormat, b.Flags, b.id, a.id, b.AltTag FROM GearTemplate a, MetaTags b WHERE a.GearType = %1 AND b.id = a.TagId ORDER BY a.OrderBy").arg(id));
+
+    while(query.next())
+    {
+        TemplateRow row;
+
+        row.orderBy     = query.value(0).toInt();
+        row.tagName     = query.value(1).toString();
+        row.tagText     = query.value(2).toString();
+        row.tagType     = query.value(3).toInt();
+        row.printFormat = query.value(4).toString();
+        row.flags       = query.value(5).toInt();
+        row.tagId       = query.value(6).toInt();
+        row.templateId  = query.value(7).toInt();
+        row.altTag      = query.value(8).toString();
+
+        rows.append(row);
+    }
+
+    endResetModel();
 }
 
 Qt::ItemFlags OptGearTemplateModel::flags(const QModelIndex &index) const
@@ -39,16 +67,18 @@ Qt::ItemFlags OptGearTemplateModel::flags(const QModelIndex &index) const
 
     // protect minimum db setup
 
-    if(!query().seek(index.row()))
+    if(index.row() >= rows.count())
         return 0;
 
-    if(ProtectBuiltInTags && ((ExifItem::TagFlags)query().value(5).toInt()).testFlag(ExifItem::Protected))
+    ExifItem::TagFlags tagFlags = (ExifItem::TagFlags)rows.at(index.row()).flags;
+
+    if(ProtectBuiltInTags && tagFlags.testFlag(ExifItem::Protected))
     {
         if((index.column() != 1) && (index.column() != 2) && (index.column() != 4))
             return Qt::ItemIsSelectable;
 
         // protect selection values from edit as well
-        if(((ExifItem::TagFlags)query().value(5).toInt()).testFlag(ExifItem::Choice) && (index.column() == 4))
+        if(tagFlags.testFlag(ExifItem::Choice) && (index.column() == 4))
             return Qt::ItemIsSelectable;
     }
 
@@ -57,9 +87,11 @@ Qt::ItemFlags OptGearTemplateModel::flags(const QModelIndex &index) const
 
 QVariant OptGearTemplateModel::data(const QModelIndex &index, int role) const
 {
-    if(!index.isValid())
+    if(!index.isValid() || (index.row() >= rows.count()))
         return QVariant();
 
+    const TemplateRow& row = rows.at(index.row());
+
     if(role == Qt::TextAlignmentRole)
     {
         switch(index.column())
@@ -72,50 +104,25 @@ QVariant OptGearTemplateModel::data(const QModelIndex &index, int role) const
     }
 
     if(role == GetTagId)
-    {
-        if(!query().seek(index.row()))
-            return QVariant();
-
-        return query().value(6).toInt();
-    }
+        return row.tagId;
 
     if(role == GetTagFlagsRole)
-    {
-        if(!query().seek(index.row()))
-            return QVariant();
-
-        return query().value(5).toInt();
-    }
+        return row.flags;
 
     if(role == GetAltTagRole)
-    {
-        if(!query().seek(index.row()))
-            return QVariant();
-
-        return query().value(8).toString();
-    }
+        return row.altTag;
 
     if(role == GetTagTypeRole)
-    {
-        if(!query().seek(index.row()))
-            return QVariant();
-
-        return query().value(3).toInt();
-    }
-
-    QVariant v = QSqlQueryModel::data(index, role);
+        return row.tagType;
 
     if(((role == Qt::ToolTipRole) || (role == Qt::DisplayRole)) && (index.column() == 1))
     {
-        if(!query().seek(index.row()))
-            return QVariant();
+        QString text = row.tagName;
 
-        QString text = query().value(1).toString();
-
-        if(((ExifItem::TagFlags)query().value(5).toInt()).testFlag(ExifItem::AsciiAlt))
+        if(((ExifItem::TagFlags)row.flags).testFlag(ExifItem::AsciiAlt))
         {
-            if(query().value(8).toString() != "")
-                text += " (" + query().value(8).toString() + ")";
+            if(row.altTag != "")
+                text += " (" + row.altTag + ")";
         }
 
         return text;
@@ -126,8 +133,7 @@ QVariant OptGearTemplateModel::data(const QModelIndex &index, int role) const
         // special care for tag type
         if(role == Qt::DisplayRole)
         {
-            if(v != QVariant())
-                return ExifItem::typeName((ExifItem::TagType)v.toInt());
+            return ExifItem::typeName((ExifItem::TagType)row.tagType);
         }
         else if(role == Qt::FontRole)
         {
@@ -140,10 +146,8 @@ QVariant OptGearTemplateModel::data(const QModelIndex &index, int role) const
 
     if(index.column() == 4)
     {
-        ExifItem::TagFlags flags = (ExifItem::TagFlags)data(index, GetTagFlagsRole).toInt();
-
         // special care for select values
-        if(flags.testFlag(ExifItem::Choice))
+        if(((ExifItem::TagFlags)row.flags).testFlag(ExifItem::Choice))
         {
             if(role == Qt::DisplayRole)
             {
@@ -152,14 +156,31 @@ QVariant OptGearTemplateModel::data(const QModelIndex &index, int role) const
         }
     }
 
-    return v;
+    if((role != Qt::DisplayRole) && (role != Qt::EditRole))
+        return QVariant();
+
+    switch(index.column())
+    {
+    case 0:
+        return row.orderBy;
+    case 1:
+        return row.tagName;
+    case 2:
+        return row.tagText;
+    case 3:
+        return row.tagType;
+    case 4:
+        return row.printFormat;
+    }
+
+    return QVariant();
 }
 
 // header information
 QVariant OptGearTemplateModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     if(((role != Qt::DisplayRole) && (role != Qt::FontRole) && (role != Qt::ToolTipRole)) || (orientation != Qt::Horizontal))
-        return QSqlQueryModel::headerData(section, orientation, role);
+        return QAbstractTableModel::headerData(section, orientation, role);
 
     if(role == Qt::FontRole)
     {
@@ -216,14 +237,14 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
     if (role != Qt::EditRole)
         return false;
 
-    if(!query().seek(index.row()))
+    if(!index.isValid() || (index.row() >= rows.count()))
         return false;
 
-    int id = query().value(6).toInt();
+    TemplateRow row = rows.at(index.row());
 
     if(value == QVariant())
     {
-        if((index.column() == 1) && query().value(1).toString().isEmpty())
+        if((index.column() == 1) && row.tagName.isEmpty())
         {
             // remove cancelled tag
             removeTag(index);
@@ -237,10 +258,12 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
 
     if(index.column() == 0)
     {
-        if(query().value(0).toInt() == value.toInt())
+        if(row.orderBy == value.toInt())
             return false;
 
-        queryStr = QString("UPDATE GearTemplate SET OrderBy = %1 WHERE id = %2").arg(value.toInt()).arg(query().value(7).toInt());
+        queryStr = QString("UPDATE GearTemplate SET OrderBy = %1 WHERE id = %2").arg(value.toInt()).arg(row.templateId);
+
+        row.orderBy = value.toInt();
     }
     else
     {
@@ -258,11 +281,11 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
                     return false;
 
                 // TODO: bad, should be checked in item delegate
-                if((query().value(1).toString() == vallist.at(0).toString()) && (query().value(5).toInt() == vallist.at(1).toInt()))
+                if((row.tagName == vallist.at(0).toString()) && (row.flags == vallist.at(1).toInt()))
                 {
                     if(((ExifItem::TagFlags)vallist.at(1).toInt()).testFlag(ExifItem::AsciiAlt))
                     {
-                        if(query().value(8).toString() == vallist.at(2).toString())
+                        if(row.altTag == vallist.at(2).toString())
                             return false;
                     }
                     else
@@ -271,41 +294,54 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
                     }
                 }
 
-                queryStr += QString("TagName = '%1', Flags = %2").arg(vallist.at(0).toString().remove(QRegExp("(\\s?)")).replace("'", "''")).arg(vallist.at(1).toInt());
+                row.tagName = vallist.at(0).toString().remove(QRegExp("(\\s?)"));
+                row.flags = vallist.at(1).toInt();
 
-                if(((ExifItem::TagFlags)vallist.at(1).toInt()).testFlag(ExifItem::AsciiAlt))
+                queryStr += QString("TagName = '%1', Flags = %2").arg(QString(row.tagName).replace("'", "''")).arg(row.flags);
+
+                if(((ExifItem::TagFlags)row.flags).testFlag(ExifItem::AsciiAlt))
                 {
-                    queryStr += QString(", AltTag = '%1'").arg(vallist.at(2).toString().remove(QRegExp("(\\s?)")).replace("'", "''"));
+                    row.altTag = vallist.at(2).toString().remove(QRegExp("(\\s?)"));
+
+                    queryStr += QString(", AltTag = '%1'").arg(QString(row.altTag).replace("'", "''"));
                 }
                 else
                 {
                     // empty alt tag otherwise
+                    row.altTag = "";
+
                     queryStr += QString(", AltTag = ''");
                 }
             }
             break;
         case 2:
             {
-                if(query().value(2).toString() == value.toString())
+                if(row.tagText == value.toString())
                     return false;
 
-                queryStr += QString("TagText = '%1'").arg(value.toString().replace("'", "''"));
+                row.tagText = value.toString();
+
+                queryStr += QString("TagText = '%1'").arg(QString(row.tagText).replace("'", "''"));
             }
             break;
         case 3:
             {
-                if(query().value(3).toInt() == value.toInt())
+                if(row.tagType == value.toInt())
                     return false;
 
-                queryStr += QString("TagType = %1").arg(value.toInt());
+                row.tagType = value.toInt();
+
+                queryStr += QString("TagType = %1").arg(row.tagType);
             }
             break;
         case 4:
             {
-                if(query().value(4).toString() == value.toString())
+                if(row.printFormat == value.toString())
                     return false;
 
-                queryStr += QString("PrintFormat = '") + value.toString().replace("'", "''") +"'";
+                row.printFormat = value.toString();
+
+                queryStr += QString("PrintFormat = '") + QString(row.printFormat).replace("'", "''") +"'";
             }
             break;
         default:
@@ -313,7 +349,7 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
             break;
         }
 
-        queryStr += QString(" WHERE id = ") + QString::number(id);
+        queryStr += QString(" WHERE id = ") + QString::number(row.tagId);
     }
 
     QSqlQuery updQuery(queryStr);
@@ -321,9 +357,22 @@ bool OptGearTemplateModel::setData(const QModelIndex &index, const QVariant &val
     if(updQuery.lastError().isValid())
         return false;
 
-    emit dataChanged(index, index);
+    // new order requires re-sorting, everything else is updated in place
+    if(index.column() == 0)
+    {
+        emit dataChanged(index, index);
 
-    reload();
+        reload();
+    }
+    else
+    {
+        rows[index.row()] = row;
+
+        // tag format, type or flags could have changed
+        ChoiceList::clearCache();
+
+        emit dataChanged(this->index(index.row(), 0), this->index(index.row(), columnCount() - 1));
+    }
 
     return true;
 }
@@ -388,19 +437,16 @@ void OptGearTemplateModel::swapOrderBys(const QModelIndex& idx1, const QModelInd
     if(!idx1.isValid() || !idx2.isValid())
         return;
 
-    // get id and orderby values of the first index
-    if(!query().seek(idx1.row()))
+    if((idx1.row() >= rows.count()) || (idx2.row() >= rows.count()))
         return;
 
-    int tagId1 = query().value(7).toInt();
-    int orderBy1 = query().value(0).toInt();
+    // get id and orderby values of the first index
+    int tagId1 = rows.at(idx1.row()).templateId;
+    int orderBy1 = rows.at(idx1.row()).orderBy;
 
     // get id and orderby values of the second index
-    if(!query().seek(idx2.row()))
-        return;
-
-    int tagId2 = query().value(7).toInt();
-    int orderBy2 = query().value(0).toInt();
+    int tagId2 = rows.at(idx2.row()).templateId;
+    int orderBy2 = rows.at(idx2.row()).orderBy;
 
     // update database
     QSqlQuery updQuery(QString("UPDATE GearTemplate SET OrderBy = %1 WHERE id = %2").arg(orderBy2).arg(tagId1));
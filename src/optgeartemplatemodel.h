@@ -20,16 +20,22 @@
 #ifndef OPTGEARTEMPLATEMODEL_H
 #define OPTGEARTEMPLATEMODEL_H
 
-#include <QSqlQueryModel>
+#include <QAbstractTableModel>
+#include <QVector>
 #include "exifitem.h"
 
-class OptGearTemplateModel : public QSqlQueryModel
+class OptGearTemplateModel : public QAbstractTableModel
 {
     Q_OBJECT
 
 public:
-    OptGearTemplateModel(QObject *parent) : QSqlQueryModel(parent) { }
-    
+    OptGearTemplateModel(QObject *parent) : QAbstractTableModel(parent), gearId(0) { }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : rows.count();
+    }
+
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
     Qt::ItemFlags flags(const QModelIndex &index) const;
@@ -71,6 +77,23 @@ public:
     static const bool ProtectBuiltInTags = true;
 
 private:
+    // template row as loaded from the database
+    struct TemplateRow
+    {
+        int     orderBy;
+        QString tagName;
+        QString tagText;
+        int     tagType;
+        QString printFormat;
+        int     flags;
+        int     tagId;
+        int     templateId;
+        QString altTag;
+    };
+
+    // rows of the current gear type, in display order
+    QVector<TemplateRow> rows;
+
     int gearId;
 };
 
@@ -0,0 +1,466 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "previewscheduler.h"
+
+// Qt includes
+
+#include <QRunnable>
+#include <QImageReader>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+
+// Local includes
+
+#include "exiftreemodel.h"
+#include "fileiconprovider.h"
+#include "thumbnailcache.h"
+
+namespace
+{
+    // full-page decodes beyond maxDecodeBytes run one at a time
+    QMutex largeDecodeMutex;
+}
+
+// single preview request
+class PreviewTask : public QRunnable
+{
+public:
+
+    PreviewTask(PreviewScheduler* const scheduler, int generation, const QString& filePath, const QByteArray& embeddedPreview)
+        : m_scheduler(scheduler),
+          m_generation(generation),
+          m_filePath(filePath),
+          m_embeddedPreview(embeddedPreview)
+    {
+    }
+
+    void run()
+    {
+        if(!m_scheduler->isCurrent(m_generation))
+            return;
+
+        QImage source = m_scheduler->render(m_generation, m_filePath, m_embeddedPreview);
+
+        if(source.isNull() || !m_scheduler->isCurrent(m_generation))
+            return;
+
+        QVector<QImage> pyramid = PreviewScheduler::buildPyramid(source);
+
+        if(!m_scheduler->setPyramid(m_generation, m_filePath, pyramid))
+            return;
+
+        // the view may have been resized while loading
+        QImage preview = PreviewScheduler::scaleFromPyramid(pyramid, m_scheduler->targetSize());
+
+        if(!m_scheduler->isCurrent(m_generation))
+            return;
+
+        QMetaObject::invokeMethod(m_scheduler, "deliver", Qt::QueuedConnection,
+                                  Q_ARG(int, m_generation), Q_ARG(QString, m_filePath), Q_ARG(QImage, preview));
+    }
+
+private:
+
+    PreviewScheduler*   m_scheduler;
+    int                 m_generation;
+    QString             m_filePath;
+    QByteArray          m_embeddedPreview;
+};
+
+// rescale of the loaded preview
+class PreviewScaleTask : public QRunnable
+{
+public:
+
+    PreviewScaleTask(PreviewScheduler* const scheduler, int generation, int scaleGeneration,
+                     const QString& filePath, const QVector<QImage>& pyramid, const QSize& targetSize)
+        : m_scheduler(scheduler),
+          m_generation(generation),
+          m_scaleGeneration(scaleGeneration),
+          m_filePath(filePath),
+          m_pyramid(pyramid),
+          m_targetSize(targetSize)
+    {
+    }
+
+    void run()
+    {
+        if(!m_scheduler->isCurrentScale(m_scaleGeneration))
+            return;
+
+        QImage preview = PreviewScheduler::scaleFromPyramid(m_pyramid, m_targetSize);
+
+        if(!m_scheduler->isCurrentScale(m_scaleGeneration))
+            return;
+
+        QMetaObject::invokeMethod(m_scheduler, "deliver", Qt::QueuedConnection,
+                                  Q_ARG(int, m_generation), Q_ARG(QString, m_filePath), Q_ARG(QImage, preview));
+    }
+
+private:
+
+    PreviewScheduler*   m_scheduler;
+    int                 m_generation;
+    int                 m_scaleGeneration;
+    QString             m_filePath;
+    QVector<QImage>     m_pyramid;
+    QSize               m_targetSize;
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+PreviewScheduler::PreviewScheduler(ExifTreeModel* const model, QObject* const parent)
+    : QObject(parent),
+      m_model(model),
+      m_generation(0)
+{
+    m_pool.setMaxThreadCount(maxThreads);
+}
+
+PreviewScheduler::~PreviewScheduler()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void PreviewScheduler::request(const QString& filePath, const QByteArray& embeddedPreview, const QSize& targetSize)
+{
+    // supersede everything requested so far
+    int generation = m_generation.fetchAndAddOrdered(1) + 1;
+    m_pool.clear();
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_targetSize = targetSize;
+        m_pyramid.clear();
+        m_pyramidPath.clear();
+    }
+
+    m_pool.start(new PreviewTask(this, generation, filePath, embeddedPreview));
+}
+
+void PreviewScheduler::cancel()
+{
+    m_generation.ref();
+    m_pool.clear();
+
+    QMutexLocker locker(&m_mutex);
+
+    m_pyramid.clear();
+    m_pyramidPath.clear();
+}
+
+void PreviewScheduler::resize(const QSize& targetSize)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_targetSize = targetSize;
+
+    // still loading, the load task picks the new size up
+    if(m_pyramid.isEmpty())
+        return;
+
+    int scaleGeneration = m_scaleGeneration.fetchAndAddOrdered(1) + 1;
+
+    m_pool.start(new PreviewScaleTask(this, m_generation.load(), scaleGeneration, m_pyramidPath, m_pyramid, targetSize), 1);
+}
+
+QSize PreviewScheduler::targetSize() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_targetSize;
+}
+
+bool PreviewScheduler::setPyramid(int generation, const QString& filePath, const QVector<QImage>& pyramid)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(!isCurrent(generation))
+        return false;
+
+    m_pyramid     = pyramid;
+    m_pyramidPath = filePath;
+
+    return true;
+}
+
+QImage PreviewScheduler::decodeScaled(const QString& filePath, int maxSize)
+{
+    QImageReader reader(filePath);
+    QSize fullSize = reader.size();
+
+    if(!fullSize.isValid())
+    {
+        QImage image;
+
+        // size not known in advance, nothing to optimize
+        if(!reader.read(&image))
+            qDebug("AnalogExif: PreviewScheduler::decodeScaled(%s) unable to read: %s", qPrintable(filePath), qPrintable(reader.errorString()));
+
+        return image;
+    }
+
+    int page = 0;
+
+    // multi-page (e.g. pyramidal TIFF) - pick the smallest page still covering maxSize
+    if(reader.imageCount() > 1)
+    {
+        int bestPage = 0;
+        QSize bestSize = fullSize;
+
+        for(int i = 1; i < reader.imageCount(); i++)
+        {
+            if(!reader.jumpToImage(i))
+                break;
+
+            QSize pageSize = reader.size();
+
+            // reduced-resolution pages keep the aspect ratio
+            if(!pageSize.isValid() || (pageSize.width() * fullSize.height() != pageSize.height() * fullSize.width()))
+                continue;
+
+            if((qMax(pageSize.width(), pageSize.height()) >= maxSize) && (pageSize.width() < bestSize.width()))
+            {
+                bestPage = i;
+                bestSize = pageSize;
+            }
+        }
+
+        reader.jumpToImage(bestPage);
+        page = bestPage;
+        fullSize = bestSize;
+
+        if(bestPage != 0)
+            qDebug("AnalogExif: PreviewScheduler::decodeScaled(%s) using page %d (%dx%d)", qPrintable(filePath), bestPage, fullSize.width(), fullSize.height());
+    }
+
+    QSize scaledSize = fullSize;
+
+    if(qMax(fullSize.width(), fullSize.height()) > maxSize)
+        scaledSize = fullSize.scaled(maxSize, maxSize, Qt::KeepAspectRatio);
+
+    // estimate peak memory: handlers without native scaling (e.g. TIFF) decode
+    // the full page first, JPEG scales in the DCT domain (up to 8x)
+    int bitsPerPixel = qMax(32, (int)QImage::toPixelFormat(reader.imageFormat()).bitsPerPixel());
+    qint64 scaledBytes = (qint64)scaledSize.width() * scaledSize.height() * bitsPerPixel / 8;
+    qint64 decodedBytes = (qint64)fullSize.width() * fullSize.height() * bitsPerPixel / 8;
+
+    if(reader.supportsOption(QImageIOHandler::ScaledSize))
+        decodedBytes = qMax(scaledBytes, decodedBytes / 64);
+
+    qint64 peakBytes = decodedBytes + scaledBytes;
+
+    qDebug("AnalogExif: PreviewScheduler::decodeScaled(%s) %dx%d -> %dx%d, estimated peak %lld KiB",
+           qPrintable(filePath), fullSize.width(), fullSize.height(), scaledSize.width(), scaledSize.height(), peakBytes / 1024);
+
+    bool largeDecode = (peakBytes > maxDecodeBytes);
+
+    if(largeDecode)
+    {
+        // too large in one go - decode the page in bands, each scaled on its own
+        if(reader.supportsOption(QImageIOHandler::ClipRect))
+            return decodeBands(filePath, page, fullSize, scaledSize, bitsPerPixel);
+
+        // the decoder needs the whole page, the peak stays at a single such decode
+        qDebug("AnalogExif: PreviewScheduler::decodeScaled(%s) exceeds the %lld KiB limit, decoding exclusively", qPrintable(filePath), maxDecodeBytes / 1024);
+    }
+
+    // a null mutex is not locked
+    QMutexLocker locker(largeDecode ? &largeDecodeMutex : 0);
+
+    if(scaledSize != fullSize)
+        reader.setScaledSize(scaledSize);
+
+    QImage image;
+
+    if(!reader.read(&image))
+    {
+        qDebug("AnalogExif: PreviewScheduler::decodeScaled(%s) unable to read: %s", qPrintable(filePath), qPrintable(reader.errorString()));
+        return QImage();
+    }
+
+    return image;
+}
+
+QImage PreviewScheduler::decodeBands(const QString& filePath, int page, const QSize& fullSize, const QSize& scaledSize, int bitsPerPixel)
+{
+    // page rows per band, half of the budget left for the scaled band and the result
+    qint64 rowBytes = (qint64)fullSize.width() * bitsPerPixel / 8;
+    qint64 bandRows = qBound<qint64>(1, maxDecodeBytes / 2 / rowBytes, fullSize.height());
+    int scaledBandRows = qMax(1, (int)(bandRows * scaledSize.height() / fullSize.height()));
+
+    qDebug("AnalogExif: PreviewScheduler::decodeBands(%s) %d scaled row(s) per band", qPrintable(filePath), scaledBandRows);
+
+    QImage result(scaledSize, QImage::Format_ARGB32_Premultiplied);
+    result.fill(Qt::transparent);
+
+    QPainter painter(&result);
+
+    for(int scaledTop = 0; scaledTop < scaledSize.height(); scaledTop += scaledBandRows)
+    {
+        // bands end on page rows mapping to whole scaled rows, no seams
+        int scaledBottom = qMin(scaledTop + scaledBandRows, scaledSize.height());
+        int top = (int)((qint64)scaledTop * fullSize.height() / scaledSize.height());
+        int bottom = (int)((qint64)scaledBottom * fullSize.height() / scaledSize.height());
+
+        // one reader per band, handlers read each page once
+        QImageReader reader(filePath);
+
+        if((page > 0) && !reader.jumpToImage(page))
+            return QImage();
+
+        reader.setClipRect(QRect(0, top, fullSize.width(), bottom - top));
+        reader.setScaledSize(QSize(scaledSize.width(), scaledBottom - scaledTop));
+
+        QImage band;
+
+        if(!reader.read(&band))
+        {
+            qDebug("AnalogExif: PreviewScheduler::decodeBands(%s) unable to read: %s", qPrintable(filePath), qPrintable(reader.errorString()));
+            return QImage();
+        }
+
+        painter.drawImage(0, scaledTop, band);
+    }
+
+    painter.end();
+
+    return result;
+}
+
+QVector<QImage> PreviewScheduler::buildPyramid(const QImage& source)
+{
+    QVector<QImage> pyramid;
+    QImage level = source;
+
+    // full decodes can be huge, nothing larger is ever shown
+    if(qMax(level.width(), level.height()) > maxSourceSize)
+        level = level.scaled(maxSourceSize, maxSourceSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    pyramid.append(level);
+
+    // halve down to the thumbnail size, each step is cheap
+    while(qMax(level.width(), level.height()) >= 2 * FileIconProvider::thumbnailSize)
+    {
+        level = level.scaled(level.width() / 2, level.height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        pyramid.append(level);
+    }
+
+    return pyramid;
+}
+
+QImage PreviewScheduler::scaleFromPyramid(const QVector<QImage>& pyramid, const QSize& targetSize)
+{
+    if(pyramid.isEmpty())
+        return QImage();
+
+    if(!targetSize.isValid())
+        return pyramid.first();
+
+    QSize fitted = pyramid.first().size().scaled(targetSize, Qt::KeepAspectRatio);
+
+    // smallest level still covering the target, at most 2x downscale left
+    int level = 0;
+
+    while((level + 1 < pyramid.count()) &&
+          (pyramid.at(level + 1).width() >= fitted.width()) && (pyramid.at(level + 1).height() >= fitted.height()))
+        level++;
+
+    return pyramid.at(level).scaled(fitted, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void PreviewScheduler::deliver(int generation, const QString& filePath, const QImage& preview)
+{
+    // the selection may have changed while the result was queued
+    if(!isCurrent(generation))
+        return;
+
+    emit previewReady(filePath, preview);
+}
+
+QImage PreviewScheduler::render(int generation, const QString& filePath, const QByteArray& embeddedPreview)
+{
+    ExifTreeModel::PreviewSource source = ExifTreeModel::PreviewNone;
+    QImage preview;
+
+    // embedded preview is the cheapest one of the right size,
+    // tiny Exif thumbnails are worse than the rendered ones though
+    if(!embeddedPreview.isEmpty() && preview.loadFromData(embeddedPreview))
+    {
+        if(qMax(preview.width(), preview.height()) >= FileIconProvider::thumbnailSize)
+            source = ExifTreeModel::PreviewEmbedded;
+        else
+            preview = QImage();
+    }
+
+    // try the thumbnail cache, then render the preview
+    if(preview.isNull())
+    {
+        preview = ThumbnailCache::find(filePath);
+
+        if(!preview.isNull())
+            source = ExifTreeModel::PreviewCache;
+    }
+
+    if(preview.isNull())
+    {
+        if(!isCurrent(generation))
+            return QImage();
+
+        preview = m_model->getPreview(filePath);
+
+        if(!preview.isNull())
+        {
+            source = ExifTreeModel::PreviewThumbnailer;
+            ThumbnailCache::insert(filePath, preview);
+        }
+    }
+
+    if(preview.isNull())
+    {
+        if(!isCurrent(generation))
+            return QImage();
+
+        // check whether image is supported
+        QList<QByteArray> supportedImgs = QImageReader::supportedImageFormats();
+
+        if(!supportedImgs.contains(filePath.section(".", -1).toLatin1()))
+            return QImage();
+
+        // decode the image itself otherwise
+        preview = decodeScaled(filePath, maxSourceSize);
+
+        if(preview.isNull())
+            return QImage();
+
+        source = ExifTreeModel::PreviewDecoded;
+    }
+
+    if(!isCurrent(generation))
+        return QImage();
+
+    qDebug("AnalogExif: PreviewScheduler::render(%s) served by %s", qPrintable(filePath), ExifTreeModel::previewSourceName(source));
+
+    return preview;
+}
@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PREVIEWSCHEDULER_H
+#define PREVIEWSCHEDULER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <QMutex>
+
+class ExifTreeModel;
+
+// loads file previews in the background
+//
+// only the latest request matters: queued requests are dropped when a new
+// one comes in, running ones give up at the next stage and results of
+// superseded requests are never delivered
+//
+// the loaded preview is kept as a pyramid of halved images, so the view
+// can be rescaled at any time from the closest level
+class PreviewScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit PreviewScheduler(ExifTreeModel* const model, QObject* const parent = nullptr);
+    ~PreviewScheduler();
+
+    // request preview of the file fitting into targetSize, supersedes all previous requests
+    void request(const QString& filePath, const QByteArray& embeddedPreview, const QSize& targetSize);
+
+    // drop the current request (e.g. selection cleared)
+    void cancel();
+
+    // rescale current preview to the new size in the background
+    void resize(const QSize& targetSize);
+
+    // threads used for preview decoding, separate from the global pool
+    static const int maxThreads = 2;
+
+    // longer side of the largest pyramid level
+    static const int maxSourceSize = 2560;
+
+    // peak memory of a decode, larger pages are read in bands or one at a time
+    static const qint64 maxDecodeBytes = 512 * 1024 * 1024;
+
+Q_SIGNALS:
+
+    void previewReady(const QString& filePath, const QImage& preview);
+
+private Q_SLOTS:
+
+    // called on the scheduler thread with the result of a request
+    void deliver(int generation, const QString& filePath, const QImage& preview);
+
+private:
+
+    friend class PreviewTask;
+    friend class PreviewScaleTask;
+
+    // loads the preview, returns null image if failed or superseded
+    QImage render(int generation, const QString& filePath, const QByteArray& embeddedPreview);
+
+    // decode only as many pixels of the image as maxSize needs
+    static QImage decodeScaled(const QString& filePath, int maxSize);
+
+    // decode page in horizontal bands within maxDecodeBytes, scaling each of them
+    static QImage decodeBands(const QString& filePath, int page, const QSize& fullSize, const QSize& scaledSize, int bitsPerPixel);
+
+    // build pyramid of the loaded preview, the first level is the largest one
+    static QVector<QImage> buildPyramid(const QImage& source);
+
+    // scale from the smallest level still covering the target size
+    static QImage scaleFromPyramid(const QVector<QImage>& pyramid, const QSize& targetSize);
+
+    // store pyramid of the current request, returns false if superseded meanwhile
+    bool setPyramid(int generation, const QString& filePath, const QVector<QImage>& pyramid);
+
+    // current target size
+    QSize targetSize() const;
+
+    bool isCurrent(int generation) const
+    {
+        return (m_generation.load() == generation);
+    }
+
+    bool isCurrentScale(int generation) const
+    {
+        return (m_scaleGeneration.load() == generation);
+    }
+
+    ExifTreeModel*  m_model;
+    QThreadPool     m_pool;
+    QAtomicInt      m_generation;
+    QAtomicInt      m_scaleGeneration;
+
+    // guards the members below
+    mutable QMutex  m_mutex;
+    QVector<QImage> m_pyramid;
+    QString         m_pyramidPath;
+    QSize           m_targetSize;
+};
+
+#endif // PREVIEWSCHEDULER_H
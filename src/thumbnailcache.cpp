@@ -0,0 +1,311 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnailcache.h"
+
+// Qt includes
+
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QDir>
+#include <QDirIterator>
+#include <QHash>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+// C++ includes
+
+#include <algorithm>
+
+namespace
+{
+    // in-memory level, guarded by the mutex
+    QMutex                  cacheMutex;
+    QCache<QString, QImage> memoryCache(ThumbnailCache::memoryBudget);
+    // key of the last known state of each file
+    QHash<QString, QString> fileKeys;
+
+    // bytes on the disk level, -1 until counted
+    QAtomicInteger<qint64>  diskBytes(-1);
+    // held by the running trim
+    QMutex                  trimMutex;
+
+    // statistics
+    QAtomicInt              memoryHits;
+    QAtomicInt              diskHits;
+    QAtomicInt              misses;
+
+    // in-memory cost of the image
+    int imageCost(const QImage& image)
+    {
+        return qMax(1, image.bytesPerLine() * image.height());
+    }
+
+    bool olderFirst(const QFileInfo& a, const QFileInfo& b)
+    {
+        return (a.lastModified() < b.lastModified());
+    }
+}
+
+QString ThumbnailCache::cacheKey(const QString& filePath)
+{
+    QFileInfo info(filePath);
+
+    if(!info.exists())
+        return QString();
+
+    QByteArray key = info.absoluteFilePath().toUtf8();
+    key += '\0';
+    key += QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+    key += '\0';
+    key += QByteArray::number(info.size());
+
+    return QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex());
+}
+
+QString ThumbnailCache::diskFolder()
+{
+    static const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails/";
+
+    return cacheDir;
+}
+
+QString ThumbnailCache::diskPath(const QString& key)
+{
+    // spread over 256 subfolders
+    return diskFolder() + key.left(2) + "/" + key + ".jpg";
+}
+
+void ThumbnailCache::updateKey(const QString& filePath, const QString& key)
+{
+    QString staleKey;
+
+    {
+        QMutexLocker locker(&cacheMutex);
+
+        QString absolutePath = QFileInfo(filePath).absoluteFilePath();
+
+        staleKey = fileKeys.value(absolutePath);
+
+        if(staleKey == key)
+            return;
+
+        fileKeys.insert(absolutePath, key);
+
+        if(!staleKey.isEmpty())
+            memoryCache.remove(staleKey);
+    }
+
+    // the file changed since, its old thumbnail is never found again
+    if(!staleKey.isEmpty())
+        QFile::remove(diskPath(staleKey));
+}
+
+QImage ThumbnailCache::find(const QString& filePath, bool memoryOnly)
+{
+    QString key = cacheKey(filePath);
+
+    if(key.isEmpty())
+        return QImage();
+
+    updateKey(filePath, key);
+
+    {
+        QMutexLocker locker(&cacheMutex);
+
+        if(QImage* const cached = memoryCache.object(key))
+        {
+            memoryHits.ref();
+            return *cached;
+        }
+    }
+
+    if(memoryOnly)
+        return QImage();
+
+    QImage thumbnail;
+    QString path = diskPath(key);
+
+    if(thumbnail.load(path, "JPG"))
+    {
+        diskHits.ref();
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        // time stamp is the last use, trimDisk() drops the oldest ones first
+        QFile file(path);
+        QDateTime now = QDateTime::currentDateTime();
+
+        if((QFileInfo(path).lastModified().secsTo(now) > diskTouchSecs) && file.open(QIODevice::Append))
+            file.setFileTime(now, QFileDevice::FileModificationTime);
+#endif
+
+        // promote to memory level
+        QMutexLocker locker(&cacheMutex);
+        memoryCache.insert(key, new QImage(thumbnail), imageCost(thumbnail));
+
+        return thumbnail;
+    }
+
+    misses.ref();
+
+    return QImage();
+}
+
+void ThumbnailCache::insert(const QString& filePath, const QImage& thumbnail)
+{
+    if(thumbnail.isNull())
+        return;
+
+    QString key = cacheKey(filePath);
+
+    if(key.isEmpty())
+        return;
+
+    updateKey(filePath, key);
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        memoryCache.insert(key, new QImage(thumbnail), imageCost(thumbnail));
+    }
+
+    // compressing is not for the caller's thread
+    QtConcurrent::run(&ThumbnailCache::store, key, thumbnail);
+}
+
+void ThumbnailCache::remove(const QString& filePath)
+{
+    QStringList keys;
+
+    {
+        QMutexLocker locker(&cacheMutex);
+
+        // the file is usually modified already, its thumbnails are under the previous key
+        keys << fileKeys.take(QFileInfo(filePath).absoluteFilePath()) << cacheKey(filePath);
+
+        foreach(const QString& key, keys)
+        {
+            if(!key.isEmpty())
+                memoryCache.remove(key);
+        }
+    }
+
+    foreach(const QString& key, keys)
+    {
+        if(!key.isEmpty())
+            QFile::remove(diskPath(key));
+    }
+}
+
+void ThumbnailCache::store(const QString& key, const QImage& thumbnail)
+{
+    QString path = diskPath(key);
+
+    if(QFileInfo::exists(path))
+        return;
+
+    if(!QDir().mkpath(QFileInfo(path).absolutePath()))
+        return;
+
+    // write via temporary file, concurrent readers never see partial thumbnail
+    QSaveFile file(path);
+
+    if(!file.open(QIODevice::WriteOnly))
+        return;
+
+    if(!thumbnail.save(&file, "JPG", 90) || !file.commit())
+    {
+        qDebug("AnalogExif: ThumbnailCache::store() unable to write %s", qPrintable(path));
+        return;
+    }
+
+    qint64 used = diskBytes.load();
+    qint64 size = QFileInfo(path).size();
+
+    // the first store of the session counts the disk level
+    if((used < 0) || (used + size > diskBudget))
+        trimDisk();
+    else
+        diskBytes.fetchAndAddRelaxed(size);
+}
+
+void ThumbnailCache::trimDisk()
+{
+    // one trim at a time, it counts the thumbnails stored meanwhile as well
+    if(!trimMutex.tryLock())
+        return;
+
+    QList<QFileInfo> files;
+    qint64 total = 0;
+    int removed = 0;
+
+    QDirIterator it(diskFolder(), QStringList() << "*.jpg", QDir::Files, QDirIterator::Subdirectories);
+
+    while(it.hasNext())
+    {
+        it.next();
+
+        files << it.fileInfo();
+        total += it.fileInfo().size();
+    }
+
+    if(total > diskBudget)
+    {
+        // least recently used first, disk hits refresh the time stamp
+        std::sort(files.begin(), files.end(), olderFirst);
+
+        for(int i = 0; (i < files.count()) && (total > diskBudget / 4 * 3); i++)
+        {
+            if(QFile::remove(files.at(i).absoluteFilePath()))
+            {
+                total -= files.at(i).size();
+                removed++;
+            }
+        }
+
+        qDebug("AnalogExif: ThumbnailCache::trimDisk() %d thumbnail(s) removed, %lld KiB left", removed, total / 1024);
+    }
+
+    diskBytes.store(total);
+
+    trimMutex.unlock();
+}
+
+QString ThumbnailCache::statistics()
+{
+    int memory;
+    int used;
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        memory = memoryCache.count();
+        used   = memoryCache.totalCost();
+    }
+
+    return QString("memory hits %1, disk hits %2, misses %3, %4 thumbnails (%5 KiB) in memory")
+            .arg(memoryHits.load()).arg(diskHits.load()).arg(misses.load())
+            .arg(memory).arg(used / 1024);
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+// Qt includes
+
+#include <QString>
+#include <QImage>
+
+// two-level thumbnail cache shared by the file view and the preview pane
+//
+// thumbnails are keyed by file path, modification time and size, so a
+// modified file simply misses; the first level is an in-memory LRU with a
+// byte budget, the second one compressed thumbnails in the user cache folder,
+// trimmed to its own budget by dropping the least recently used ones
+class ThumbnailCache
+{
+public:
+    // cached thumbnail of the file or null image; memoryOnly skips the disk lookup
+    static QImage find(const QString& filePath, bool memoryOnly = false);
+
+    // store thumbnail of the file in memory and (in background) on disk
+    static void insert(const QString& filePath, const QImage& thumbnail);
+
+    // drop thumbnails of the file, in memory and on disk
+    static void remove(const QString& filePath);
+
+    // one-line hit/miss report
+    static QString statistics();
+
+    // budget of the in-memory level
+    static const int memoryBudget = 64 * 1024 * 1024;
+
+    // budget of the disk level, trimmed to 3/4 of it when exceeded
+    static const qint64 diskBudget = 256 * 1024 * 1024;
+
+    // disk hits refresh the time stamp used for the LRU order at most this often
+    static const int diskTouchSecs = 24 * 60 * 60;
+
+private:
+    // cache key of the current file state, empty if file does not exist
+    static QString cacheKey(const QString& filePath);
+
+    // folder and location of the on-disk thumbnails
+    static QString diskFolder();
+    static QString diskPath(const QString& key);
+
+    // remember the key of the file, removes the one of its previous state
+    static void updateKey(const QString& filePath, const QString& key);
+
+    // remove the least recently used thumbnails over the disk budget
+    static void trimDisk();
+
+    // write thumbnail to the disk level
+    static void store(const QString& key, const QImage& thumbnail);
+};
+
+#endif // THUMBNAILCACHE_H
@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnailprefetcher.h"
+
+// Qt includes
+
+#include <QListView>
+#include <QScrollBar>
+#include <QFileSystemModel>
+#include <QFileInfo>
+#include <QStringList>
+
+// Local includes
+
+#include "fileiconprovider.h"
+
+ThumbnailPrefetcher::ThumbnailPrefetcher(QListView* const view, FileIconProvider* const provider, QObject* const parent)
+    : QObject(parent),
+      m_view(view),
+      m_provider(provider),
+      m_lastValue(0),
+      m_direction(1)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(100);
+
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(slotPrefetch()));
+
+    connect(m_view->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(slotScrolled(int)));
+
+    // folder contents arrive in chunks
+    connect(m_view->model(), SIGNAL(rowsInserted(QModelIndex,int,int)),
+            this, SLOT(slotSchedule()));
+    connect(m_view->model(), SIGNAL(layoutChanged()),
+            this, SLOT(slotSchedule()));
+    connect(m_view->model(), SIGNAL(modelReset()),
+            this, SLOT(slotSchedule()));
+}
+
+void ThumbnailPrefetcher::slotScrolled(int value)
+{
+    if(value != m_lastValue)
+        m_direction = (value > m_lastValue) ? 1 : -1;
+
+    m_lastValue = value;
+
+    slotSchedule();
+}
+
+void ThumbnailPrefetcher::slotSchedule()
+{
+    m_timer.start();
+}
+
+void ThumbnailPrefetcher::slotPrefetch()
+{
+    QAbstractItemModel* const model = m_view->model();
+    QModelIndex root = m_view->rootIndex();
+    int rowCount = model->rowCount(root);
+
+    if(rowCount == 0)
+        return;
+
+    // visible range
+    QModelIndex first = m_view->indexAt(QPoint(1, 1));
+    QModelIndex last = m_view->indexAt(QPoint(1, m_view->viewport()->height() - 2));
+
+    int firstRow = first.isValid() ? first.row() : 0;
+    int lastRow = last.isValid() ? last.row() : rowCount - 1;
+    int page = lastRow - firstRow + 1;
+
+    int aheadFrom, aheadTo, behindFrom, behindTo;
+
+    if(m_direction > 0)
+    {
+        aheadFrom = lastRow + 1;
+        aheadTo = qMin(rowCount - 1, lastRow + screensAhead * page);
+        behindFrom = firstRow - 1;
+        behindTo = qMax(0, firstRow - page / 2);
+    }
+    else
+    {
+        aheadFrom = firstRow - 1;
+        aheadTo = qMax(0, firstRow - screensAhead * page);
+        behindFrom = lastRow + 1;
+        behindTo = qMin(rowCount - 1, lastRow + page / 2);
+    }
+
+    QStringList filePaths;
+
+    // nearest rows first, the ones ahead before the ones behind
+    for(int pass = 0; pass < 2; pass++)
+    {
+        int from = (pass == 0) ? aheadFrom : behindFrom;
+        int to = (pass == 0) ? aheadTo : behindTo;
+        int step = (from <= to) ? 1 : -1;
+
+        if((from < 0) || (from >= rowCount))
+            continue;
+
+        for(int row = from; row != to + step; row += step)
+        {
+            QString filePath = model->data(model->index(row, 0, root), QFileSystemModel::FilePathRole).toString();
+
+            if(!filePath.isEmpty() && !QFileInfo(filePath).isDir())
+                filePaths.append(filePath);
+        }
+    }
+
+    m_provider->prefetch(filePaths);
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAILPREFETCHER_H
+#define THUMBNAILPREFETCHER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QTimer>
+
+class QListView;
+class FileIconProvider;
+
+// keeps thumbnails of the rows around the visible part of the file view warm
+//
+// rows in the scroll direction are requested up to screensAhead screens in
+// advance, half a screen is kept behind; requests go to the low priority
+// queue of the icon provider, so visible rows are never delayed
+class ThumbnailPrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    ThumbnailPrefetcher(QListView* const view, FileIconProvider* const provider, QObject* const parent = nullptr);
+
+    static const int screensAhead = 2;
+
+private Q_SLOTS:
+
+    void slotScrolled(int value);
+    void slotSchedule();
+    void slotPrefetch();
+
+private:
+
+    QListView*          m_view;
+    FileIconProvider*   m_provider;
+
+    // delays prefetch until scrolling settles a bit
+    QTimer              m_timer;
+
+    int                 m_lastValue;
+    // 1 = scrolling down, -1 = up
+    int                 m_direction;
+};
+
+#endif // THUMBNAILPREFETCHER_H
@@ -0,0 +1,164 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// Qt includes
+
+#include <QtTest>
+
+// Local includes
+
+#include "choicelist.h"
+
+// lookups of the parsed choice lists against a plain QVariant search
+class ChoiceListTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void parse_data();
+    void parse();
+
+    void lookup_data();
+    void lookup();
+
+    void cache();
+};
+
+void ChoiceListTest::parse_data()
+{
+    QTest::addColumn<QString>("list");
+    QTest::addColumn<int>("type");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("integers") << "Auto||0;;Manual||1;;Program||2" << (int)ExifItem::TagInteger << 3;
+    QTest::newRow("strings") << "Yes||Y;;No||N" << (int)ExifItem::TagString << 2;
+    QTest::newRow("fractions") << "1/125||1/125;;1/60||1/60" << (int)ExifItem::TagFraction << 2;
+    QTest::newRow("trailing separator") << "Auto||0;;Manual||1;;" << (int)ExifItem::TagInteger << 2;
+    QTest::newRow("malformed") << "Auto||0;;Manual" << (int)ExifItem::TagInteger << 0;
+    QTest::newRow("empty") << "" << (int)ExifItem::TagInteger << 0;
+}
+
+void ChoiceListTest::parse()
+{
+    QFETCH(QString, list);
+    QFETCH(int, type);
+    QFETCH(int, count);
+
+    QSharedPointer<const ChoiceList> choices = ChoiceList::get(list, (ExifItem::TagType)type);
+
+    QCOMPARE(choices->count(), count);
+
+    // texts and values in the order of the list
+    QStringList items = list.split(";;", QString::SkipEmptyParts);
+
+    for(int i = 0; i < choices->count(); i++)
+    {
+        QStringList values = items.at(i).split("||", QString::SkipEmptyParts);
+
+        QCOMPARE(choices->text(i), values.at(0));
+        QCOMPARE(choices->value(i), ExifItem::valueFromString(values.at(1), (ExifItem::TagType)type));
+    }
+}
+
+void ChoiceListTest::lookup_data()
+{
+    QTest::addColumn<QString>("list");
+    QTest::addColumn<int>("type");
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<int>("index");
+
+    const QString integers = "Auto||0;;Manual||1;;Program||2";
+
+    QTest::newRow("int") << integers << (int)ExifItem::TagInteger << QVariant(1) << 1;
+    QTest::newRow("first int") << integers << (int)ExifItem::TagInteger << QVariant(0) << 0;
+    QTest::newRow("missing int") << integers << (int)ExifItem::TagInteger << QVariant(5) << -1;
+    QTest::newRow("uint") << integers << (int)ExifItem::TagInteger << QVariant(2u) << 2;
+    QTest::newRow("longlong") << integers << (int)ExifItem::TagInteger << QVariant(Q_INT64_C(2)) << 2;
+    QTest::newRow("double") << integers << (int)ExifItem::TagInteger << QVariant(1.0) << 1;
+    QTest::newRow("number string") << integers << (int)ExifItem::TagInteger << QVariant(QString("2")) << 2;
+    QTest::newRow("text") << integers << (int)ExifItem::TagInteger << QVariant(QString("Manual")) << -1;
+    QTest::newRow("null") << integers << (int)ExifItem::TagInteger << QVariant() << -1;
+    QTest::newRow("duplicate int") << "Off||0;;None||0;;On||1" << (int)ExifItem::TagInteger << QVariant(0) << 0;
+    QTest::newRow("int after invalid") << "Auto||x;;One||1" << (int)ExifItem::TagInteger << QVariant(1) << 1;
+    QTest::newRow("null after invalid") << "Auto||x;;One||1" << (int)ExifItem::TagInteger << QVariant() << 0;
+    QTest::newRow("string") << "Yes||Y;;No||N" << (int)ExifItem::TagString << QVariant(QString("N")) << 1;
+    QTest::newRow("missing string") << "Yes||Y;;No||N" << (int)ExifItem::TagString << QVariant(QString("n")) << -1;
+    QTest::newRow("number in strings") << "One||1;;Two||2" << (int)ExifItem::TagString << QVariant(2) << 1;
+    QTest::newRow("fraction") << "1/125||1/125;;1/60||1/60" << (int)ExifItem::TagFraction << QVariant(QVariantList() << 1 << 60) << 1;
+    QTest::newRow("missing fraction") << "1/125||1/125;;1/60||1/60" << (int)ExifItem::TagFraction << QVariant(QVariantList() << 1 << 30) << -1;
+    QTest::newRow("malformed") << "Auto||0;;Manual" << (int)ExifItem::TagInteger << QVariant(0) << -1;
+}
+
+void ChoiceListTest::lookup()
+{
+    QFETCH(QString, list);
+    QFETCH(int, type);
+    QFETCH(QVariant, value);
+    QFETCH(int, index);
+
+    QSharedPointer<const ChoiceList> choices = ChoiceList::get(list, (ExifItem::TagType)type);
+
+    // the first value that equals as QVariant
+    int expected = -1;
+
+    for(int i = 0; i < choices->count(); i++)
+    {
+        if(choices->value(i) == value)
+        {
+            expected = i;
+            break;
+        }
+    }
+
+    QCOMPARE(expected, index);
+
+    QCOMPARE(choices->indexOf(value), index);
+    QCOMPARE(choices->indexOf(ExifValue(value)), index);
+
+    QString text = (index < 0) ? QString() : choices->text(index);
+
+    QCOMPARE(choices->textOf(value), text);
+    QCOMPARE(choices->textOf(ExifValue(value)), text);
+    QCOMPARE(ExifItem::findChoiceTextByValue(list, value, (ExifItem::TagType)type), text);
+}
+
+void ChoiceListTest::cache()
+{
+    const QString list = "Auto||0;;Manual||1";
+
+    QSharedPointer<const ChoiceList> choices = ChoiceList::get(list, ExifItem::TagInteger);
+
+    // parsed once per list, type and flags
+    QCOMPARE(ChoiceList::get(list, ExifItem::TagInteger), choices);
+    QVERIFY(ChoiceList::get(list, ExifItem::TagString) != choices);
+    QVERIFY(ChoiceList::get(list, ExifItem::TagInteger, ExifItem::Multi) != choices);
+
+    ChoiceList::clearCache();
+
+    // lists already handed out stay valid
+    QSharedPointer<const ChoiceList> reparsed = ChoiceList::get(list, ExifItem::TagInteger);
+
+    QVERIFY(reparsed != choices);
+    QCOMPARE(choices->textOf(QVariant(1)), QString("Manual"));
+    QCOMPARE(reparsed->textOf(QVariant(1)), QString("Manual"));
+}
+
+QTEST_MAIN(ChoiceListTest)
+
+#include "choicelisttest.moc"
@@ -0,0 +1,239 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// Qt includes
+
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+// Local includes
+
+#include "editgeartreemodel.h"
+
+// subtree copy and delete of the gear library on an in-memory database
+class EditGearTreeModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void init();
+    void cleanup();
+
+    void copyNestedSubtree();
+    void deleteNestedSubtree();
+    void deepChain();
+    void copyKeepsDeletedIds();
+    void cycleTerminates();
+
+private:
+
+    // insert gear with one property, returns its id
+    int addGear(int parentId, const QString& name);
+
+    // single number result of the statement
+    int queryInt(const QString& statement);
+};
+
+void EditGearTreeModelTest::init()
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(":memory:");
+
+    QVERIFY(db.open());
+
+    // library tables used by the model, as in NewDb.ael
+    QStringList statements;
+
+    statements << "CREATE TABLE UserGearItems (id INTEGER PRIMARY KEY AUTOINCREMENT, ParentId INTEGER REFERENCES UserGearItems(id), "
+                  "GearType NUMERIC DEFAULT 0 NOT NULL, GearName TEXT NOT NULL, OrderBy NUMERIC DEFAULT 0 NOT NULL)"
+               << "CREATE TABLE UserGearProperties (id INTEGER PRIMARY KEY AUTOINCREMENT, GearId INTEGER REFERENCES UserGearItems(id), "
+                  "TagId INTEGER, TagValue TEXT NULL, OrderBy NUMERIC DEFAULT 0 NOT NULL, AltValue TEXT NULL)"
+               << "CREATE TABLE GearTemplate (id INTEGER PRIMARY KEY AUTOINCREMENT, GearType NUMERIC DEFAULT 0 NOT NULL, "
+                  "TagId INTEGER, OrderBy NUMERIC DEFAULT 0 NOT NULL)";
+
+    QSqlQuery query;
+
+    foreach(const QString& statement, statements)
+    {
+        QVERIFY2(query.exec(statement), qPrintable(query.lastError().text()));
+    }
+}
+
+void EditGearTreeModelTest::cleanup()
+{
+    QString connection;
+
+    {
+        QSqlDatabase db = QSqlDatabase::database();
+        connection = db.connectionName();
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connection);
+}
+
+int EditGearTreeModelTest::addGear(int parentId, const QString& name)
+{
+    QSqlQuery query;
+
+    if(!query.exec(QString("INSERT INTO UserGearItems(ParentId, GearType, GearName) VALUES(%1, 0, '%2')").arg(parentId).arg(name)))
+        return -1;
+
+    int id = query.lastInsertId().toInt();
+
+    if(!query.exec(QString("INSERT INTO UserGearProperties(GearId, TagId, TagValue) VALUES(%1, 1, '%2')").arg(id).arg(name)))
+        return -1;
+
+    return id;
+}
+
+int EditGearTreeModelTest::queryInt(const QString& statement)
+{
+    QSqlQuery query;
+
+    if(!query.exec(statement) || !query.first())
+        return -1;
+
+    return query.value(0).toInt();
+}
+
+void EditGearTreeModelTest::copyNestedSubtree()
+{
+    int body = addGear(0, "Body");
+    int lens = addGear(body, "Lens");
+    addGear(lens, "Filter");
+    addGear(body, "Back");
+    addGear(0, "Other");
+
+    EditGearTreeModel model(0, 0, true);
+
+    int copy = model.createNewGear(body, 0, 0, "Copy of ", -1);
+
+    QVERIFY(copy != -1);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 9);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties"), 9);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE id = %1 AND GearName = 'Copy of Body' AND ParentId = 0").arg(copy)), 1);
+
+    // children hang below the copies, not below the originals
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE ParentId = %1").arg(copy)), 2);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE ParentId = %1").arg(body)), 2);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems f JOIN UserGearItems l ON f.ParentId = l.id "
+                              "WHERE f.GearName = 'Filter' AND l.GearName = 'Lens' AND l.ParentId = %1").arg(copy)), 1);
+
+    // properties follow their gear
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties p JOIN UserGearItems a ON p.GearId = a.id "
+                      "WHERE p.TagValue <> a.GearName AND a.GearName NOT LIKE 'Copy of %'"), 0);
+}
+
+void EditGearTreeModelTest::deleteNestedSubtree()
+{
+    int body = addGear(0, "Body");
+    int lens = addGear(body, "Lens");
+    addGear(lens, "Filter");
+    addGear(body, "Back");
+    int other = addGear(0, "Other");
+    addGear(other, "Other lens");
+
+    EditGearTreeModel model(0, 0, true);
+
+    QVERIFY(model.deleteGear(body, 0));
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 2);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties"), 2);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE id = %1 OR ParentId = %1").arg(other)), 2);
+}
+
+void EditGearTreeModelTest::deepChain()
+{
+    // far deeper than any real library, nothing is cut off
+    int root = addGear(0, "Item 0");
+    int parent = root;
+
+    for(int depth = 1; depth < 200; depth++)
+        parent = addGear(parent, QString("Item %1").arg(depth));
+
+    EditGearTreeModel model(0, 0, true);
+
+    int copy = model.createNewGear(root, 0, 0, "Copy of ", -1);
+
+    QVERIFY(copy != -1);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 400);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties"), 400);
+
+    // the copied chain ends in a copy of the last item
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE GearName = 'Item 199' AND ParentId > %1").arg(parent)), 1);
+
+    QVERIFY(model.deleteGear(root, 0));
+
+    // the whole original chain is gone, no orphans left
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 200);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE id <= %1").arg(parent)), 0);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties"), 200);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems a LEFT JOIN UserGearItems p ON a.ParentId = p.id WHERE a.ParentId <> 0 AND p.id IS NULL"), 0);
+}
+
+void EditGearTreeModelTest::copyKeepsDeletedIds()
+{
+    int body = addGear(0, "Body");
+    addGear(body, "Lens");
+    int removed = addGear(0, "Removed");
+
+    EditGearTreeModel model(0, 0, true);
+
+    // the id of the deleted gear may still be referenced elsewhere
+    QVERIFY(model.deleteGear(removed, 0));
+
+    int copy = model.createNewGear(body, 0, 0, "Copy of ", -1);
+
+    QVERIFY(copy > removed);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE id = %1").arg(removed)), 0);
+
+    // AUTOINCREMENT continues after the copies
+    int next = addGear(0, "Next");
+
+    QVERIFY(next > copy + 1);
+}
+
+void EditGearTreeModelTest::cycleTerminates()
+{
+    // damaged library: two items parenting each other
+    int first = addGear(0, "First");
+    int second = addGear(first, "Second");
+
+    QSqlQuery query;
+    QVERIFY(query.exec(QString("UPDATE UserGearItems SET ParentId = %1 WHERE id = %2").arg(second).arg(first)));
+
+    EditGearTreeModel model(0, 0, true);
+
+    // each item is copied once, the copy is a proper tree
+    int copy = model.createNewGear(first, 0, 0, "Copy of ", -1);
+
+    QVERIFY(copy != -1);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 4);
+    QCOMPARE(queryInt(QString("SELECT COUNT(*) FROM UserGearItems WHERE ParentId = %1 AND GearName = 'Second'").arg(copy)), 1);
+
+    QVERIFY(model.deleteGear(first, 0));
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearItems"), 2);
+    QCOMPARE(queryInt("SELECT COUNT(*) FROM UserGearProperties"), 2);
+}
+
+QTEST_MAIN(EditGearTreeModelTest)
+
+#include "editgeartreemodeltest.moc"
@@ -0,0 +1,221 @@
+/*
+    Copyright (C) 2010 C-41 Bytes <contact@c41bytes.com>
+
+    This file is part of AnalogExif.
+
+    AnalogExif is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AnalogExif is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with AnalogExif.  If not, see <http://www.gnu.org/licenses/>.
+*/
+// Qt includes
+
+#include <QtTest>
+
+// Local includes
+
+#include "exifvalue.h"
+
+Q_DECLARE_METATYPE(ExifValue::Kind)
+
+// ExifValue against the QVariant it stands for
+class ExifValueTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void roundTrip_data();
+    void roundTrip();
+
+    void conversions_data();
+    void conversions();
+
+    void equality_data();
+    void equality();
+
+    void copy_data();
+    void copy();
+
+private:
+
+    // one value of every kind
+    void addValues();
+
+    static QVariantList variantList(const QVector<ExifValue>& values);
+};
+
+void ExifValueTest::addValues()
+{
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<ExifValue::Kind>("kind");
+
+    QDateTime dateTime(QDate(2010, 5, 1), QTime(12, 30, 15));
+
+    QTest::newRow("null") << QVariant() << ExifValue::Null;
+    QTest::newRow("int") << QVariant(-42) << ExifValue::Integer;
+    QTest::newRow("uint") << QVariant(42u) << ExifValue::Integer;
+    QTest::newRow("longlong") << QVariant(Q_INT64_C(-5000000000)) << ExifValue::Integer;
+    QTest::newRow("ulonglong") << QVariant(Q_UINT64_C(18000000000000000000)) << ExifValue::Integer;
+    QTest::newRow("bool") << QVariant(true) << ExifValue::Integer;
+    QTest::newRow("double") << QVariant(2.8) << ExifValue::Real;
+    QTest::newRow("float") << QVariant(0.5f) << ExifValue::Real;
+    QTest::newRow("empty string") << QVariant(QString("")) << ExifValue::String;
+    QTest::newRow("short string") << QVariant(QString("Kodak")) << ExifValue::String;
+    QTest::newRow("full short string") << QVariant(QString(ExifValue::shortStringCapacity, QChar('x'))) << ExifValue::String;
+    QTest::newRow("long string") << QVariant(QString("Kodak Portra 400 VC")) << ExifValue::String;
+    QTest::newRow("number string") << QVariant(QString("125")) << ExifValue::String;
+    QTest::newRow("date string") << QVariant(QString("2010-05-01T12:30:15")) << ExifValue::String;
+    QTest::newRow("datetime") << QVariant(dateTime) << ExifValue::DateTime;
+    QTest::newRow("rational") << QVariant(QVariantList() << 1 << 125) << ExifValue::Rational;
+    QTest::newRow("int list") << QVariant(QVariantList() << 1 << 2 << 3) << ExifValue::List;
+    QTest::newRow("real list") << QVariant(QVariantList() << 1.5 << 2.5) << ExifValue::List;
+    QTest::newRow("string list") << QVariant(QVariantList() << QString("a") << QString("Kodak Portra 400 VC")) << ExifValue::List;
+    QTest::newRow("nested list") << QVariant(QVariantList() << QVariant(QVariantList() << 1 << 2) << QString("alt")) << ExifValue::List;
+    QTest::newRow("empty list") << QVariant(QVariantList()) << ExifValue::List;
+    QTest::newRow("other") << QVariant(QStringList() << "a" << "b") << ExifValue::Other;
+}
+
+QVariantList ExifValueTest::variantList(const QVector<ExifValue>& values)
+{
+    QVariantList result;
+
+    foreach(const ExifValue& value, values)
+    {
+        result << value.toVariant();
+    }
+
+    return result;
+}
+
+void ExifValueTest::roundTrip_data()
+{
+    addValues();
+}
+
+void ExifValueTest::roundTrip()
+{
+    QFETCH(QVariant, value);
+    QFETCH(ExifValue::Kind, kind);
+
+    ExifValue exifValue(value);
+
+    QCOMPARE(exifValue.kind(), kind);
+    QCOMPARE(exifValue.isNull(), !value.isValid());
+
+    // same type and value back
+    QVariant result = exifValue.toVariant();
+
+    QCOMPARE(result.userType(), value.userType());
+    QCOMPARE(result, value);
+
+    // a two-int list counts as its two items, whether rational or multi-value
+    int count = !value.isValid() ? 0 : ((value.userType() == QMetaType::QVariantList) ? value.toList().count() : 1);
+
+    QCOMPARE(exifValue.count(), count);
+}
+
+void ExifValueTest::conversions_data()
+{
+    addValues();
+}
+
+void ExifValueTest::conversions()
+{
+    QFETCH(QVariant, value);
+
+    ExifValue exifValue(value);
+
+    QCOMPARE(exifValue.toInt(), value.toInt());
+    QCOMPARE(exifValue.toLongLong(), value.toLongLong());
+    QCOMPARE(exifValue.toDouble(), value.toDouble());
+    QCOMPARE(exifValue.toString(), value.toString());
+    QCOMPARE(exifValue.toStringList(), value.toStringList());
+    QCOMPARE(exifValue.toDateTime(), value.toDateTime());
+    QCOMPARE(variantList(exifValue.toList()), value.toList());
+}
+
+void ExifValueTest::equality_data()
+{
+    QTest::addColumn<QVariant>("first");
+    QTest::addColumn<QVariant>("second");
+
+    QDateTime dateTime(QDate(2010, 5, 1), QTime(12, 30, 15));
+
+    QTest::newRow("null, null") << QVariant() << QVariant();
+    QTest::newRow("same int") << QVariant(400) << QVariant(400);
+    QTest::newRow("other int") << QVariant(400) << QVariant(200);
+    QTest::newRow("int, uint") << QVariant(400) << QVariant(400u);
+    QTest::newRow("int, longlong") << QVariant(400) << QVariant(Q_INT64_C(400));
+    QTest::newRow("int, double") << QVariant(8) << QVariant(8.0);
+    QTest::newRow("int, other double") << QVariant(8) << QVariant(5.6);
+    QTest::newRow("int, number string") << QVariant(125) << QVariant(QString("125"));
+    QTest::newRow("int, string") << QVariant(125) << QVariant(QString("Kodak"));
+    QTest::newRow("same double") << QVariant(2.8) << QVariant(2.8);
+    QTest::newRow("other double") << QVariant(2.8) << QVariant(4.0);
+    QTest::newRow("same short string") << QVariant(QString("Kodak")) << QVariant(QString("Kodak"));
+    QTest::newRow("other short string") << QVariant(QString("Kodak")) << QVariant(QString("Ilford"));
+    QTest::newRow("prefix string") << QVariant(QString("Kodak")) << QVariant(QString("Kodak Portra 400 VC"));
+    QTest::newRow("same long string") << QVariant(QString("Kodak Portra 400 VC")) << QVariant(QString("Kodak Portra 400 VC"));
+    QTest::newRow("other long string") << QVariant(QString("Kodak Portra 400 VC")) << QVariant(QString("Kodak Portra 160 NC"));
+    QTest::newRow("same datetime") << QVariant(dateTime) << QVariant(dateTime);
+    QTest::newRow("other datetime") << QVariant(dateTime) << QVariant(dateTime.addSecs(1));
+    QTest::newRow("same rational") << QVariant(QVariantList() << 1 << 125) << QVariant(QVariantList() << 1 << 125);
+    QTest::newRow("other rational") << QVariant(QVariantList() << 1 << 125) << QVariant(QVariantList() << 1 << 250);
+    QTest::newRow("rational, list") << QVariant(QVariantList() << 1 << 125) << QVariant(QVariantList() << 1 << 125 << 1);
+    QTest::newRow("same list") << QVariant(QVariantList() << 1.5 << 2.5) << QVariant(QVariantList() << 1.5 << 2.5);
+    QTest::newRow("other list") << QVariant(QVariantList() << 1.5 << 2.5) << QVariant(QVariantList() << 1.5 << 3.5);
+    QTest::newRow("shorter list") << QVariant(QVariantList() << 1 << 2 << 3) << QVariant(QVariantList() << 1 << 2 << 3 << 4);
+    QTest::newRow("same other") << QVariant(QStringList() << "a" << "b") << QVariant(QStringList() << "a" << "b");
+    QTest::newRow("other other") << QVariant(QStringList() << "a" << "b") << QVariant(QStringList() << "a" << "c");
+}
+
+void ExifValueTest::equality()
+{
+    QFETCH(QVariant, first);
+    QFETCH(QVariant, second);
+
+    QCOMPARE(ExifValue(first) == ExifValue(second), first == second);
+    QCOMPARE(ExifValue(second) == ExifValue(first), second == first);
+    QCOMPARE(ExifValue(first) != ExifValue(second), first != second);
+}
+
+void ExifValueTest::copy_data()
+{
+    addValues();
+}
+
+void ExifValueTest::copy()
+{
+    QFETCH(QVariant, value);
+
+    ExifValue exifValue(value);
+
+    // copy constructor
+    ExifValue copied(exifValue);
+
+    QCOMPARE(copied.toVariant(), value);
+    QVERIFY(copied == exifValue);
+
+    // assignment over a value of another kind, and onto itself
+    ExifValue assigned(QVariant(QString("Kodak Portra 400 VC")));
+    assigned = exifValue;
+
+    ExifValue& self = assigned;
+    assigned = self;
+
+    QCOMPARE(assigned.toVariant(), value);
+    QVERIFY(assigned == exifValue);
+}
+
+QTEST_MAIN(ExifValueTest)
+
+#include "exifvaluetest.moc"